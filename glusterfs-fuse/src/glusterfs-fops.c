@@ -317,6 +317,63 @@ glusterfs_fsync (const char *path,
   return ret;
 }
 
+#if FUSE_USE_VERSION >= 29
+/* fallocate (2) and its hole punching / zeroing modes */
+static int
+glusterfs_fallocate (const char *path,
+		     int mode,
+		     off_t offset,
+		     off_t len,
+		     struct fuse_file_info *info)
+{
+  struct xlator *xlator = fuse_get_context ()->private_data;
+  int ret;
+
+  if (mode & FALLOC_FL_PUNCH_HOLE)
+    ret = xlator->fops->discard (xlator, path, offset, len, (void *)info->fh);
+  else if (mode & FALLOC_FL_ZERO_RANGE)
+    ret = xlator->fops->zerofill (xlator, path, offset, len, (void *)info->fh);
+  else if (mode & ~FALLOC_FL_KEEP_SIZE)
+    return -EOPNOTSUPP;
+  else
+    ret = xlator->fops->fallocate (xlator, path, mode & FALLOC_FL_KEEP_SIZE,
+				   offset, len, (void *)info->fh);
+  if (ret < 0)
+    ret = -errno;
+  else
+    errno = 0;
+  return ret;
+}
+#endif
+
+/* fuse has no copy_file_range, a setxattr of GF_XATTR_COPY_FROM on path
+   stands in for it: the bricks copy the named file over path. The first
+   copy tells whether they can (unify: both on one brick), path is only
+   cut to the copied length at the end */
+static int
+glusterfs_copy_from (const char *path,
+		     const char *value,
+		     size_t size)
+{
+  struct xlator *xlator = fuse_get_context ()->private_data;
+  char from[PATH_MAX] = {0,};
+  off_t offset = 0;
+  int ret;
+
+  if (size == 0 || size >= sizeof (from))
+    return -EINVAL;
+  memcpy (from, value, size);
+
+  while ((ret = xlator->fops->copy (xlator, from, offset,
+				    path, offset, GF_COPY_MAX)) > 0)
+    offset += ret;
+
+  if (ret < 0 || xlator->fops->truncate (xlator, path, offset) < 0)
+    return -errno;
+  errno = 0;
+  return 0;
+}
+
 static int
 glusterfs_setxattr (const char *path,
 		    const char *name,
@@ -325,6 +382,10 @@ glusterfs_setxattr (const char *path,
 		    int flags)
 {
   struct xlator *xlator = fuse_get_context ()->private_data;
+
+  if (strcmp (name, GF_XATTR_COPY_FROM) == 0)
+    return glusterfs_copy_from (path, value, size);
+
   int ret = xlator->fops->setxattr (xlator, path, name, value, size, flags);
   if (ret < 0)
     ret = -errno;
@@ -484,6 +545,31 @@ glusterfs_readdir (const char *path,
 		   struct fuse_file_info *info)
 {
   struct xlator *xlator = fuse_get_context ()->private_data;
+  char *page = malloc (GF_GETDENTS_PAGE);
+  off_t next = 0;
+  int count;
+
+  /* page by page, so no reply carries the whole directory */
+  while ((count = xlator->fops->getdents (xlator, path, next, page,
+					  GF_GETDENTS_PAGE, &next)) > 0) {
+    char *tmp;
+    char *tmp_lock;
+
+    tmp = strtok_r (page, "/", &tmp_lock);
+    while (tmp) {
+      fill (buf, tmp, NULL, 0);
+      tmp = strtok_r (NULL, "/", &tmp_lock);
+    }
+  }
+  free (page);
+
+  if (count == 0) {
+    errno = 0;
+    return 0;
+  }
+  if (errno != ENOSYS)
+    return -errno;
+
   char *ret = xlator->fops->readdir (xlator, path, offset);
   
   char *ret_orig = ret;
@@ -541,6 +627,9 @@ static struct fuse_operations glusterfs_fops = {
   .flush       = glusterfs_flush,
   .release     = glusterfs_release,
   .fsync       = glusterfs_fsync,
+#if FUSE_USE_VERSION >= 29
+  .fallocate   = glusterfs_fallocate,
+#endif
   .setxattr    = glusterfs_setxattr,
   .getxattr    = glusterfs_getxattr,
   .listxattr   = glusterfs_listxattr,
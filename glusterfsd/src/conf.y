@@ -1,4 +1,4 @@
-%token DIR_NAME KEY_LENGTH NEWLINE VALUE WHITESPACE COMMENT CHROOT SCRATCH NUMBER NUMBER_BYTE PORT ID PROTOCOL
+%token DIR_NAME KEY_LENGTH NEWLINE VALUE WHITESPACE COMMENT CHROOT SCRATCH NUMBER NUMBER_BYTE PORT ID PROTOCOL BACKLOG ACCEPTORS DATA_QUANTUM META_QUANTUM MAX_INFLIGHT
 
 %{
 #include <stdio.h>
@@ -11,6 +11,11 @@ static void set_scratch_dir (char *dir);
 static void set_key_len (char *key);
 static int  set_port_num (char *port);
 static void set_inet_prot (char *prot);
+static void set_backlog (char *backlog);
+static void set_acceptors (char *acceptors);
+static void set_data_quantum (char *quantum);
+static void set_meta_quantum (char *quantum);
+static void set_max_inflight (char *bytes);
 
 #define YYSTYPE char *
 
@@ -18,13 +23,18 @@ static void set_inet_prot (char *prot);
 
 %%
 C1: C1 C2 | C2;
-C2: KEY_LEN | PORT_NUM | SCRATCH_DIR | CHROOT_DIR | INET_PROT;
+C2: KEY_LEN | PORT_NUM | SCRATCH_DIR | CHROOT_DIR | INET_PROT | LISTEN_BACKLOG | ACCEPTOR_COUNT | DATA_QUANT | META_QUANT | INFLIGHT_BYTES;
 
 CHROOT_DIR: CHROOT ID {set_chroot_dir ($2);};
 SCRATCH_DIR: SCRATCH ID {set_scratch_dir ($2);};
 KEY_LEN: KEY_LENGTH ID {set_key_len ($2);};
 PORT_NUM: PORT ID {set_port_num ($2);};
 INET_PROT:  PROTOCOL ID {set_inet_prot ($2);};
+LISTEN_BACKLOG: BACKLOG ID {set_backlog ($2);};
+ACCEPTOR_COUNT: ACCEPTORS ID {set_acceptors ($2);};
+DATA_QUANT: DATA_QUANTUM ID {set_data_quantum ($2);};
+META_QUANT: META_QUANTUM ID {set_meta_quantum ($2);};
+INFLIGHT_BYTES: MAX_INFLIGHT ID {set_max_inflight ($2);};
 %%
 
 struct confd *complete_confd;
@@ -109,6 +119,41 @@ set_inet_prot (char *prot)
   complete_confd->inet_prot = strdup (prot);
 }
 
+static void 
+set_backlog (char *backlog)
+{
+  gf_log ("libglusterfs", LOG_DEBUG, "conf.y->set_backlog: listen backlog = %s\n", backlog);
+  complete_confd->backlog = atoi (backlog);
+}
+
+static void 
+set_acceptors (char *acceptors)
+{
+  gf_log ("libglusterfs", LOG_DEBUG, "conf.y->set_acceptors: acceptor threads = %s\n", acceptors);
+  complete_confd->acceptors = atoi (acceptors);
+}
+
+static void 
+set_data_quantum (char *quantum)
+{
+  gf_log ("libglusterfs", LOG_DEBUG, "conf.y->set_data_quantum: data quantum = %s\n", quantum);
+  complete_confd->data_quantum = atoi (quantum);
+}
+
+static void 
+set_meta_quantum (char *quantum)
+{
+  gf_log ("libglusterfs", LOG_DEBUG, "conf.y->set_meta_quantum: metadata quantum = %s\n", quantum);
+  complete_confd->meta_quantum = atoi (quantum);
+}
+
+static void 
+set_max_inflight (char *bytes)
+{
+  gf_log ("libglusterfs", LOG_DEBUG, "conf.y->set_max_inflight: max inflight bytes = %s\n", bytes);
+  complete_confd->max_inflight = atoi (bytes);
+}
+
 static void
 parse_error (void)
 {
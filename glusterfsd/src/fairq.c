@@ -0,0 +1,222 @@
+#include "glusterfsd.h"
+#include "fairq.h"
+#include "protocol.h"
+
+void
+fairq_sched_init (struct fairq_sched *sched,
+		  int data_quantum,
+		  int meta_quantum,
+		  int max_inflight)
+{
+  memset (sched, 0, sizeof (*sched));
+  sched->data_quantum = data_quantum;
+  sched->meta_quantum = meta_quantum;
+  sched->max_inflight = max_inflight;
+}
+
+/* bytes a READ asks for, the reply is what costs us; no reply is bigger
+   than a block. The parsed request stays in blk->dict for the handler */
+static int
+read_request_len (gf_block *blk)
+{
+  int len = 0;
+  dict_t *dict = get_new_dict ();
+
+  dict_unserialize (blk->data, blk->size, &dict);
+  if (!dict)
+    return 0;
+
+  len = data_to_int (dict_get (dict, "LEN"));
+  blk->dict = dict;
+
+  if (len > GLUSTERFSD_MAX_BLOCK_SIZE)
+    len = GLUSTERFSD_MAX_BLOCK_SIZE;
+  return (len > 0) ? len : 0;
+}
+
+static void
+request_cost (gf_block *blk, struct fairq_request *req)
+{
+  req->is_data = 0;
+  req->cost = 1;
+  req->bytes = blk->size;
+
+  if (blk->type != OP_TYPE_FOP_REQUEST)
+    return;
+
+  switch (blk->op) {
+  case OP_WRITE:
+    req->is_data = 1;
+    req->cost = blk->size;
+    break;
+  case OP_READ:
+    req->is_data = 1;
+    req->cost = read_request_len (blk);
+    req->bytes += req->cost;
+    break;
+  }
+}
+
+int
+fairq_can_enqueue (struct fairq_sched *sched,
+		   struct sock_private *sock_priv)
+{
+  return sock_priv->queue.queued_bytes < sched->max_inflight;
+}
+
+void
+fairq_enqueue (struct fairq_sched *sched,
+	       struct sock_private *sock_priv,
+	       gf_block *blk)
+{
+  struct fairq *queue = &sock_priv->queue;
+  struct fairq_request *req = calloc (1, sizeof (*req));
+
+  req->blk = blk;
+  request_cost (blk, req);
+
+  if (queue->tail)
+    queue->tail->next = req;
+  else
+    queue->head = req;
+  queue->tail = req;
+  queue->queued_bytes += req->bytes;
+
+  if (!queue->is_active) {
+    queue->is_active = 1;
+    queue->next_active = NULL;
+    if (sched->active_tail)
+      sched->active_tail->queue.next_active = sock_priv;
+    else
+      sched->active = sock_priv;
+    sched->active_tail = sock_priv;
+  }
+}
+
+int
+fairq_pending (struct fairq_sched *sched)
+{
+  return sched->active != NULL;
+}
+
+static struct fairq_request *
+fairq_dequeue (struct fairq *queue)
+{
+  struct fairq_request *req = queue->head;
+
+  queue->head = req->next;
+  if (!queue->head)
+    queue->tail = NULL;
+  queue->queued_bytes -= req->bytes;
+
+  return req;
+}
+
+static void
+fairq_serve (struct fairq_sched *sched,
+	     struct sock_private *sock_priv,
+	     fairq_dispatch_t dispatch)
+{
+  struct fairq *queue = &sock_priv->queue;
+
+  queue->deficit_data += sched->data_quantum;
+  queue->deficit_meta += sched->meta_quantum;
+
+  while (queue->head && !sock_priv->dead) {
+    struct fairq_request *req = queue->head;
+    int *deficit = req->is_data ? &queue->deficit_data : &queue->deficit_meta;
+
+    if (*deficit < req->cost)
+      break;
+
+    *deficit -= req->cost;
+    fairq_dequeue (queue);
+
+    if (dispatch (sock_priv, req->blk) != 0)
+      sock_priv->dead = 1;
+    free (req);
+  }
+
+  /* a class blocked behind the other one must not hoard budget */
+  if (queue->deficit_meta > sched->meta_quantum)
+    queue->deficit_meta = sched->meta_quantum;
+  if ((!queue->head || !queue->head->is_data) &&
+      queue->deficit_data > sched->data_quantum)
+    queue->deficit_data = sched->data_quantum;
+}
+
+/* rounds until the head of queue can go, 1 unless it is a data request
+   costing more than the deficit and a quantum */
+static int
+fairq_rounds_needed (struct fairq_sched *sched,
+		     struct fairq *queue)
+{
+  int need;
+
+  if (!queue->head || !queue->head->is_data || sched->data_quantum <= 0)
+    return 1;
+  need = queue->head->cost - queue->deficit_data;
+  if (need <= sched->data_quantum)
+    return 1;
+  return (need + sched->data_quantum - 1) / sched->data_quantum;
+}
+
+void
+fairq_round (struct fairq_sched *sched,
+	     fairq_dispatch_t dispatch)
+{
+  struct sock_private *trav;
+  int skip = -1;
+
+  /* rounds in which nobody could dispatch are done at once: everybody
+     gets their quanta for them, nothing else would happen in them */
+  for (trav = sched->active; trav && skip != 0; trav = trav->queue.next_active) {
+    int rounds = fairq_rounds_needed (sched, &trav->queue);
+
+    if (skip == -1 || rounds - 1 < skip)
+      skip = rounds - 1;
+  }
+  for (trav = sched->active; skip > 0 && trav; trav = trav->queue.next_active)
+    trav->queue.deficit_data += skip * sched->data_quantum;
+
+  trav = sched->active;
+  sched->active = NULL;
+  sched->active_tail = NULL;
+
+  while (trav) {
+    struct sock_private *next = trav->queue.next_active;
+    struct fairq *queue = &trav->queue;
+
+    queue->next_active = NULL;
+    if (!trav->dead)
+      fairq_serve (sched, trav, dispatch);
+
+    if (queue->head && !trav->dead) {
+      if (sched->active_tail)
+	sched->active_tail->queue.next_active = trav;
+      else
+	sched->active = trav;
+      sched->active_tail = trav;
+    } else {
+      queue->is_active = 0;
+      queue->deficit_data = 0;
+      queue->deficit_meta = 0;
+    }
+
+    trav = next;
+  }
+}
+
+/* free whatever a closing connection still has queued */
+void
+fairq_drop (struct sock_private *sock_priv)
+{
+  struct fairq *queue = &sock_priv->queue;
+
+  while (queue->head) {
+    struct fairq_request *req = fairq_dequeue (queue);
+
+    stream_block_free (req->blk);
+    free (req);
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef _FAIRQ_H
+#define _FAIRQ_H
+
+#include "protocol.h"
+
+/*
+  Per-client fair queuing in front of fop dispatch.
+
+  Every connection keeps a FIFO of received requests. The FIFO is never
+  reordered, replies must go back in request order. Connections with
+  pending requests sit on an active ring which is served by deficit round
+  robin: each round a connection is granted 'data_quantum' bytes of read
+  and write traffic and 'meta_quantum' other requests, and may dispatch
+  from the head of its FIFO as long as the budget of the head's class
+  lasts. A connection holding more than 'max_inflight' queued bytes is not
+  read from until its backlog drains. Rounds in which no connection could
+  dispatch anything are not spun through, their quanta are handed out at
+  once.
+*/
+
+struct sock_private;
+
+struct fairq_request {
+  struct fairq_request *next;
+  gf_block *blk;
+  int cost;       /* bytes for data ops, at most a block, 1 for everything else */
+  int bytes;      /* accounted against max_inflight */
+  char is_data;
+};
+
+struct fairq {
+  struct fairq_request *head;
+  struct fairq_request *tail;
+  struct sock_private *next_active;
+  int queued_bytes;
+  int deficit_data;
+  int deficit_meta;
+  char is_active;
+};
+
+struct fairq_sched {
+  struct sock_private *active;
+  struct sock_private *active_tail;
+  int data_quantum;  /* bytes per round */
+  int meta_quantum;  /* requests per round */
+  int max_inflight;  /* queued bytes per connection */
+};
+
+typedef int (*fairq_dispatch_t) (struct sock_private *sock_priv, gf_block *blk);
+
+void fairq_sched_init (struct fairq_sched *sched, int data_quantum,
+		       int meta_quantum, int max_inflight);
+int fairq_can_enqueue (struct fairq_sched *sched, struct sock_private *sock_priv);
+void fairq_enqueue (struct fairq_sched *sched, struct sock_private *sock_priv,
+		    gf_block *blk);
+int fairq_pending (struct fairq_sched *sched);
+void fairq_round (struct fairq_sched *sched, fairq_dispatch_t dispatch);
+void fairq_drop (struct sock_private *sock_priv);
+
+#endif /* _FAIRQ_H */
@@ -1,5 +1,6 @@
 
 #include "glusterfsd.h"
+#include "common-utils.h"
 #include <time.h>
 
 #if __WORDSIZE == 64
@@ -41,7 +42,7 @@ glusterfsd_open (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
   dict_set (dict, "FD", int_to_data (ctx));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
 
   return 0;
@@ -93,7 +94,7 @@ glusterfsd_release (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
   dict_set (dict, "RET", int_to_data (ret));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
 
   return  0;
@@ -119,7 +120,7 @@ glusterfsd_flush (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
 
   return  0;
@@ -148,7 +149,7 @@ glusterfsd_fsync (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
   dict_set (dict, "RET", int_to_data (ret));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return  0;
@@ -158,14 +159,22 @@ int
 glusterfsd_write (struct sock_private *sock_priv)
 {
   gf_block *blk = (gf_block *)sock_priv->private;
-  dict_t *dict = get_new_dict ();
-  dict_unserialize (blk->data, blk->size, &dict);
+  dict_t *dict = blk->dict;
+
+  if (dict) {
+    /* parsed by stream_recv_block (), BUF is in blk->vector */
+    blk->dict = NULL;
+  } else {
+    dict = get_new_dict ();
+    dict_unserialize (blk->data, blk->size, &dict);
+  }
   
   if (!dict)
     return -1;
   struct xlator *xl = sock_priv->xl;
   data_t *datat = dict_get (dict, "BUF");
   struct file_context *tmp_ctx = data_to_int (dict_get (dict, "FD"));
+  int ret;
 
   {
     struct file_ctx_list *fctxl = sock_priv->fctxl;
@@ -176,17 +185,27 @@ glusterfsd_write (struct sock_private *sock_priv)
       fctxl = fctxl->next;
     }
 
-    if (!fctxl)
+    if (!fctxl) {
       /* TODO: write error to socket instead of returning */
+      blk->dict = dict;
       return -1;
+    }
   }
 
-  int ret = xl->fops->write (xl,
-			     data_to_bin (dict_get (dict, "PATH")),
-			     datat->data,
-			     datat->len,
-			     data_to_int (dict_get (dict, "OFFSET")),
-			     tmp_ctx);
+  if (blk->vector)
+    ret = xl->fops->writev (xl,
+			    data_to_bin (dict_get (dict, "PATH")),
+			    blk->vector,
+			    blk->count,
+			    data_to_int (dict_get (dict, "OFFSET")),
+			    tmp_ctx);
+  else
+    ret = xl->fops->write (xl,
+			   data_to_bin (dict_get (dict, "PATH")),
+			   datat->data,
+			   datat->len,
+			   data_to_int (dict_get (dict, "OFFSET")),
+			   tmp_ctx);
 
   dict_del (dict, "PATH");
   dict_del (dict, "OFFSET");
@@ -198,27 +217,81 @@ glusterfsd_write (struct sock_private *sock_priv)
     dict_set (dict, "ERRNO", int_to_data (errno));
   }
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
 }
 
+/*
+  Find the data extents of [offset, offset + len) of an open file, as
+  [start, end) pairs relative to offset. Returns their number, or -1 if
+  the read should go out as it is: too few holes, too many extents, or
+  no extent map.
+*/
+static int
+read_extents (struct xlator *xl,
+	      const char *path,
+	      struct file_context *ctx,
+	      off_t offset,
+	      int len,
+	      int *extents)
+{
+  off_t pos = offset, end = offset + len;
+  int nr = 0, data_bytes = 0;
+
+  while (pos < end) {
+    off_t data_start, data_end;
+
+    if (xl->fops->seek (xl, path, pos, SEEK_DATA, &data_start, ctx) != 0) {
+      if (errno != ENXIO)
+	return -1;
+      break;
+    }
+    if (data_start >= end)
+      break;
+    if (nr == GF_SPARSE_MAX_EXTENTS)
+      return -1;
+    if (xl->fops->seek (xl, path, data_start, SEEK_HOLE, &data_end, ctx) != 0)
+      return -1;
+    if (data_end > end)
+      data_end = end;
+
+    extents[2 * nr] = data_start - offset;
+    extents[2 * nr + 1] = data_end - offset;
+    data_bytes += data_end - data_start;
+    nr++;
+    pos = data_end;
+  }
+
+  if (len - data_bytes < GF_SPARSE_MIN_HOLE)
+    return -1;
+  return nr;
+}
+
 int
 glusterfsd_read (struct sock_private *sock_priv)
 {
   int len = 0;
 
   gf_block *blk = (gf_block *)sock_priv->private;
-  dict_t *dict = get_new_dict ();
-  dict_unserialize (blk->data, blk->size, &dict);
+  dict_t *dict = blk->dict;
+
+  if (dict) {
+    /* parsed by fairq_enqueue () for its cost */
+    blk->dict = NULL;
+  } else {
+    dict = get_new_dict ();
+    dict_unserialize (blk->data, blk->size, &dict);
+  }
   
   if (!dict)
     return -1;
   struct xlator *xl = sock_priv->xl;
   int size = data_to_int (dict_get (dict, "LEN"));
-  static char *data = NULL;
-  static int data_len = 0;
+  /* per acceptor thread, see start_acceptors () */
+  static __thread char *data = NULL;
+  static __thread int data_len = 0;
 
   {
     struct file_context *tmp_ctx = data_to_int (dict_get (dict, "FD"));
@@ -230,16 +303,23 @@ glusterfsd_read (struct sock_private *sock_priv)
       fctxl = fctxl->next;
     }
 
-    if (!fctxl)
+    if (!fctxl) {
       /* TODO: write error to socket instead of returning */
+      blk->dict = dict;
       return -1;
+    }
   }
   
   if (size > 0) {
     if (size > data_len) {
       if (data)
 	free (data);
-      data = malloc (size * 2);
+      /* aligned, so an O_DIRECT brick can read straight into it */
+      if (posix_memalign ((void **)&data, getpagesize (), size * 2) != 0) {
+	data = NULL;
+	data_len = 0;
+	return -1;
+      }
       data_len = size * 2;
     }
     len = xl->fops->read (xl,
@@ -252,21 +332,42 @@ glusterfsd_read (struct sock_private *sock_priv)
     len = 0;
   }
 
+  int op_errno = errno;
+  int buf_len = len;
+  char holes[(GF_SPARSE_MAX_EXTENTS + 1) * 20];
+
+  holes[0] = '\0';
+  if (len >= GF_SPARSE_MIN_HOLE && dict_get (dict, "SPARSE")) {
+    int extents[2 * GF_SPARSE_MAX_EXTENTS];
+    int nr = read_extents (xl,
+			   data_to_str (dict_get (dict, "PATH")),
+			   (struct file_context *) data_to_int (dict_get (dict, "FD")),
+			   data_to_int (dict_get (dict, "OFFSET")),
+			   len,
+			   extents);
+
+    if (nr >= 0)
+      buf_len = sparse_compact (data, len, extents, nr, holes);
+  }
+
   dict_del (dict, "FD");
   dict_del (dict, "OFFSET");
   dict_del (dict, "LEN");
   dict_del (dict, "PATH");
+  dict_del (dict, "SPARSE");
 
   {
     dict_set (dict, "RET", int_to_data (len));
-    dict_set (dict, "ERRNO", int_to_data (errno));
-    if (len > 0)
-      dict_set (dict, "BUF", bin_to_data (data, len));
+    dict_set (dict, "ERRNO", int_to_data (op_errno));
+    if (buf_len > 0)
+      dict_set (dict, "BUF", bin_to_data (data, buf_len));
     else
       dict_set (dict, "BUF", bin_to_data (" ", 1));      
+    if (holes[0])
+      dict_set (dict, "HOLES", str_to_data (holes));
   }
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -299,7 +400,7 @@ glusterfsd_readdir (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   if (buf)
@@ -339,7 +440,7 @@ glusterfsd_readlink (struct sock_private *sock_priv)
     dict_set (dict, "ERRNO", int_to_data (errno));
   }
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -372,7 +473,7 @@ glusterfsd_mknod (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -404,7 +505,7 @@ glusterfsd_mkdir (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -428,7 +529,7 @@ glusterfsd_unlink (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -455,7 +556,7 @@ glusterfsd_chmod (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -485,7 +586,7 @@ glusterfsd_chown (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -512,7 +613,7 @@ glusterfsd_truncate (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -540,7 +641,7 @@ glusterfsd_ftruncate (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -572,7 +673,7 @@ glusterfsd_utime (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -596,7 +697,7 @@ glusterfsd_rmdir (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -627,7 +728,7 @@ glusterfsd_symlink (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -658,7 +759,7 @@ glusterfsd_rename (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -689,7 +790,7 @@ glusterfsd_link (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -738,7 +839,7 @@ glusterfsd_getattr (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -781,7 +882,7 @@ glusterfsd_statfs (struct sock_private *sock_priv)
     dict_set (dict, "BUF", str_to_data (buffer));
   }
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -813,7 +914,7 @@ glusterfsd_setxattr (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -843,7 +944,7 @@ glusterfsd_getxattr (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -869,7 +970,7 @@ glusterfsd_removexattr (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -902,7 +1003,7 @@ glusterfsd_listxattr (struct sock_private *sock_priv)
 
   free (list);
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -928,7 +1029,7 @@ glusterfsd_opendir (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -978,7 +1079,7 @@ glusterfsd_access (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -1031,7 +1132,7 @@ glusterfsd_fgetattr (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
   dict_set (dict, "BUF", str_to_data (buffer));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
   return 0;
 }
@@ -1039,11 +1140,13 @@ glusterfsd_fgetattr (struct sock_private *sock_priv)
 int 
 glusterfsd_bulk_getattr (struct sock_private *sock_priv)
 {
-  
-  struct bulk_stat *bstbuf = calloc (sizeof (struct bulk_stat), 1);
+  struct bulk_stat bstbuf = {0,};
   struct bulk_stat *curr = NULL;
-  struct stat *stbuf = NULL;
-  unsigned int nr_entries = 0;
+  struct bulk_stat_record *records = NULL;
+  char *names = NULL;
+  int nr_entries = 0;
+  int names_len = 0;
+  off_t next = 0;
 
   gf_block *blk = (gf_block *)sock_priv->private;
   dict_t *dict = get_new_dict ();
@@ -1052,82 +1155,272 @@ glusterfsd_bulk_getattr (struct sock_private *sock_priv)
   if (!dict)
     return -1;
   struct xlator *xl = sock_priv->xl;
-  char buffer[PATH_MAX*257] = {0,};
-  char *buffer_ptr = NULL;
   data_t *path_data = dict_get (dict, "PATH");
+  int ret = -1;
   
   if (!path_data){
     gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd-fops.c->bulk_getattr: dictionary entry for path missing\n");
-    goto fail;
-  }
-  char *path_bin = data_to_bin (path_data);
-  
-  if (!path_bin){
-    gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd-fops.c->bulk_getattr: getting pathname from dict failed\n");
+    errno = EINVAL;
     goto fail;
   }
 
-  int ret = xl->fops->bulk_getattr (xl,
-				    path_bin,
-				    bstbuf);
+  ret = xl->fops->bulk_getattr (xl,
+				data_to_str (path_data),
+				data_to_int (dict_get (dict, "OFFSET")),
+				&bstbuf,
+				&next);
   
   if (ret < 0){
     gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd-fops.c->bulk_getattr: child bulk_getattr failed\n");
     goto fail;
   }
   dict_del (dict, "PATH");
+  dict_del (dict, "OFFSET");
 
-  // convert bulk_stat structure to ASCII values (solving endian problem)
-  buffer_ptr = buffer;
-  curr = bstbuf->next;
+  /* fixed size records plus the names in the same order, '/' separated */
+  for (curr = bstbuf.next; curr; curr = curr->next) {
+    names_len += strlen (curr->pathname) + 1;
+    nr_entries++;
+  }
+  records = malloc (nr_entries * sizeof (*records) + 1);
+  names = malloc (names_len + 1);
+  names[0] = '\0';
+  names_len = 0;
+  nr_entries = 0;
+
+  curr = bstbuf.next;
   while (curr) {
     struct bulk_stat *prev = curr;
-    int bwritten = 0;
-    stbuf = curr->stbuf;
-    nr_entries++;
-    bwritten = sprintf (buffer_ptr, "%s/", curr->pathname);
-    buffer_ptr += bwritten;
-    bwritten = sprintf (buffer_ptr, F_L64"x,"F_L64"x,%x,%lx,%x,%x,"F_L64"x,"F_L64"x,%lx,"F_L64"x,%lx,%lx,%lx,%lx,%lx,%lx/",
-			stbuf->st_dev,
-			stbuf->st_ino,
-			stbuf->st_mode,
-			stbuf->st_nlink,
-			stbuf->st_uid,
-			stbuf->st_gid,
-			stbuf->st_rdev,
-			stbuf->st_size,
-			stbuf->st_blksize,
-			stbuf->st_blocks,
-			stbuf->st_atime,
-			stbuf->st_atim.tv_nsec,
-			stbuf->st_mtime,
-			stbuf->st_mtim.tv_nsec,
-			stbuf->st_ctime,
-			stbuf->st_ctim.tv_nsec);
-    buffer_ptr += bwritten;
+    int len = strlen (curr->pathname);
+
+    bulk_stat_pack (&records[nr_entries++], curr->stbuf);
+    memcpy (names + names_len, curr->pathname, len);
+    names_len += len;
+    names[names_len++] = '/';
     curr = curr->next;
 
-    free (stbuf);
+    free (prev->stbuf);
     free (prev->pathname);
     free (prev);
   }
+  if (names_len)
+    names[names_len - 1] = '\0';
 
-  free (bstbuf);
-
-  /*if (buffer){
-    gf_log ("glusterfsd", LOG_CRITICAL, "vikas deserves to be killed: %s\n", buffer);
-    }*/
-  dict_set (dict, "BUF", str_to_data (buffer));
+  dict_set (dict, "BUF", bin_to_data (records, nr_entries * sizeof (*records)));
+  dict_set (dict, "NAMES", str_to_data (names));
   dict_set (dict, "NR_ENTRIES", int_to_data (nr_entries));
+  dict_set (dict, "NEXT", int_to_data (next));
  fail:
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_FOP_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
+  dict_destroy (dict);
+
+  free (records);
+  free (names);
+  return 0;
+}
+
+int
+glusterfsd_getdents (struct sock_private *sock_priv)
+{
+  gf_block *blk = (gf_block *)sock_priv->private;
+  dict_t *dict = get_new_dict ();
+  dict_unserialize (blk->data, blk->size, &dict);
+  
+  if (!dict)
+    return -1;
+  struct xlator *xl = sock_priv->xl;
+  size_t size = data_to_int (dict_get (dict, "SIZE"));
+  off_t next = 0;
+
+  /* one page per reply, whatever the client asked for */
+  if (size > GF_GETDENTS_PAGE)
+    size = GF_GETDENTS_PAGE;
+  char *buf = malloc (size + 1);
+
+  int ret = xl->fops->getdents (xl,
+				data_to_str (dict_get (dict, "PATH")),
+				data_to_int (dict_get (dict, "OFFSET")),
+				buf,
+				size,
+				&next);
+
+  dict_del (dict, "PATH");
+  dict_del (dict, "OFFSET");
+  dict_del (dict, "SIZE");
+
+  if (ret >= 0) {
+    dict_set (dict, "BUF", str_to_data (buf));
+    dict_set (dict, "NEXT", int_to_data (next));
+  }
+  dict_set (dict, "RET", int_to_data (ret));
+  dict_set (dict, "ERRNO", int_to_data (errno));
+
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
   dict_destroy (dict);
+
+  free (buf);
   return 0;
 }
 
+int
+glusterfsd_copy (struct sock_private *sock_priv)
+{
+  gf_block *blk = (gf_block *)sock_priv->private;
+  dict_t *dict = get_new_dict ();
+  dict_unserialize (blk->data, blk->size, &dict);
+  
+  if (!dict)
+    return -1;
+  struct xlator *xl = sock_priv->xl;
+  size_t size = data_to_int (dict_get (dict, "SIZE"));
+
+  /* do not let one request hold this thread for ages */
+  if (size > GF_COPY_MAX)
+    size = GF_COPY_MAX;
+
+  int ret = xl->fops->copy (xl,
+			    data_to_str (dict_get (dict, "FROM")),
+			    data_to_int (dict_get (dict, "FROM_OFFSET")),
+			    data_to_str (dict_get (dict, "TO")),
+			    data_to_int (dict_get (dict, "TO_OFFSET")),
+			    size);
+
+  dict_del (dict, "FROM");
+  dict_del (dict, "FROM_OFFSET");
+  dict_del (dict, "TO");
+  dict_del (dict, "TO_OFFSET");
+  dict_del (dict, "SIZE");
+
+  dict_set (dict, "RET", int_to_data (ret));
+  dict_set (dict, "ERRNO", int_to_data (errno));
+
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
+  dict_destroy (dict);
+  return 0;
+}
+
+/* the FD of a request is a pointer glusterfsd_open () handed out, only
+   one this connection holds may reach the xlators */
+static struct file_context *
+fctx_get (struct sock_private *sock_priv, dict_t *dict)
+{
+  struct file_context *ctx = (struct file_context *)data_to_int (dict_get (dict, "FD"));
+  struct file_ctx_list *fctxl = sock_priv->fctxl->next;
+
+  while (fctxl) {
+    if (fctxl->ctx == ctx)
+      return ctx;
+    fctxl = fctxl->next;
+  }
+  return NULL;
+}
+
+int
+glusterfsd_seek (struct sock_private *sock_priv)
+{
+  gf_block *blk = (gf_block *)sock_priv->private;
+  dict_t *dict = get_new_dict ();
+  dict_unserialize (blk->data, blk->size, &dict);
+  
+  if (!dict)
+    return -1;
+  struct xlator *xl = sock_priv->xl;
+  struct file_context *ctx = fctx_get (sock_priv, dict);
+  off_t result = 0;
+  int ret = -1;
+
+  errno = EBADF;
+  if (ctx)
+    ret = xl->fops->seek (xl,
+			  data_to_str (dict_get (dict, "PATH")),
+			  data_to_int (dict_get (dict, "OFFSET")),
+			  data_to_int (dict_get (dict, "WHENCE")),
+			  &result,
+			  ctx);
+
+  dict_del (dict, "PATH");
+  dict_del (dict, "FD");
+  dict_del (dict, "OFFSET");
+  dict_del (dict, "WHENCE");
+
+  dict_set (dict, "RET", int_to_data (ret));
+  dict_set (dict, "ERRNO", int_to_data (errno));
+  if (ret == 0)
+    dict_set (dict, "OFFSET", int_to_data (result));
+
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
+  dict_destroy (dict);
+  return 0;
+}
+
+/* fallocate, discard and zerofill only differ in the fop they call */
+static int
+glusterfsd_range_op (struct sock_private *sock_priv)
+{
+  gf_block *blk = (gf_block *)sock_priv->private;
+  dict_t *dict = get_new_dict ();
+  dict_unserialize (blk->data, blk->size, &dict);
+  
+  if (!dict)
+    return -1;
+  struct xlator *xl = sock_priv->xl;
+  const char *path = data_to_str (dict_get (dict, "PATH"));
+  off_t offset = data_to_int (dict_get (dict, "OFFSET"));
+  size_t len = data_to_int (dict_get (dict, "LEN"));
+  struct file_context *ctx = fctx_get (sock_priv, dict);
+  int ret = -1;
+
+  errno = EBADF;
+  if (ctx) {
+    switch (blk->op) {
+    case OP_FALLOCATE:
+      ret = xl->fops->fallocate (xl, path, data_to_int (dict_get (dict, "KEEP_SIZE")),
+				 offset, len, ctx);
+      break;
+    case OP_DISCARD:
+      ret = xl->fops->discard (xl, path, offset, len, ctx);
+      break;
+    default:
+      ret = xl->fops->zerofill (xl, path, offset, len, ctx);
+      break;
+    }
+  }
+
+  dict_del (dict, "PATH");
+  dict_del (dict, "FD");
+  dict_del (dict, "OFFSET");
+  dict_del (dict, "LEN");
+  dict_del (dict, "KEEP_SIZE");
+
+  dict_set (dict, "RET", int_to_data (ret));
+  dict_set (dict, "ERRNO", int_to_data (errno));
+
+  reply_dump (sock_priv, dict, blk, OP_TYPE_FOP_REPLY);
+  dict_destroy (dict);
+  return 0;
+}
+
+int
+glusterfsd_fallocate (struct sock_private *sock_priv)
+{
+  return glusterfsd_range_op (sock_priv);
+}
+
+int
+glusterfsd_discard (struct sock_private *sock_priv)
+{
+  return glusterfsd_range_op (sock_priv);
+}
+
+int
+glusterfsd_zerofill (struct sock_private *sock_priv)
+{
+  return glusterfsd_range_op (sock_priv);
+}
+
 int
 handle_fops (glusterfsd_fn_t *gfopsd, struct sock_private *sock_priv)
 {
@@ -1135,6 +1428,11 @@ handle_fops (glusterfsd_fn_t *gfopsd, struct sock_private *sock_priv)
   gf_block *blk = (gf_block *) sock_priv->private;
   int op = blk->op;
 
+  if (op < 0 || op >= OP_MAXVALUE) {
+    gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd-fops.c->handle_fops: invalid op %d\n", op);
+    return -1;
+  }
+
   ret = gfopsd[op].function (sock_priv);
 
   if (ret != 0) {
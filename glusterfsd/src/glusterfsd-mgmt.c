@@ -57,7 +57,7 @@ glusterfsd_getspec (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return ret;
@@ -112,7 +112,7 @@ glusterfsd_setspec (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (remote_errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return ret;
@@ -153,7 +153,7 @@ glusterfsd_lock (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
 
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return 0;
@@ -187,7 +187,7 @@ glusterfsd_unlock (struct sock_private *sock_priv)
   dict_set (dict, "ERRNO", int_to_data (errno));
 
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return ret;
@@ -204,16 +204,16 @@ glusterfsd_nslookup (struct sock_private *sock_priv)
   char *path = data_to_str (path_data);
   char *ns = ns_lookup (path);
 
-  ns = ns ? ns : "";
-  dict_set (dict, "NS", str_to_data (ns));
+  dict_set (dict, "NS", str_to_data (ns ? ns : ""));
 
   dict_del (dict, "PATH");
 
   dict_set (dict, "RET", int_to_data (0));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
+  free (ns);
   
   return 0;
 }
@@ -241,7 +241,7 @@ glusterfsd_nsupdate (struct sock_private *sock_priv)
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return ret;
@@ -265,7 +265,8 @@ glusterfsd_setvolume (struct sock_private *sock_priv)
   dict_unserialize (blk->data, blk->size, &dict);
   
   char *name = data_to_str (dict_get (dict, "remote-subvolume"));
-  struct xlator *xl = get_xlator_tree_node ();
+  struct xlator_graph *graph = glusterfsd_graph_get ();
+  struct xlator *xl = graph ? graph->tree : NULL;
   FUNCTION_CALLED;
 
   while (xl) {
@@ -315,10 +316,18 @@ glusterfsd_setvolume (struct sock_private *sock_priv)
   }
   dict_del (dict, "remote-subvolume");
 
+  /* a bound connection pins the graph its xl lives in */
+  glusterfsd_graph_put (sock_priv->graph);
+  sock_priv->graph = NULL;
+  if (sock_priv->xl)
+    sock_priv->graph = graph;
+  else
+    glusterfsd_graph_put (graph);
+
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (remote_errno));
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return ret;
@@ -337,28 +346,36 @@ glusterfsd_stats (struct sock_private *sock_priv)
 
   if (!dict)
     return -1;
-  struct xlator *xl = get_xlator_tree_node ();
+  struct xlator_graph *graph = glusterfsd_graph_get ();
+  struct xlator *xl = graph->tree;
   struct xlator_stats stats;
 
   int ret = xl->mgmt_ops->stats (xl, &stats);
+  glusterfsd_graph_put (graph);
 
   dict_set (dict, "RET", int_to_data (ret));
   dict_set (dict, "ERRNO", int_to_data (errno));
 
   if (ret == 0) {
     char buffer[256] = {0,};
-    sprintf (buffer, "%lx,%llx,%llx,%llx,%llx,%lx,%lx\n",
+    /* new fields go last, older clients read up to what they know */
+    sprintf (buffer, "%lx,%llx,%llx,%llx,%llx,%lx,%lx,%lx,%lx,%lx,%lx,%lx\n",
 	     (long)stats.nr_files,
 	     (long long)stats.disk_usage,
 	     (long long)stats.free_disk,
 	     (long long)stats.read_usage,
 	     (long long)stats.write_usage,
 	     (long)stats.disk_speed,
-	     (long)glusterfsd_stats_nr_clients);
+	     (long)glusterfsd_stats_nr_clients,
+	     (long)stats.read_iops,
+	     (long)stats.write_iops,
+	     (long)stats.latency_p50,
+	     (long)stats.latency_p90,
+	     (long)stats.latency_p99);
     dict_set (dict, "BUF", str_to_data (buffer));
   }
 
-  dict_dump (sock_priv->fd, dict, blk, OP_TYPE_MGMT_REPLY);
+  reply_dump (sock_priv, dict, blk, OP_TYPE_MGMT_REPLY);
   dict_destroy (dict);
   
   return 0;
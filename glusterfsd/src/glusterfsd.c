@@ -3,10 +3,14 @@
 #include "protocol.h"
 
 #include <errno.h>
+#include <signal.h>
+#include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <argp.h>
 
 #include "sdp_inet.h"
+#include "fairq.h"
+#include "common-utils.h"
 
 #define SCRATCH_DIR confd->scratch_dir
 #define LISTEN_PORT confd->port
@@ -25,32 +29,193 @@ error_t parse_opts (int key, char *arg, struct argp_state *_state);
 extern struct confd * file_to_confd (FILE *fp);
 
 int glusterfsd_stats_nr_clients = 0;
+static pthread_mutex_t nr_clients_lock = PTHREAD_MUTEX_INITIALIZER;
 static char *configfile = NULL;
 static char *specfile = NULL;
 static char doc[] = "glusterfsd is glusterfs server";
 static char argp_doc[] = " ";
 static struct argp argp = { options, parse_opts, argp_doc, doc };
-static struct xlator *xlator_tree_node = NULL;
+static struct xlator_graph *active_graph = NULL;
+static pthread_mutex_t graph_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t reload_pending = 0;
 struct confd *confd;
 
-void
-set_xlator_tree_node (FILE *fp)
+static void
+graph_destroy (struct xlator_graph *graph)
 {
-  struct xlator *xl = file_to_xlator_tree (fp);
-  struct xlator *trav = xl;
-  xlator_tree_node = xl;
-  
+  struct xlator *trav = graph->tree;
+
   while (trav) {
-    if (trav->init)
-      trav->init (trav);
+    if (trav->fini)
+      trav->fini (trav);
     trav = trav->next;
   }
+
+  trav = graph->tree;
+  while (trav) {
+    struct xlator *next = trav->next;
+    dict_destroy (trav->options);
+    free (trav->name);
+    free (trav);
+    trav = next;
+  }
+
+  free (graph);
+}
+
+static struct xlator_graph *
+graph_load (FILE *fp)
+{
+  struct xlator_graph *graph;
+  struct xlator *trav;
+  struct xlator *tree = file_to_xlator_tree (fp);
+
+  if (!tree)
+    return NULL;
+
+  graph = calloc (1, sizeof (*graph));
+  graph->tree = tree;
+  graph->refs = 1;
+
+  for (trav = tree; trav; trav = trav->next) {
+    if (trav->init && trav->init (trav) != 0) {
+      gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd.c->graph_load: %s failed to initialize\n",
+	      trav->name);
+      /* fini only what came up */
+      trav->fini = NULL;
+      while ((trav = trav->next))
+	trav->fini = NULL;
+      graph_destroy (graph);
+      return NULL;
+    }
+  }
+
+  return graph;
+}
+
+void
+set_xlator_tree_node (FILE *fp)
+{
+  active_graph = graph_load (fp);
 }
 
 struct xlator *
 get_xlator_tree_node ()
 {
-  return xlator_tree_node;
+  return active_graph ? active_graph->tree : NULL;
+}
+
+/* take a reference on the active graph, for binding a connection */
+struct xlator_graph *
+glusterfsd_graph_get ()
+{
+  struct xlator_graph *graph;
+
+  pthread_mutex_lock (&graph_lock);
+  graph = active_graph;
+  if (graph)
+    graph->refs++;
+  pthread_mutex_unlock (&graph_lock);
+
+  return graph;
+}
+
+void
+glusterfsd_graph_put (struct xlator_graph *graph)
+{
+  int refs;
+
+  if (!graph)
+    return;
+
+  pthread_mutex_lock (&graph_lock);
+  refs = --graph->refs;
+  pthread_mutex_unlock (&graph_lock);
+
+  if (!refs) {
+    gf_log ("glusterfsd", LOG_NORMAL, "glusterfsd.c->glusterfsd_graph_put: old graph drained, tearing it down\n");
+    graph_destroy (graph);
+  }
+}
+
+/*
+  Load the spec file again and switch to it. Connections still on the
+  old graph move over in graph_rebind () once they have no open files.
+*/
+static void
+graph_reload (void)
+{
+  struct xlator_graph *graph;
+  struct xlator_graph *old;
+  FILE *fp = fopen (specfile, "r");
+
+  if (!fp) {
+    gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd.c->graph_reload: %s: %s, keeping the current graph\n",
+	    specfile, strerror (errno));
+    return;
+  }
+  graph = graph_load (fp);
+  fclose (fp);
+
+  if (!graph) {
+    gf_log ("glusterfsd", LOG_CRITICAL, "glusterfsd.c->graph_reload: could not load %s, keeping the current graph\n",
+	    specfile);
+    return;
+  }
+
+  pthread_mutex_lock (&graph_lock);
+  old = active_graph;
+  active_graph = graph;
+  if (old)
+    old->retired = 1;
+  pthread_mutex_unlock (&graph_lock);
+
+  gf_log ("glusterfsd", LOG_NORMAL, "glusterfsd.c->graph_reload: loaded %s\n", specfile);
+  glusterfsd_graph_put (old);
+}
+
+static void
+reload_handler (int sig)
+{
+  reload_pending = 1;
+}
+
+/*
+  Move an idle connection off a retired graph, to the volume with the
+  same name in the active one. A connection with open files stays where
+  its file contexts are. If the volume is gone or its allow-ip changed
+  the client has to connect and authenticate again.
+*/
+static int
+graph_rebind (struct sock_private *sock_priv)
+{
+  struct xlator_graph *graph;
+  struct xlator *xl;
+  data_t *old_allow;
+  data_t *new_allow;
+
+  if (sock_priv->fctxl->next)
+    return 0;
+
+  graph = glusterfsd_graph_get ();
+  for (xl = graph->tree; xl; xl = xl->next)
+    if (strcmp (xl->name, sock_priv->xl->name) == 0)
+      break;
+
+  old_allow = dict_get (sock_priv->xl->options, "allow-ip");
+  new_allow = xl ? dict_get (xl->options, "allow-ip") : NULL;
+  if (!xl || !old_allow || !new_allow ||
+      strcmp (data_to_str (old_allow), data_to_str (new_allow)) != 0) {
+    gf_log ("glusterfsd", LOG_NORMAL, "glusterfsd.c->graph_rebind: volume %s changed, closing socket %d\n",
+	    sock_priv->xl->name, sock_priv->fd);
+    glusterfsd_graph_put (graph);
+    return -1;
+  }
+
+  glusterfsd_graph_put (sock_priv->graph);
+  sock_priv->graph = graph;
+  sock_priv->xl = xl;
+  return 0;
 }
 
 static int
@@ -84,12 +249,21 @@ server_init ()
   
   opt = 1;
   setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt));
+#ifdef SO_REUSEPORT
+  /* every acceptor binds its own listener, the kernel spreads connections */
+  if (confd->acceptors > 1 &&
+      setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof (opt)) != 0) {
+    perror ("setsockopt(SO_REUSEPORT)");
+    close (sock);
+    return -1;
+  }
+#endif
   if (bind (sock, (struct sockaddr *)&sin, sizeof (sin)) != 0) {
     perror ("bind()");
     return -1;
   }
 
-  if (listen (sock, 10) != 0) {
+  if (listen (sock, confd->backlog) != 0) {
     perror ("listen()");
     return -1;
   }
@@ -116,22 +290,142 @@ register_new_sock (int s)
 }
 
 static void
-unregister_sock (struct sock_private *sock_priv,
-		 struct pollfd *pfd,
-		 int s,
-		 int num_pfd)
+nr_clients_update (int delta)
 {
-  int idx = pfd[s].fd;
+  pthread_mutex_lock (&nr_clients_lock);
+  glusterfsd_stats_nr_clients += delta;
+  pthread_mutex_unlock (&nr_clients_lock);
+}
+
+static glusterfsd_fn_t gfopsd[] = { 
+  {glusterfsd_getattr},
+  {glusterfsd_readlink},
+  {glusterfsd_mknod},
+  {glusterfsd_mkdir},
+  {glusterfsd_unlink},
+  {glusterfsd_rmdir},
+  {glusterfsd_symlink},
+  {glusterfsd_rename},
+  {glusterfsd_link},
+  {glusterfsd_chmod},
+  {glusterfsd_chown},
+  {glusterfsd_truncate},
+  {glusterfsd_utime},
+  {glusterfsd_open},
+  {glusterfsd_read},
+  {glusterfsd_write},
+  {glusterfsd_statfs},
+  {glusterfsd_flush},
+  {glusterfsd_release},
+  {glusterfsd_fsync},
+  {glusterfsd_setxattr},
+  {glusterfsd_getxattr},
+  {glusterfsd_listxattr},
+  {glusterfsd_removexattr},
+  {glusterfsd_opendir},
+  {glusterfsd_readdir},
+  {glusterfsd_releasedir},
+  {glusterfsd_fsyncdir},
+  {glusterfsd_init},
+  {glusterfsd_destroy},
+  {glusterfsd_access},
+  {glusterfsd_create},
+  {glusterfsd_ftruncate},
+  {glusterfsd_fgetattr},
+  {glusterfsd_bulk_getattr},
+  {glusterfsd_getdents},
+  {glusterfsd_copy},
+  {glusterfsd_seek},
+  {glusterfsd_fallocate},
+  {glusterfsd_discard},
+  {glusterfsd_zerofill},
+  {NULL},
+};
+
+static glusterfsd_fn_t gmgmtd[] = {
+  {glusterfsd_setvolume},
+  {glusterfsd_getvolume},
+  {glusterfsd_stats},
+  {glusterfsd_setspec},
+  {glusterfsd_getspec},
+  {NULL}
+};
+
+/*
+  Queue a reply on the connection instead of writing it right away.
+  Everything queued during a loop pass goes out in one writev from
+  reply_flush (), so pipelined replies share TCP segments.
+*/
+int
+reply_dump (struct sock_private *sock_priv,
+	    dict_t *dict,
+	    gf_block *blk,
+	    int type)
+{
+  struct reply_queue *replies = &sock_priv->replies;
+  int len;
+  char *buf = dict_dump_buf (dict, blk, type, &len);
+
+  if (replies->count == replies->alloced) {
+    replies->alloced = replies->alloced ? replies->alloced * 2 : 8;
+    replies->vector = realloc (replies->vector,
+			       replies->alloced * sizeof (struct iovec));
+  }
+  replies->vector[replies->count].iov_base = buf;
+  replies->vector[replies->count].iov_len = len;
+  replies->count++;
+
+  if (replies->count >= GLUSTERFSD_REPLY_BATCH)
+    return reply_flush (sock_priv);
+  return 0;
+}
+
+static void
+reply_discard (struct reply_queue *replies)
+{
+  int i;
+
+  for (i = 0; i < replies->count; i++)
+    free (replies->vector[i].iov_base);
+  replies->count = 0;
+}
+
+int
+reply_flush (struct sock_private *sock_priv)
+{
+  struct reply_queue *replies = &sock_priv->replies;
+  struct iovec *vector;
+  int ret = 0;
+
+  if (!replies->count)
+    return 0;
+
+  /* full_writev () moves the bases, write from a copy */
+  vector = alloca (replies->count * sizeof (struct iovec));
+  memcpy (vector, replies->vector, replies->count * sizeof (struct iovec));
+
+  ret = full_writev (sock_priv->fd, vector, replies->count);
+  if (ret == -1)
+    sock_priv->dead = 1;
+
+  reply_discard (replies);
+  return ret;
+}
+
+static void
+unregister_sock (struct sock_private *sock_priv)
+{
+  int idx = sock_priv->fd;
   gf_log ("glusterfsd", LOG_DEBUG, "Closing socket %d\n", idx);
 	  /* Some error in the socket, close it */
-  if (sock_priv[idx].xl) {
-    struct file_ctx_list *trav_fctxl = sock_priv[idx].fctxl->next;
+  if (sock_priv->xl) {
+    struct file_ctx_list *trav_fctxl = sock_priv->fctxl->next;
     while (trav_fctxl) {
       struct file_context *ctx;
       struct file_ctx_list *prev;
-      sock_priv[idx].xl->fops->release (sock_priv[idx].xl, 
-					trav_fctxl->path, 
-					trav_fctxl->ctx);
+      sock_priv->xl->fops->release (sock_priv->xl, 
+				    trav_fctxl->path, 
+				    trav_fctxl->ctx);
       prev = trav_fctxl;
       trav_fctxl = trav_fctxl->next;
 
@@ -143,182 +437,209 @@ unregister_sock (struct sock_private *sock_priv,
 	free (p_ctx);
       }
 
+      free (prev->path);
       free (prev);
     }
   }
-  free (sock_priv[idx].fctxl);
+  glusterfsd_graph_put (sock_priv->graph);
+  fairq_drop (sock_priv);
+  reply_discard (&sock_priv->replies);
+  free (sock_priv->replies.vector);
+  free (sock_priv->fctxl);
   close (idx);
- 
-  pfd[s].fd = pfd[num_pfd].fd;
-  pfd[s].revents = 0;
+  nr_clients_update (-1);
 
+  memset (sock_priv, 0, sizeof (*sock_priv));
+}
+
+static int
+dispatch_request (struct sock_private *sock_priv,
+		  gf_block *blk)
+{
+  int ret;
+  /* replies are dumped through blk->data, keep the request buffer */
+  char *data = blk->data;
+
+  sock_priv->private = blk;
+  if (sock_priv->graph && sock_priv->graph->retired &&
+      graph_rebind (sock_priv) != 0) {
+    ret = -1;
+  } else if (blk->type == OP_TYPE_FOP_REQUEST) {
+    ret = handle_fops (gfopsd, sock_priv);
+  } else if (blk->type == OP_TYPE_MGMT_REQUEST) {
+    ret = handle_mgmt (gmgmtd, sock_priv);
+  } else {
+    gf_log ("glusterfsd", LOG_CRITICAL, "Protocol error: unknown request");
+    ret = -1;
+  }
+  sock_priv->private = NULL;
+
+  /* a handler takes blk->dict, anything left was not consumed */
+  blk->data = data;
+  stream_block_free (blk);
+  return ret;
 }
 
 static void
 server_loop (int main_sock)
 {
   int s;
-  int ret = 0;
-  int max_pfd = 0;
   int num_pfd = 0;
   int allocfd_count = 1024;
-  struct sock_private sock_priv[64*1024] = {{0,},}; //FIXME: is this value right?
-  glusterfsd_fn_t gfopsd[] = { 
-    {glusterfsd_getattr},
-    {glusterfsd_readlink},
-    {glusterfsd_mknod},
-    {glusterfsd_mkdir},
-    {glusterfsd_unlink},
-    {glusterfsd_rmdir},
-    {glusterfsd_symlink},
-    {glusterfsd_rename},
-    {glusterfsd_link},
-    {glusterfsd_chmod},
-    {glusterfsd_chown},
-    {glusterfsd_truncate},
-    {glusterfsd_utime},
-    {glusterfsd_open},
-    {glusterfsd_read},
-    {glusterfsd_write},
-    {glusterfsd_statfs},
-    {glusterfsd_flush},
-    {glusterfsd_release},
-    {glusterfsd_fsync},
-    {glusterfsd_setxattr},
-    {glusterfsd_getxattr},
-    {glusterfsd_listxattr},
-    {glusterfsd_removexattr},
-    {glusterfsd_opendir},
-    {glusterfsd_readdir},
-    {glusterfsd_releasedir},
-    {glusterfsd_fsyncdir},
-    {glusterfsd_init},
-    {glusterfsd_destroy},
-    {glusterfsd_access},
-    {glusterfsd_create},
-    {glusterfsd_ftruncate},
-    {glusterfsd_fgetattr},
-    {glusterfsd_bulk_getattr},
-    {NULL},
-  };
-  glusterfsd_fn_t gmgmtd[] = {
-    {glusterfsd_setvolume},
-    {glusterfsd_getvolume},
-    {glusterfsd_stats},
-    {glusterfsd_setspec},
-    {glusterfsd_getspec},
-    {NULL}
-  };
-  struct pollfd *pfd = (struct pollfd *)malloc (allocfd_count * sizeof (struct pollfd *));
+  struct fairq_sched sched;
+  /* one table per acceptor thread, too big for a thread stack */
+  struct sock_private *sock_priv = calloc (64*1024, sizeof (struct sock_private)); //FIXME: is this value right?
+  struct pollfd *pfd = (struct pollfd *)malloc (allocfd_count * sizeof (struct pollfd));
+
+  fairq_sched_init (&sched, confd->data_quantum, confd->meta_quantum,
+		    confd->max_inflight);
   
   pfd[num_pfd].fd = main_sock;
-  pfd[num_pfd].events = POLLIN | POLLPRI | POLLOUT;
-  num_pfd++; max_pfd++;
+  pfd[num_pfd].events = POLLIN | POLLPRI;
+  num_pfd++;
   
   while (1) {
-    if (poll(pfd, max_pfd, -1) < 0) {
-      /* This should not get timedout (look at -1) */
+    /* SIGHUP: one acceptor swaps the graph, requests are between fops here */
+    if (reload_pending && __sync_lock_test_and_set (&reload_pending, 0))
+      graph_reload ();
+
+    /* stop reading from clients which already have too much queued */
+    for (s = 1; s < num_pfd; s++) {
+      if (fairq_can_enqueue (&sched, &sock_priv[pfd[s].fd]))
+	pfd[s].events = POLLIN | POLLPRI;
+      else
+	pfd[s].events = 0;
+      pfd[s].revents = 0;
+    }
+
+    /* queued work left over from the last round, only peek at the sockets */
+    if (poll (pfd, num_pfd, fairq_pending (&sched) ? 0 : -1) < 0) {
       if (errno == EINTR)
 	continue;
       gprintf("poll(): %s", strerror(errno));
+      free (sock_priv);
+      free (pfd);
       return;
     }
-    
-    for (s=0; s < max_pfd; s++) {
-      if ((pfd[s].revents & POLLIN) || (pfd[s].revents & POLLPRI) || (pfd[s].revents & POLLOUT)) {
-	/* If activity is on main socket, accept the new connection */
-	ret = 0;
-	if (pfd[s].fd == main_sock) {
-	  int client_sock = register_new_sock (pfd[s].fd);
-	  glusterfsd_stats_nr_clients++;
-	  pfd[num_pfd].fd = client_sock;
-	  pfd[num_pfd].events = POLLIN | POLLPRI;
-	  sock_priv[client_sock].fd = client_sock;
-	  sock_priv[client_sock].fctxl = calloc (1, sizeof (struct file_ctx_list));
-
-	  num_pfd++;
-	  if (num_pfd == allocfd_count) {
-	    allocfd_count *= 2;
-	    pfd = realloc (pfd, allocfd_count * sizeof (struct pollfd *));
-	  }
-	  pfd[s].revents = 0;
+
+    /* receive: whatever each readable connection has pipelined, in bounds */
+    for (s = 0; s < num_pfd; s++) {
+      if (!pfd[s].revents)
+	continue;
+
+      /* If activity is on main socket, accept the new connection */
+      if (pfd[s].fd == main_sock) {
+	int client_sock = register_new_sock (pfd[s].fd);
+	if (client_sock == -1)
 	  continue;
+
+	nr_clients_update (1);
+	if (num_pfd == allocfd_count) {
+	  allocfd_count *= 2;
+	  pfd = realloc (pfd, allocfd_count * sizeof (struct pollfd));
 	}
-	
-	gf_block *blk = gf_block_unserialize (pfd[s].fd);
-	if (blk == NULL) {
-	  ret = -1;
-	}
-	else {
-	  sock_priv[pfd[s].fd].private = blk;
-	  if (blk->type == OP_TYPE_FOP_REQUEST) {
-	    ret = handle_fops (gfopsd, &sock_priv[pfd[s].fd]);
-	  } else if (blk->type == OP_TYPE_MGMT_REQUEST) {
-	    ret = handle_mgmt (gmgmtd, &sock_priv[pfd[s].fd]);
-	  } else {
-	    gf_log ("glusterfsd", LOG_CRITICAL, "Protocol error: unknown request");
-	    ret = -1;
-	  }
-	}
-	
-	if (blk) {
-	  free (blk);
-	}
-	
-	if (ret == -1) {
-	  int idx = pfd[s].fd;
-	  gf_log ("glusterfsd", LOG_DEBUG, "Closing socket %d\n", idx);
-	  /* Some error in the socket, close it */
-	  if (sock_priv[idx].xl) {
-	    struct file_ctx_list *trav_fctxl = sock_priv[idx].fctxl->next;
-	    while (trav_fctxl) {
-	      sock_priv[idx].xl->fops->release (sock_priv[idx].xl, 
-						trav_fctxl->path, 
-						trav_fctxl->ctx);
-	      trav_fctxl = trav_fctxl->next;
-	    }
-	  }
-	  
-	  free (sock_priv[idx].fctxl);
-	  close (idx);
-	  glusterfsd_stats_nr_clients--;
-
-	  pfd[s].fd = pfd[num_pfd].fd;
-	  pfd[s].revents = 0;
-	  num_pfd--;
-	}
+	pfd[num_pfd].fd = client_sock;
+	pfd[num_pfd].events = POLLIN | POLLPRI;
+	pfd[num_pfd].revents = 0;
+	num_pfd++;
+
+	sock_priv[client_sock].fd = client_sock;
+	sock_priv[client_sock].fctxl = calloc (1, sizeof (struct file_ctx_list));
+	continue;
       }
-      if (pfd[s].revents & POLLERR ) {
-	/* Some problem in the socket, close it */
-	int idx = pfd[s].fd;
-	gf_log ("glusterfsd", LOG_DEBUG, "POLLERR - Closing socket %d\n", idx);
-	/* Some error in the socket, close it */
-	if (sock_priv[idx].xl) {
-	  struct file_ctx_list *trav_fctxl = sock_priv[idx].fctxl->next;
-	  while (trav_fctxl) {
-	    sock_priv[idx].xl->fops->release (sock_priv[idx].xl, 
-					      trav_fctxl->path, 
-					      trav_fctxl->ctx);
-	    trav_fctxl = trav_fctxl->next;
+
+      if (pfd[s].revents & (POLLIN | POLLPRI)) {
+	struct sock_private *client = &sock_priv[pfd[s].fd];
+	int batch = 0;
+	int pending = 0;
+
+	do {
+	  gf_block *blk = stream_recv_block (pfd[s].fd,
+					     GLUSTERFSD_MAX_BLOCK_SIZE);
+	  if (blk == NULL) {
+	    client->dead = 1;
+	    break;
 	  }
-	}
-	
-	free (sock_priv[idx].fctxl);
-	close (idx);
-	glusterfsd_stats_nr_clients--;
-	
-	pfd[s].fd = pfd[num_pfd].fd;
-	pfd[s].revents = 0;
-	num_pfd--;
+	  fairq_enqueue (&sched, client, blk);
+
+	  if (ioctl (pfd[s].fd, FIONREAD, &pending) != 0)
+	    pending = 0;
+	} while (pending > 0 && ++batch < GLUSTERFSD_RECV_BATCH &&
+		 fairq_can_enqueue (&sched, client));
+      } else if (pfd[s].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+	gf_log ("glusterfsd", LOG_DEBUG, "POLLERR - Closing socket %d\n", pfd[s].fd);
+	sock_priv[pfd[s].fd].dead = 1;
+      }
+    }
+
+    /* dispatch: one deficit round robin pass over the backlogged clients */
+    fairq_round (&sched, dispatch_request);
+
+    /* send: one writev per connection for all replies of this round */
+    for (s = 1; s < num_pfd; s++)
+      reply_flush (&sock_priv[pfd[s].fd]);
+
+    /* reap: some error in the socket or a failed request, close it */
+    for (s = 1; s < num_pfd; ) {
+      if (sock_priv[pfd[s].fd].dead) {
+	unregister_sock (&sock_priv[pfd[s].fd]);
+	pfd[s] = pfd[--num_pfd];
+      } else {
+	s++;
       }
-      pfd[s].revents = 0;
     }
-    max_pfd = num_pfd;
   }
 
   return;
 }
 
+static void *
+acceptor_thread (void *arg)
+{
+  server_loop ((long) arg);
+  return NULL;
+}
+
+static int
+start_acceptors (void)
+{
+  int i;
+  sigset_t hup;
+
+#ifndef SO_REUSEPORT
+  if (confd->acceptors > 1) {
+    gf_log ("glusterfsd", LOG_CRITICAL, "SO_REUSEPORT not supported, using a single acceptor");
+    confd->acceptors = 1;
+  }
+#endif
+
+  /* SIGHUP goes to the main thread, so that its poll () returns */
+  sigemptyset (&hup);
+  sigaddset (&hup, SIGHUP);
+  pthread_sigmask (SIG_BLOCK, &hup, NULL);
+
+  /* the calling thread becomes the last acceptor */
+  for (i = 1; i < confd->acceptors; i++) {
+    pthread_t thread;
+    int sock = server_init ();
+
+    if (sock == -1)
+      return -1;
+
+    if (pthread_create (&thread, NULL, acceptor_thread, (void *)(long) sock) != 0) {
+      gf_log ("glusterfsd", LOG_CRITICAL, "unable to start acceptor thread %d", i);
+      close (sock);
+      return -1;
+    }
+    pthread_detach (thread);
+  }
+  pthread_sigmask (SIG_UNBLOCK, &hup, NULL);
+
+  gf_log ("glusterfsd", LOG_NORMAL, "listening with %d acceptor(s), backlog %d",
+	  confd->acceptors, confd->backlog);
+  return 0;
+}
+
 error_t
 parse_opts (int key, char *arg, struct argp_state *_state)
 {
@@ -360,6 +681,11 @@ main (int argc, char *argv[])
     fp = fopen (specfile, "r");
     set_xlator_tree_node (fp);
     fclose (fp);
+    if (!get_xlator_tree_node ()) {
+      fprintf (stderr, "glusterfsd: unable to load %s\n", specfile);
+      exit (1);
+    }
+    signal (SIGHUP, reload_handler);
   } else {
     argp_help (&argp, stderr, ARGP_HELP_USAGE, argv[0]);
     exit (0);
@@ -383,6 +709,16 @@ main (int argc, char *argv[])
     }
     if (!confd->inet_prot)
       confd->inet_prot = strdup ("tcp");
+    if (confd->backlog <= 0)
+      confd->backlog = GLUSTERFSD_DEFAULT_BACKLOG;
+    if (confd->acceptors <= 0)
+      confd->acceptors = GLUSTERFSD_DEFAULT_ACCEPTORS;
+    if (confd->data_quantum <= 0)
+      confd->data_quantum = GLUSTERFSD_DEFAULT_DATA_QUANTUM;
+    if (confd->meta_quantum <= 0)
+      confd->meta_quantum = GLUSTERFSD_DEFAULT_META_QUANTUM;
+    if (confd->max_inflight <= 0)
+      confd->max_inflight = GLUSTERFSD_DEFAULT_MAX_INFLIGHT;
 
     fclose (fp);
   } else {
@@ -412,6 +748,9 @@ main (int argc, char *argv[])
   main_sock = server_init ();
   if (main_sock == -1) 
     return 1;
+
+  if (start_acceptors () != 0)
+    return 1;
   
   server_loop (main_sock);
   return 0;
@@ -1,10 +1,29 @@
 #include "glusterfs.h"
 #include "xlator.h"
 #include "logging.h"
+#include "fairq.h"
+#include "stream.h"
+#include <sys/uio.h>
 
 #define GLUSTERFSD_SPEC_DIR    "/var/state/glusterfs"
 #define GLUSTERFSD_SPEC_PATH   "/var/state/glusterfs/client-volume.spec"
 
+#define GLUSTERFSD_DEFAULT_BACKLOG    10
+#define GLUSTERFSD_DEFAULT_ACCEPTORS  1
+
+/* fair queuing budgets, see fairq.h */
+#define GLUSTERFSD_DEFAULT_DATA_QUANTUM  (128 * 1024)
+#define GLUSTERFSD_DEFAULT_META_QUANTUM  16
+#define GLUSTERFSD_DEFAULT_MAX_INFLIGHT  (4 * 1024 * 1024)
+
+/* largest block accepted from a client, a 1MB write and its dict */
+#define GLUSTERFSD_MAX_BLOCK_SIZE    (1024 * 1024 + 4096)
+
+/* requests taken from one connection per poll pass */
+#define GLUSTERFSD_RECV_BATCH        16
+/* replies gathered before a connection is flushed early */
+#define GLUSTERFSD_REPLY_BATCH       64
+
 #define CHECK_ENDMGMT() do {\
 	  fgets (readbuf, 80, fp); \
 	  if (strcasecmp (readbuf, "EndMgmt\n") != 0) { \
@@ -32,11 +51,34 @@ struct file_ctx_list {
   struct file_context *ctx;
   char *path;
 };
+/*
+  A loaded translator tree. The active graph holds one reference and
+  every connection bound to one of its volumes holds another. SIGHUP
+  loads the spec file again into a new graph and makes it active; the
+  old graph is torn down once its last connection has moved over.
+*/
+struct xlator_graph {
+  struct xlator *tree;  /* list of all the xlators, through ->next */
+  int refs;
+  char retired;         /* no longer the active graph */
+};
+
+/* replies produced in this loop pass, written out with one writev */
+struct reply_queue {
+  struct iovec *vector;
+  int count;
+  int alloced;
+};
+
 struct sock_private {
   struct file_ctx_list *fctxl;
   struct xlator *xl;
+  struct xlator_graph *graph;  /* the graph xl belongs to */
   int fd;
   void *private;
+  struct fairq queue;  /* requests received but not yet dispatched */
+  struct reply_queue replies;
+  char dead;           /* close at the end of this loop iteration */
 };
 
 struct gfsd_fns {
@@ -50,6 +92,11 @@ struct confd {
   int key_len;
   int port;
   char *bind_ip_address;
+  int backlog;    /* listen(2) backlog of each listening socket */
+  int acceptors;  /* number of SO_REUSEPORT listeners, one thread each */
+  int data_quantum;  /* read/write bytes each client may dispatch per round */
+  int meta_quantum;  /* other requests each client may dispatch per round */
+  int max_inflight;  /* queued request bytes before a client is not read */
   // add few more things if needed
 };
 
@@ -91,6 +138,12 @@ int glusterfsd_ftruncate (struct sock_private *sock_priv);
 int glusterfsd_fgetattr (struct sock_private *sock_priv);
 int glusterfsd_stats (struct sock_private *sock_priv);
 int glusterfsd_bulk_getattr (struct sock_private *sock_priv);
+int glusterfsd_getdents (struct sock_private *sock_priv);
+int glusterfsd_copy (struct sock_private *sock_priv);
+int glusterfsd_seek (struct sock_private *sock_priv);
+int glusterfsd_fallocate (struct sock_private *sock_priv);
+int glusterfsd_discard (struct sock_private *sock_priv);
+int glusterfsd_zerofill (struct sock_private *sock_priv);
 
 int glusterfsd_getvolume (struct sock_private *sock_priv);
 int glusterfsd_setvolume (struct sock_private *sock_priv);
@@ -101,7 +154,11 @@ int glusterfsd_nsupdate (struct sock_private *sock_priv);
 
 int glusterfsd_getspec (struct sock_private *sock_priv);
 int glusterfsd_setspec (struct sock_private *sock_priv);
+int reply_dump (struct sock_private *sock_priv, dict_t *dict, gf_block *blk, int type);
+int reply_flush (struct sock_private *sock_priv);
 int handle_fops (glusterfsd_fn_t *gfopsd, struct sock_private *sock_priv);
 int handle_mgmt (glusterfsd_fn_t *gmgmtd, struct sock_private *sock_priv);
 struct xlator *get_xlator_tree_node (void);
+struct xlator_graph *glusterfsd_graph_get (void);
+void glusterfsd_graph_put (struct xlator_graph *graph);
 
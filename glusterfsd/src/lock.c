@@ -4,6 +4,10 @@
 #include "hashfn.h"
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+
+/* the mgmt ops of every acceptor thread come here */
+static pthread_mutex_t global_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 int
 lock_try_acquire (const char *path)
@@ -13,6 +17,7 @@ lock_try_acquire (const char *path)
 
   hashval = hashval % LOCK_HASH;
 
+  pthread_mutex_lock (&global_lock_mutex);
   trav = global_lock[hashval];
 
   
@@ -28,8 +33,10 @@ lock_try_acquire (const char *path)
 
     trav->next = global_lock[hashval];
     global_lock[hashval] = trav;
+    pthread_mutex_unlock (&global_lock_mutex);
     return 0;
   }
+  pthread_mutex_unlock (&global_lock_mutex);
 
   errno = EEXIST;
   return -1;
@@ -44,6 +51,7 @@ lock_release (const char *path)
 
   hashval = hashval % LOCK_HASH;
 
+  pthread_mutex_lock (&global_lock_mutex);
   trav = global_lock[hashval];
   prev = NULL;
 
@@ -56,16 +64,17 @@ lock_release (const char *path)
   }
 
   if (trav) {
-    free (trav->path);
-
     if (prev)
       prev->next = trav->next;
     else
       global_lock[hashval] = trav->next;
+    pthread_mutex_unlock (&global_lock_mutex);
 
+    free ((char *)trav->path);
     free (trav);
     return 0;
   }
+  pthread_mutex_unlock (&global_lock_mutex);
 
   errno = ENOENT;
   return -1;
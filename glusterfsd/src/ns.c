@@ -4,15 +4,22 @@
 #include "hashfn.h"
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
+/* the mgmt ops of every acceptor thread come here */
+static pthread_mutex_t global_ns_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* a copy, to be freed by the caller: an update frees the one in the table */
 char *
 ns_lookup (const char *path)
 {
   int hashval = SuperFastHash ((char *)path, strlen (path));
   ns_inner_t *trav;
+  char *ns = NULL;
 
   hashval = hashval % LOCK_HASH;
 
+  pthread_mutex_lock (&global_ns_mutex);
   trav = global_ns[hashval];
 
   
@@ -23,9 +30,10 @@ ns_lookup (const char *path)
   }
 
   if (trav)
-    return trav->ns;
+    ns = strdup (trav->ns);
+  pthread_mutex_unlock (&global_ns_mutex);
 
-  return NULL;
+  return ns;
 }
 
 
@@ -37,6 +45,7 @@ ns_update (const char *path, const char *ns)
 
   hashval = hashval % LOCK_HASH;
 
+  pthread_mutex_lock (&global_ns_mutex);
   trav = global_ns[hashval];
   prev = NULL;
 
@@ -60,5 +69,6 @@ ns_update (const char *path, const char *ns)
     else
       global_ns[hashval] = trav;
   }
+  pthread_mutex_unlock (&global_ns_mutex);
   return 0;
 }
@@ -0,0 +1,199 @@
+#include "glusterfsd.h"
+#include "stream.h"
+#include "protocol.h"
+#include "common-utils.h"
+
+struct stream_buf {
+  struct stream_buf *next;
+};
+
+/* every acceptor thread runs its own loop, keep the pool per thread */
+static __thread struct stream_buf *pool;
+static __thread int pool_count;
+
+void *
+stream_buf_get (int len)
+{
+  void *buf = NULL;
+
+  if (len <= STREAM_BUF_SIZE && pool) {
+    buf = pool;
+    pool = pool->next;
+    pool_count--;
+    return buf;
+  }
+
+  if (len < STREAM_BUF_SIZE)
+    len = STREAM_BUF_SIZE;
+  if (posix_memalign (&buf, getpagesize (), len) != 0)
+    return NULL;
+
+  return buf;
+}
+
+void
+stream_buf_put (void *buf, int len)
+{
+  struct stream_buf *sbuf = buf;
+
+  if (len <= STREAM_BUF_SIZE && pool_count < STREAM_POOL_MAX) {
+    sbuf->next = pool;
+    pool = sbuf;
+    pool_count++;
+    return;
+  }
+
+  free (buf);
+}
+
+/* read len bytes of a body which has *remaining bytes left */
+static int
+stream_read (int fd, char *buf, int len, int *remaining)
+{
+  if (len < 0 || len > *remaining)
+    return -1;
+
+  *remaining -= len;
+  return full_read (fd, buf, len);
+}
+
+/* a BUF of len bytes into pooled pieces, blk->vector */
+static int
+stream_recv_vector (int fd, gf_block *blk, int len, int *remaining)
+{
+  int count = (len + STREAM_BUF_SIZE - 1) / STREAM_BUF_SIZE;
+  int i;
+
+  blk->vector = calloc (count ? count : 1, sizeof (struct iovec));
+  for (i = 0; i < count; i++) {
+    int piece = (len < STREAM_BUF_SIZE) ? len : STREAM_BUF_SIZE;
+
+    blk->vector[i].iov_base = stream_buf_get (piece);
+    if (!blk->vector[i].iov_base)
+      return -1;
+    blk->vector[i].iov_len = piece;
+    blk->count++;
+    if (stream_read (fd, blk->vector[i].iov_base, piece, remaining) != 0)
+      return -1;
+    len -= piece;
+  }
+  return 0;
+}
+
+/*
+  dict_unserialize () working on the fd instead of a buffer, see
+  dict_serialize () for the format. BUF goes to pooled pieces in
+  blk->vector instead of the dict.
+*/
+static dict_t *
+stream_recv_dict (int fd, gf_block *blk)
+{
+  int size = blk->size;
+  dict_t *dict = get_new_dict ();
+  char line[19] = {0,};
+  int remaining = size;
+  int count = 0;
+  int cnt;
+
+  if (stream_read (fd, line, 9, &remaining) != 0 ||
+      sscanf (line, "%x\n", &count) != 1 ||
+      count <= 0)
+    goto err;
+
+  for (cnt = 0; cnt < count; cnt++) {
+    int key_len, value_len;
+    char *key;
+    data_t *value;
+
+    if (stream_read (fd, line, 18, &remaining) != 0 ||
+	sscanf (line, "%x:%x\n", &key_len, &value_len) != 2)
+      goto err;
+
+    if (key_len < 0 || value_len < 0 || key_len + value_len > remaining)
+      goto err;
+
+    key = calloc (1, key_len + 1);
+    if (stream_read (fd, key, key_len, &remaining) != 0 ||
+	dict_get (dict, key)) {
+      free (key);
+      goto err;
+    }
+
+    if (strcmp (key, "BUF") == 0) {
+      free (key);
+      if (blk->vector ||
+	  stream_recv_vector (fd, blk, value_len, &remaining) != 0)
+	goto err;
+      continue;
+    }
+
+    value = get_new_data ();
+    value->len = value_len;
+    value->data = malloc (value_len + 1);
+    dict_set (dict, key, value);
+    free (key);
+
+    if (!value->data ||
+	stream_read (fd, value->data, value_len, &remaining) != 0)
+      goto err;
+    value->data[value_len] = 0;
+  }
+
+  if (remaining != 0 || !blk->vector)
+    goto err;
+
+  return dict;
+
+ err:
+  dict_destroy (dict);
+  return NULL;
+}
+
+gf_block *
+stream_recv_block (int fd, int max_size)
+{
+  gf_block *blk = gf_block_new ();
+
+  if (gf_block_unserialize_header (fd, blk) != 0)
+    goto err;
+
+  if (blk->size > max_size) {
+    gf_log ("glusterfsd", LOG_CRITICAL,
+	    "stream.c->stream_recv_block: block of %d bytes over the limit of %d",
+	    blk->size, max_size);
+    goto err;
+  }
+
+  if (blk->type == OP_TYPE_FOP_REQUEST && blk->op == OP_WRITE) {
+    blk->dict = stream_recv_dict (fd, blk);
+    if (!blk->dict)
+      goto err;
+  } else {
+    blk->data = malloc (blk->size);
+    if (full_read (fd, blk->data, blk->size) != 0)
+      goto err;
+  }
+
+  if (gf_block_unserialize_trailer (fd) != 0)
+    goto err;
+
+  return blk;
+
+ err:
+  stream_block_free (blk);
+  return NULL;
+}
+
+void
+stream_block_free (gf_block *blk)
+{
+  int i;
+
+  if (blk->dict)
+    dict_destroy (blk->dict);
+  for (i = 0; i < blk->count; i++)
+    stream_buf_put (blk->vector[i].iov_base, blk->vector[i].iov_len);
+  free (blk->vector);
+  free (blk->data);
+  free (blk);
+}
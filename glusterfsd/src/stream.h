@@ -0,0 +1,28 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include "protocol.h"
+#include "dict.h"
+
+/*
+  Receive side of glusterfsd.
+
+  A block bigger than the limit given to stream_recv_block () is refused
+  before anything is allocated for it. The body of a write request is
+  parsed straight off the socket: the BUF payload is read into page
+  aligned pieces of STREAM_BUF_SIZE from a per-thread pool, kept in
+  blk->vector, and the rest of the dict is left in blk->dict; blk->data
+  stays NULL. The payload reaches the writev of the storage xlator
+  without another copy, and stream_block_free () gives the pieces back.
+*/
+
+#define STREAM_BUF_SIZE  (128 * 1024)
+#define STREAM_POOL_MAX  16  /* idle buffers kept per thread */
+
+gf_block *stream_recv_block (int fd, int max_size);
+void stream_block_free (gf_block *blk);
+
+void *stream_buf_get (int len);
+void stream_buf_put (void *buf, int len);
+
+#endif /* _STREAM_H */
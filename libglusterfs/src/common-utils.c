@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
@@ -8,6 +9,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 char *
 stripwhite (char *string)
@@ -163,6 +165,32 @@ str2double (char *str, double *d)
   return 0;
 }
 
+/* "64MB" and the like, KB/MB/GB are powers of 1024 */
+int 
+str2size (char *str, long long *size)
+{
+  long long value;
+  char *tail = NULL;
+  
+  errno = 0;
+  value = strtoll (str, &tail, 10);
+  if (errno || tail == str || value < 0)
+    return (-1);
+  
+  if (strcasecmp (tail, "KB") == 0)
+    value <<= 10;
+  else if (strcasecmp (tail, "MB") == 0)
+    value <<= 20;
+  else if (strcasecmp (tail, "GB") == 0)
+    value <<= 30;
+  else if (tail[0] != '\0' && strcasecmp (tail, "B") != 0)
+    return (-1); // unknown unit
+  
+  *size = value;
+  
+  return 0;
+}
+
 int 
 validate_ip_address (char *ip_address)
 {
@@ -225,3 +253,95 @@ full_write (int fd, char *buf, int size)
 {
   return full_rw (fd, buf, size, write);
 }
+
+/*
+  Make sure all the buffers in vector are written to the fd, in order.
+  vector is modified on the way.
+*/
+int
+full_writev (int fd, struct iovec *vector, int count)
+{
+  while (count) {
+    int ret = writev (fd, vector, count);
+    if (ret <= 0) {
+      if (ret == -1 && errno == EINTR)
+	continue;
+      return -1;
+    }
+
+    while (count && ret >= vector->iov_len) {
+      ret -= vector->iov_len;
+      vector++;
+      count--;
+    }
+
+    if (count) {
+      vector->iov_base = (char *)vector->iov_base + ret;
+      vector->iov_len -= ret;
+    }
+  }
+
+  return 0;
+}
+
+/*
+  Sparse read replies. The nr data extents of data, [start, end) pairs in
+  extents, are moved to its front, and holes gets the gaps between them
+  as "start,length;" pairs in hex; there is room needed for nr + 1 of
+  them. Returns the bytes of data left.
+*/
+int
+sparse_compact (char *data,
+		int len,
+		int *extents,
+		int nr,
+		char *holes)
+{
+  int pos = 0, out = 0, used = 0;
+  int i;
+
+  holes[0] = '\0';
+  for (i = 0; i < nr; i++) {
+    int start = extents[2 * i];
+    int end = extents[2 * i + 1];
+
+    if (start > pos)
+      used += sprintf (holes + used, "%x,%x;", pos, start - pos);
+    memmove (data + out, data + start, end - start);
+    out += end - start;
+    pos = end;
+  }
+  if (pos < len)
+    sprintf (holes + used, "%x,%x;", pos, len - pos);
+
+  return out;
+}
+
+/* undo sparse_compact () into buf of len bytes */
+int
+sparse_expand (char *buf,
+	       int len,
+	       const char *data,
+	       int data_len,
+	       const char *holes)
+{
+  int pos = 0, in = 0;
+  unsigned int start, hole_len;
+  int consumed;
+
+  while (sscanf (holes, "%x,%x;%n", &start, &hole_len, &consumed) == 2) {
+    if (start < pos || start + hole_len > len ||
+	in + (start - pos) > data_len)
+      return -1;
+    memcpy (buf + pos, data + in, start - pos);
+    in += start - pos;
+    memset (buf + start, 0, hole_len);
+    pos = start + hole_len;
+    holes += consumed;
+  }
+
+  if (in + (len - pos) > data_len)
+    return -1;
+  memcpy (buf + pos, data + in, len - pos);
+  return 0;
+}
@@ -8,6 +8,17 @@ int str2ulong (char *str, int base, unsigned long *ul);
 int str2int (char *str, int base, int *i);
 int str2uint (char *str, int base, unsigned int *ui);
 int str2double (char *str, double *d);
+int str2size (char *str, long long *size);
 int validate_ip_address (char *ip_address);
 
+int full_read (int fd, char *buf, int size);
+int full_write (int fd, char *buf, int size);
+
+struct iovec;
+int full_writev (int fd, struct iovec *vector, int count);
+
+int sparse_compact (char *data, int len, int *extents, int nr, char *holes);
+int sparse_expand (char *buf, int len, const char *data, int data_len,
+		   const char *holes);
+
 #endif
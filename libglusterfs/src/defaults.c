@@ -650,11 +650,166 @@ default_fgetattr (struct xlator *xl,
 int
 default_bulk_getattr (struct xlator *xl,
 		      const char *path,
-		      struct bulk_stat *bstbuf)
+		      off_t offset,
+		      struct bulk_stat *bstbuf,
+		      off_t *next)
 {
   return xl->first_child->fops->bulk_getattr (xl->first_child,
 					      path,
-					      bstbuf);
+					      offset,
+					      bstbuf,
+					      next);
+}
+
+/* an xlator without readv/writev of its own gets one read or write per
+   piece, through its own fops; forwarding to the child would go past
+   what its read and write do, and a transport has no child */
+int
+default_readv (struct xlator *xl,
+	       const char *path,
+	       const struct iovec *vector,
+	       int count,
+	       off_t offset,
+	       struct file_context *ctx)
+{
+  int done = 0;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    int ret = xl->fops->read (xl,
+			      path,
+			      vector[i].iov_base,
+			      vector[i].iov_len,
+			      offset + done,
+			      ctx);
+
+    if (ret < 0)
+      return done ? done : ret;
+    done += ret;
+    if (ret < vector[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+int
+default_writev (struct xlator *xl,
+		const char *path,
+		const struct iovec *vector,
+		int count,
+		off_t offset,
+		struct file_context *ctx)
+{
+  int done = 0;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    int ret = xl->fops->write (xl,
+			       path,
+			       vector[i].iov_base,
+			       vector[i].iov_len,
+			       offset + done,
+			       ctx);
+
+    if (ret < 0)
+      return done ? done : ret;
+    done += ret;
+    if (ret < vector[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+int
+default_getdents (struct xlator *xl,
+		  const char *path,
+		  off_t offset,
+		  char *buf,
+		  size_t size,
+		  off_t *next)
+{
+  return xl->first_child->fops->getdents (xl->first_child,
+					  path,
+					  offset,
+					  buf,
+					  size,
+					  next);
+}
+
+int
+default_copy (struct xlator *xl,
+	      const char *from,
+	      off_t from_offset,
+	      const char *to,
+	      off_t to_offset,
+	      size_t size)
+{
+  return xl->first_child->fops->copy (xl->first_child,
+				      from,
+				      from_offset,
+				      to,
+				      to_offset,
+				      size);
+}
+
+int
+default_seek (struct xlator *xl,
+	      const char *path,
+	      off_t offset,
+	      int whence,
+	      off_t *result,
+	      struct file_context *ctx)
+{
+  return xl->first_child->fops->seek (xl->first_child,
+				      path,
+				      offset,
+				      whence,
+				      result,
+				      ctx);
+}
+
+int
+default_fallocate (struct xlator *xl,
+		   const char *path,
+		   int keep_size,
+		   off_t offset,
+		   size_t len,
+		   struct file_context *ctx)
+{
+  return xl->first_child->fops->fallocate (xl->first_child,
+					   path,
+					   keep_size,
+					   offset,
+					   len,
+					   ctx);
+}
+
+int
+default_discard (struct xlator *xl,
+		 const char *path,
+		 off_t offset,
+		 size_t len,
+		 struct file_context *ctx)
+{
+  return xl->first_child->fops->discard (xl->first_child,
+					 path,
+					 offset,
+					 len,
+					 ctx);
+}
+
+int
+default_zerofill (struct xlator *xl,
+		  const char *path,
+		  off_t offset,
+		  size_t len,
+		  struct file_context *ctx)
+{
+  return xl->first_child->fops->zerofill (xl->first_child,
+					  path,
+					  offset,
+					  len,
+					  ctx);
 }
 
 int
@@ -170,7 +170,71 @@ default_fgetattr (struct xlator *xl,
 int
 default_bulk_getattr (struct xlator *xl,
 		      const char *path,
-		      struct bulk_stat *bstbuf);
+		      off_t offset,
+		      struct bulk_stat *bstbuf,
+		      off_t *next);
+
+int
+default_readv (struct xlator *xl,
+	       const char *path,
+	       const struct iovec *vector,
+	       int count,
+	       off_t offset,
+	       struct file_context *ctx);
+
+int
+default_writev (struct xlator *xl,
+		const char *path,
+		const struct iovec *vector,
+		int count,
+		off_t offset,
+		struct file_context *ctx);
+
+int
+default_getdents (struct xlator *xl,
+		  const char *path,
+		  off_t offset,
+		  char *buf,
+		  size_t size,
+		  off_t *next);
+
+int
+default_copy (struct xlator *xl,
+	      const char *from,
+	      off_t from_offset,
+	      const char *to,
+	      off_t to_offset,
+	      size_t size);
+
+int
+default_seek (struct xlator *xl,
+	      const char *path,
+	      off_t offset,
+	      int whence,
+	      off_t *result,
+	      struct file_context *ctx);
+
+int
+default_fallocate (struct xlator *xl,
+		   const char *path,
+		   int keep_size,
+		   off_t offset,
+		   size_t len,
+		   struct file_context *ctx);
+
+int
+default_discard (struct xlator *xl,
+		 const char *path,
+		 off_t offset,
+		 size_t len,
+		 struct file_context *ctx);
+
+int
+default_zerofill (struct xlator *xl,
+		  const char *path,
+		  off_t offset,
+		  size_t len,
+		  struct file_context *ctx);
 
 int 
 default_stats (struct xlator *this,
@@ -349,11 +349,12 @@ dict_unserialize (char *buf, int size, dict_t **fill)
 }
 
 /*
-  Encapsulate a dict in a block and write it to the fd
+  Encapsulate a dict in a block, the serialized block is returned in
+  a malloc'd buffer of *len bytes
 */
 
-int
-dict_dump (int fd, dict_t *dict, gf_block *blk, int type)
+char *
+dict_dump_buf (dict_t *dict, gf_block *blk, int type, int *len)
 {
   int dict_len = dict_serialized_length (dict);
   char *dict_buf = malloc (dict_len);
@@ -364,11 +365,26 @@ dict_dump (int fd, dict_t *dict, gf_block *blk, int type)
   int blk_len = gf_block_serialized_length (blk);
   char *blk_buf = malloc (blk_len);
   gf_block_serialize (blk, blk_buf);
+
+  free (dict_buf);
+  blk->data = NULL;
+  *len = blk_len;
+  return blk_buf;
+}
+
+/*
+  Encapsulate a dict in a block and write it to the fd
+*/
+
+int
+dict_dump (int fd, dict_t *dict, gf_block *blk, int type)
+{
+  int blk_len;
+  char *blk_buf = dict_dump_buf (dict, blk, type, &blk_len);
   
   int ret = full_write (fd, blk_buf, blk_len);
   
   free (blk_buf);
-  free (dict_buf);
   return ret;
 }
 
@@ -33,6 +33,7 @@ data_t *dict_get (dict_t *this, char *key);
 void dict_del (dict_t *this, char *key);
 
 int dict_dump (int fd, dict_t *dict, gf_block *blk, int type);
+char *dict_dump_buf (dict_t *dict, gf_block *blk, int type, int *len);
 
 int dict_serialized_length (dict_t *dict);
 void dict_serialize (dict_t *dict, char *buf);
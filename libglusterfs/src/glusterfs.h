@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/poll.h>
+#include <sys/uio.h>
 #include <pthread.h>
 
 #include "dict.h"
@@ -24,6 +25,26 @@
 
 #define gprintf printf
 
+/* most bytes of names returned by one getdents call */
+#define GF_GETDENTS_PAGE (64 * 1024)
+/* bytes of names behind one bulk_getattr page, keeps replies under 1MB */
+#define GF_BULK_GETATTR_PAGE (16 * 1024)
+
+/* setxattr of this name asks the storage to reserve that many bytes for
+   the file, nothing is stored */
+#define GF_XATTR_SIZE_HINT "trusted.glusterfs.size-hint"
+
+/* setxattr of this name on a file replaces its contents with those of the
+   file named by the value, copied by the bricks */
+#define GF_XATTR_COPY_FROM "trusted.glusterfs.copy-from"
+
+/* most bytes one copy request moves, callers loop */
+#define GF_COPY_MAX (64 * 1024 * 1024)
+
+/* a read reply leaves out holes once they add up to this many bytes */
+#define GF_SPARSE_MIN_HOLE 4096
+#define GF_SPARSE_MAX_EXTENTS 128
+
 #define FUNCTION_CALLED /*\
 do {                    \
      gf_log (__FILE__, LOG_DEBUG, "%s called\n", __FUNCTION__); \
@@ -65,6 +86,12 @@ typedef enum {
   OP_FTRUNCATE,
   OP_FGETATTR,
   OP_BULKGETATTR,
+  OP_GETDENTS,
+  OP_COPY,
+  OP_SEEK,
+  OP_FALLOCATE,
+  OP_DISCARD,
+  OP_ZEROFILL,
   OP_MAXVALUE
 } glusterfs_op_t;
 
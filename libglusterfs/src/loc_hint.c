@@ -14,25 +14,18 @@ closest_power_of_two (int n)
 loc_hint_table
 *loc_hint_table_new (int nr_entries)
 {
-  loc_hint_table *hints = malloc (sizeof (loc_hint_table));
+  loc_hint_table *hints = calloc (1, sizeof (loc_hint_table));
   hints->table_size = closest_power_of_two (nr_entries);
-  hints->table = malloc (sizeof (loc_hint) * hints->table_size);
+  hints->table = calloc (hints->table_size, sizeof (loc_hint *));
 
   int i;
   
   hints->unused_entries = (loc_hint *) calloc (nr_entries, sizeof (loc_hint));
   hints->unused_entries_initial = hints->unused_entries;
   
-  hints->unused_entries[0].prev = NULL;
-  hints->unused_entries[0].next = &hints->unused_entries[1];
-
-  for (i = 1; i < nr_entries-1; i++) {
+  /* the unused entries are only chained through next */
+  for (i = 0; i < nr_entries - 1; i++)
     hints->unused_entries[i].next = &hints->unused_entries[i+1];
-    hints->unused_entries[i].prev = &hints->unused_entries[i-1];
-  }
-
-  hints->unused_entries[nr_entries-1].prev = &hints->unused_entries[nr_entries-2];
-  hints->unused_entries[nr_entries-1].next = NULL;
 
   pthread_mutex_init (&hints->lock, NULL);
   return hints;
@@ -41,20 +34,30 @@ loc_hint_table
 void 
 loc_hint_table_destroy (loc_hint_table *hints)
 {
+  loc_hint *hint;
+
   pthread_mutex_lock (&hints->lock);
+  for (hint = hints->used_entries; hint != NULL; hint = hint->next)
+    free ((void *)hint->path);
   free (hints->unused_entries_initial);
   free (hints->table);
   pthread_mutex_unlock (&hints->lock);
+  pthread_mutex_destroy (&hints->lock);
   free (hints);
 }
 
+static unsigned int
+hint_hash (loc_hint_table *hints, const char *path)
+{
+  return SuperFastHash (path, strlen (path)) % hints->table_size;
+}
+
 static loc_hint *
 hint_lookup (loc_hint_table *hints, const char *path)
 {
-  int hashval = SuperFastHash (path, strlen (path)) % hints->table_size;
   loc_hint *h;
 
-  for (h = hints->table[hashval]; h != NULL; h = h->hash_next) {
+  for (h = hints->table[hint_hash (hints, path)]; h != NULL; h = h->hash_next) {
     if (!strcmp (h->path, path))
       return h;
   }
@@ -62,31 +65,81 @@ hint_lookup (loc_hint_table *hints, const char *path)
   return NULL;
 }
 
+/* takes hint out of the used list */
+static void
+hint_unlink (loc_hint_table *hints, loc_hint *hint)
+{
+  if (hint->prev)
+    hint->prev->next = hint->next;
+  else
+    hints->used_entries = hint->next;
+
+  if (hint->next)
+    hint->next->prev = hint->prev;
+  else
+    hints->used_entries_last = hint->prev;
+
+  hint->next = hint->prev = NULL;
+}
+
+/* puts hint at the front of the used list, the most recent end */
+static void
+hint_push_front (loc_hint_table *hints, loc_hint *hint)
+{
+  hint->prev = NULL;
+  hint->next = hints->used_entries;
+  if (hints->used_entries)
+    hints->used_entries->prev = hint;
+  hints->used_entries = hint;
+  if (hints->used_entries_last == NULL)
+    hints->used_entries_last = hint;
+}
+
+/* puts hint at the back of the used list, the first to be reused */
+static void
+hint_push_back (loc_hint_table *hints, loc_hint *hint)
+{
+  hint->next = NULL;
+  hint->prev = hints->used_entries_last;
+  if (hints->used_entries_last)
+    hints->used_entries_last->next = hint;
+  hints->used_entries_last = hint;
+  if (hints->used_entries == NULL)
+    hints->used_entries = hint;
+}
+
+static void
+hint_unhash (loc_hint_table *hints, loc_hint *hint)
+{
+  loc_hint **h = &hints->table[hint_hash (hints, hint->path)];
+
+  while (*h != NULL) {
+    if (*h == hint) {
+      *h = hint->hash_next;
+      break;
+    }
+    h = &(*h)->hash_next;
+  }
+  hint->hash_next = NULL;
+}
+
 struct xlator *
 loc_hint_lookup (loc_hint_table *hints, const char *path)
 {
+  struct xlator *xlator = NULL;
+
   pthread_mutex_lock (&hints->lock);
   loc_hint *hint = hint_lookup (hints, path);
   if (hint && hint->valid) {
     /* bring this entry to the front */
-    if (hint->prev)
-      hint->prev->next = hint->next;
-    if (hint->next)
-      hint->next->prev = hint->prev;
-
-    hints->used_entries->prev = hint;
-    hint->next = hints->used_entries;
-    hint->prev = NULL;
-    hints->used_entries = hint;
-
-    pthread_mutex_unlock (&hints->lock);
-    /* return with reference (_getref) */
-    return hint->xlator;
-  }
-  else {
-    pthread_mutex_unlock (&hints->lock);
-    return NULL;
+    hint_unlink (hints, hint);
+    hint_push_front (hints, hint);
+    /* TBD: return with reference (_getref) */
+    xlator = hint->xlator;
   }
+  pthread_mutex_unlock (&hints->lock);
+
+  return xlator;
 }
 
 void 
@@ -99,95 +152,47 @@ loc_hint_insert (loc_hint_table *hints, const char *path, struct xlator *xlator)
   if (hint) {
     /* getref */
     hint->xlator = xlator;
+    hint->valid = 1;
+    hint_unlink (hints, hint);
+    hint_push_front (hints, hint);
     pthread_mutex_unlock (&hints->lock);
     return;
   }
 
   /*
-    If we have unused entries, take one from it and insert it into
-    the used entries list
+    If we have unused entries, take one from it, otherwise take the last
+    entry from the used list (the "oldest") that nobody holds
   */
   if (hints->unused_entries) {
     hint = hints->unused_entries;
     hints->unused_entries = hint->next;
-    
-    if (hints->unused_entries)
-      hints->unused_entries->prev = NULL;
-    hint->next = hints->used_entries;
-    
-    if (hints->used_entries)
-      hints->used_entries->prev = hint;
-    hints->used_entries = hint;
-
-    if (hints->used_entries_last == NULL)
-      hints->used_entries_last = hint;
-
-    hint->path = strdup (path);
-    hint->xlator = xlator;
-    hint->valid = 1;
-
-    int hashval = SuperFastHash (path, strlen (path)) % hints->table_size;
-    hint->hash_next = hints->table[hashval];
-    hints->table[hashval] = hint;
-
-    pthread_mutex_unlock (&hints->lock);
-    return;
-  }
-
-  /* 
-     All entries are in use. Take the last entry from the used list
-     (the "oldest") and use it
-  */
-
-  hint = hints->used_entries_last;
-  while (hint->refcount > 0) {
-    hint = hint->prev;
+  } else {
+    hint = hints->used_entries_last;
+    while (hint && hint->refcount > 0)
+      hint = hint->prev;
     if (!hint) {
       /*
 	uh-oh. We've reached the beginning of the list without finding any free
 	node. Silently return.
       */
+      pthread_mutex_unlock (&hints->lock);
       return;
     }
-  }
-
-  /* Remove that node from the used list and the hash table */
-  /* TBD: unref() on the xlator, and lose reference to it 
-     before fixing next xlator, and get a reference to it
-     with getref () */
-  if (hint == hints->used_entries_last)
-    hints->used_entries_last = hint->prev;
-  
-  if (hint->prev)
-    hint->prev->next = hint->next;
-  
-  if (hint->next)
-    hint->next->prev = hint->prev;
 
-  int hashval = SuperFastHash (path, strlen (path)) % hints->table_size;
-  loc_hint *h = hints->table[hashval];
-  loc_hint *hp = NULL;
-  while (h != NULL) {
-    if (h == hint) {
-      if (hp)
-	hp->next = h->next;
-      else
-	hints->table[hashval] = h->next;
-    }
-    hp = h;
-    h = h->next;
+    /* TBD: unref() on the xlator, and lose reference to it 
+       before fixing next xlator, and get a reference to it
+       with getref () */
+    hint_unlink (hints, hint);
+    hint_unhash (hints, hint);
+    free ((void *)hint->path);
   }
-  
-  free ((void *)hint->path);
+
   hint->path = strdup (path);
   hint->xlator = xlator;
   hint->valid = 1;
+  hint_push_front (hints, hint);
 
-  hint->next = hints->used_entries;
-  hint->prev = NULL;
-  hints->used_entries = hint;
-
-  hashval = SuperFastHash (path, strlen (path)) % hints->table_size;
+  unsigned int hashval = hint_hash (hints, path);
   hint->hash_next = hints->table[hashval];
   hints->table[hashval] = hint;
 
@@ -198,8 +203,12 @@ void loc_hint_invalidate (loc_hint_table *hints, const char *path)
 {
   pthread_mutex_lock (&hints->lock);
   loc_hint *hint = hint_lookup (hints, path);
-  if (hint) 
+  if (hint) {
     hint->valid = 0;
+    /* no use keeping it over valid ones */
+    hint_unlink (hints, hint);
+    hint_push_back (hints, hint);
+  }
   pthread_mutex_unlock (&hints->lock);
 }
 
@@ -52,33 +52,32 @@ gf_block_serialized_length (gf_block *b)
 	  NAME_LEN + SIZE_LEN + b->size + END_LEN);
 }
 
-gf_block *
-gf_block_unserialize (int fd)
+/*
+  Read and check the fixed size header of a block, fills type, op,
+  name and size of blk. The body is left on the fd.
+*/
+int
+gf_block_unserialize_header (int fd, gf_block *blk)
 {
-  gf_block *blk = gf_block_new ();
-  int header_len = START_LEN + TYPE_LEN + OP_LEN +
-    NAME_LEN + SIZE_LEN;
-  char *header = malloc (header_len);
+  char buf[START_LEN + TYPE_LEN + OP_LEN + NAME_LEN + SIZE_LEN];
+  char *header = buf;
 
-  int ret = full_read (fd, header, header_len);
+  int ret = full_read (fd, header, sizeof (buf));
   if (ret == -1)
-    goto err;
-
-  //  fprintf (stderr, "----------\n[READ]\n----------\n");
-  //  write (2, header, header_len);
+    return -1;
 
   if (strncmp (header, "Block Start\n", START_LEN) != 0) 
-    goto err;
+    return -1;
   header += START_LEN;
 
   ret = sscanf (header, "%o\n", &blk->type);
   if (ret != 1)
-    goto err;
+    return -1;
   header += TYPE_LEN;
   
   ret = sscanf (header, "%o\n", &blk->op);
   if (ret != 1)
-    goto err;
+    return -1;
   header += OP_LEN;
   
   memcpy (blk->name, header, NAME_LEN-1);
@@ -86,13 +85,36 @@ gf_block_unserialize (int fd)
 
   ret = sscanf (header, "%o\n", &blk->size);
   if (ret != 1)
-    goto err;
+    return -1;
 
   if (blk->size < 0)
+    return -1;
+
+  return 0;
+}
+
+int
+gf_block_unserialize_trailer (int fd)
+{
+  char end[END_LEN+1] = {0,};
+  int ret = full_read (fd, end, END_LEN);
+
+  if ((ret != 0) || (strncmp (end, "Block End\n", END_LEN) != 0))
+    return -1;
+
+  return 0;
+}
+
+gf_block *
+gf_block_unserialize (int fd)
+{
+  gf_block *blk = gf_block_new ();
+
+  if (gf_block_unserialize_header (fd, blk) != 0)
     goto err;
 
   char *buf = malloc (blk->size);
-  ret = full_read (fd, buf, blk->size);
+  int ret = full_read (fd, buf, blk->size);
   if (ret == -1) {
     free (buf);
     goto err;
@@ -103,20 +125,15 @@ gf_block_unserialize (int fd)
   }
   blk->data = buf;
   
-  char end[END_LEN+1] = {0,};
-  ret = full_read (fd, end, END_LEN);
-  if ((ret != 0) || (strncmp (end, "Block End\n", END_LEN) != 0))
+  if (gf_block_unserialize_trailer (fd) != 0)
     goto err;
 
-  if (strstr (buf, "NR_ENTRIES")){
-    gf_log ("libglusterfs", LOG_CRITICAL, "protocol.c->unserialize: block end string: %s\n", end);
-  }
   //  write (2, buf, bytes_read);
-  //  write (2, end, END_LEN);
   
   return blk;
   
  err:
+  free (blk->data);
   free (blk);
   return NULL;
 }
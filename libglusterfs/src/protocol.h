@@ -23,12 +23,18 @@
 #define SIZE_LEN  33
 #define END_LEN   10
 
+struct _dict;
+struct iovec;
+
 typedef struct {
   int type;
   int op;
   char name[32];
   int size;
   char *data;
+  struct _dict *dict; /* body already parsed off the fd, data is NULL then */
+  struct iovec *vector; /* BUF of a write parsed that way, in pieces */
+  int count;
 } gf_block;
 
 gf_block *gf_block_new (void);
@@ -36,5 +42,7 @@ int gf_block_serialize (gf_block *b, char *buf);
 int gf_block_serialized_length (gf_block *b);
 
 gf_block *gf_block_unserialize (int fd);
+int gf_block_unserialize_header (int fd, gf_block *blk);
+int gf_block_unserialize_trailer (int fd);
 
 #endif
@@ -158,9 +158,15 @@ yyerror (const char *str)
 }
 
 extern FILE *yyin;
+extern void yyrestart (FILE *fp);
+
 struct xlator *
 file_to_xlator_tree (FILE *fp)
 {
+  /* may be called again to load a new spec, start from scratch */
+  complete_tree = NULL;
+  tree = NULL;
+  yyrestart (fp);
   yyin = fp;
   yyparse ();
   return complete_tree;
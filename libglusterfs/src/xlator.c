@@ -2,6 +2,7 @@
 #include "xlator.h"
 #include <dlfcn.h>
 #include <netdb.h>
+#include <endian.h>
 #include "defaults.h"
 
 #define SET_DEFAULT_FOP(fn) do {        \
@@ -55,6 +56,14 @@ fill_defaults (struct xlator *xl)
   SET_DEFAULT_FOP (ftruncate);
   SET_DEFAULT_FOP (fgetattr);
   SET_DEFAULT_FOP (bulk_getattr);
+  SET_DEFAULT_FOP (readv);
+  SET_DEFAULT_FOP (writev);
+  SET_DEFAULT_FOP (getdents);
+  SET_DEFAULT_FOP (copy);
+  SET_DEFAULT_FOP (seek);
+  SET_DEFAULT_FOP (fallocate);
+  SET_DEFAULT_FOP (discard);
+  SET_DEFAULT_FOP (zerofill);
 
   SET_DEFAULT_MGMT_OP (stats);
   SET_DEFAULT_MGMT_OP (lock);
@@ -157,3 +166,48 @@ foreach_xlator (struct xlator *this,
 
   _foreach_dfs (top, fn);
 }
+
+void
+bulk_stat_pack (struct bulk_stat_record *rec,
+		const struct stat *stbuf)
+{
+  rec->dev = htobe64 (stbuf->st_dev);
+  rec->ino = htobe64 (stbuf->st_ino);
+  rec->rdev = htobe64 (stbuf->st_rdev);
+  rec->size = htobe64 (stbuf->st_size);
+  rec->blocks = htobe64 (stbuf->st_blocks);
+  rec->atime = htobe64 (stbuf->st_atime);
+  rec->mtime = htobe64 (stbuf->st_mtime);
+  rec->ctime = htobe64 (stbuf->st_ctime);
+  rec->atime_nsec = htonl (stbuf->st_atim.tv_nsec);
+  rec->mtime_nsec = htonl (stbuf->st_mtim.tv_nsec);
+  rec->ctime_nsec = htonl (stbuf->st_ctim.tv_nsec);
+  rec->mode = htonl (stbuf->st_mode);
+  rec->nlink = htonl (stbuf->st_nlink);
+  rec->uid = htonl (stbuf->st_uid);
+  rec->gid = htonl (stbuf->st_gid);
+  rec->blksize = htonl (stbuf->st_blksize);
+}
+
+void
+bulk_stat_unpack (struct stat *stbuf,
+		  const struct bulk_stat_record *rec)
+{
+  memset (stbuf, 0, sizeof (*stbuf));
+  stbuf->st_dev = be64toh (rec->dev);
+  stbuf->st_ino = be64toh (rec->ino);
+  stbuf->st_rdev = be64toh (rec->rdev);
+  stbuf->st_size = be64toh (rec->size);
+  stbuf->st_blocks = be64toh (rec->blocks);
+  stbuf->st_atime = be64toh (rec->atime);
+  stbuf->st_mtime = be64toh (rec->mtime);
+  stbuf->st_ctime = be64toh (rec->ctime);
+  stbuf->st_atim.tv_nsec = ntohl (rec->atime_nsec);
+  stbuf->st_mtim.tv_nsec = ntohl (rec->mtime_nsec);
+  stbuf->st_ctim.tv_nsec = ntohl (rec->ctime_nsec);
+  stbuf->st_mode = ntohl (rec->mode);
+  stbuf->st_nlink = ntohl (rec->nlink);
+  stbuf->st_uid = ntohl (rec->uid);
+  stbuf->st_gid = ntohl (rec->gid);
+  stbuf->st_blksize = ntohl (rec->blksize);
+}
@@ -1,6 +1,7 @@
 #ifndef _XLATOR_H
 #define _XLATOR_H
 #include <stdio.h>
+#include <stdint.h>
 #include "glusterfs.h"
 #include "layout.h"
 
@@ -35,14 +36,43 @@ struct bulk_stat {
   struct bulk_stat *next;
 };
 
+/* one entry of a bulk_getattr reply: fixed size, big endian, the names
+   travel separately in readdir order */
+struct bulk_stat_record {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t rdev;
+  uint64_t size;
+  uint64_t blocks;
+  uint64_t atime;
+  uint64_t mtime;
+  uint64_t ctime;
+  uint32_t atime_nsec;
+  uint32_t mtime_nsec;
+  uint32_t ctime_nsec;
+  uint32_t mode;
+  uint32_t nlink;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t blksize;
+} __attribute__ ((packed));
+
+void bulk_stat_pack (struct bulk_stat_record *rec, const struct stat *stbuf);
+void bulk_stat_unpack (struct stat *stbuf, const struct bulk_stat_record *rec);
+
 struct xlator_stats {
   unsigned long nr_files;   /* Number of files open via this xlator */
   unsigned long long free_disk; /* Mega bytes */
   unsigned long long disk_usage; /* Mega bytes */
-  unsigned long disk_speed; /* MHz or Mbps */
+  unsigned long disk_speed; /* MB/s, measured by the storage */
   unsigned long nr_clients; /* Number of client nodes (filled by glusterfsd) */
-  unsigned long long write_usage;
-  unsigned long long read_usage;
+  unsigned long long write_usage; /* KB/s, averaged over the last seconds */
+  unsigned long long read_usage;  /* KB/s, averaged over the last seconds */
+  unsigned long read_iops;
+  unsigned long write_iops;
+  unsigned long latency_p50; /* usecs of reads and writes, recent ones */
+  unsigned long latency_p90;
+  unsigned long latency_p99;
   /* add more stats here */
 };
 
@@ -109,7 +139,34 @@ struct xlator_fops {
 		    struct  file_context *ctx);
   int (*fgetattr) (struct xlator *this, const char *path, struct stat *buf,
 		 struct file_context *ctx);
-  int (*bulk_getattr) (struct xlator *this, const char *path, struct bulk_stat *bstbuf);
+  /* stats one page of the directory from the offset cookie on, entries go
+     on the front of bstbuf->next; returns their number, 0 at the end */
+  int (*bulk_getattr) (struct xlator *this, const char *path, off_t offset,
+		       struct bulk_stat *bstbuf, off_t *next);
+  /* read and write at offset into or from the pieces of vector in turn,
+     returns the bytes moved */
+  int (*readv) (struct xlator *this, const char *path, const struct iovec *vector,
+		int count, off_t offset, struct file_context *ctx);
+  int (*writev) (struct xlator *this, const char *path, const struct iovec *vector,
+		 int count, off_t offset, struct file_context *ctx);
+  /* a page of '/' separated names starting at the offset cookie, returns
+     the number of names, 0 at the end; *next resumes after this page */
+  int (*getdents) (struct xlator *this, const char *path, off_t offset,
+		   char *buf, size_t size, off_t *next);
+  /* copy_file_range between two existing files of this volume, returns
+     the bytes copied, short at the end of from */
+  int (*copy) (struct xlator *this, const char *from, off_t from_offset,
+	       const char *to, off_t to_offset, size_t size);
+  /* lseek with SEEK_DATA or SEEK_HOLE, the extent map of an open file */
+  int (*seek) (struct xlator *this, const char *path, off_t offset,
+	       int whence, off_t *result, struct file_context *ctx);
+  /* reserve, punch out or zero a range of an open file, no data moves */
+  int (*fallocate) (struct xlator *this, const char *path, int keep_size,
+		    off_t offset, size_t len, struct file_context *ctx);
+  int (*discard) (struct xlator *this, const char *path, off_t offset,
+		  size_t len, struct file_context *ctx);
+  int (*zerofill) (struct xlator *this, const char *path, off_t offset,
+		   size_t len, struct file_context *ctx);
 };
 
 struct xlator {
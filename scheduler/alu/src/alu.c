@@ -183,14 +183,14 @@ alu_init (struct xlator *xl)
 	_threshold_fn->sched_value = get_stats_write_usage;
 	entry_fn = dict_get (xl->options, "alu.write-usage.entry-threshold");
 	if (!entry_fn) {
-	  alu_sched->entry_limit.write_usage = 25;
+	  alu_sched->entry_limit.write_usage = 25 * 1024; /* KB/s */
 	} else {
 	  alu_sched->entry_limit.write_usage = (long)str_to_long_long (entry_fn->data);
 	}
 	_threshold_fn->entry_value = get_stats_write_usage;
 	exit_fn = dict_get (xl->options, "alu.write-usage.exit-threshold");
 	if (!exit_fn) {
-	  alu_sched->exit_limit.write_usage = 5;
+	  alu_sched->exit_limit.write_usage = 5 * 1024;
 	} else {
 	  alu_sched->exit_limit.write_usage = (long)str_to_long_long (exit_fn->data);
 	}
@@ -215,14 +215,14 @@ alu_init (struct xlator *xl)
 	_threshold_fn->sched_value = get_stats_read_usage;
 	entry_fn = dict_get (xl->options, "alu.read-usage.entry-threshold");
 	if (!entry_fn) {
-	  alu_sched->entry_limit.read_usage = 25;
+	  alu_sched->entry_limit.read_usage = 25 * 1024; /* KB/s */
 	} else {
 	  alu_sched->entry_limit.read_usage = (long)str_to_long_long (entry_fn->data);
 	}
 	_threshold_fn->entry_value = get_stats_read_usage;
 	exit_fn = dict_get (xl->options, "alu.read-usage.exit-threshold");
 	if (!exit_fn) {
-	  alu_sched->exit_limit.read_usage = 5;
+	  alu_sched->exit_limit.read_usage = 5 * 1024;
 	} else {
 	  alu_sched->exit_limit.read_usage = (long)str_to_long_long (exit_fn->data);
 	}
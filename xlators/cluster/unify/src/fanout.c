@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <errno.h>
+
+#include "fanout.h"
+#include "logging.h"
+
+struct fanout_batch {
+  int left;
+  pthread_cond_t done;
+};
+
+static void
+call_run (struct fanout_call *call)
+{
+  errno = 0;
+  call->ret = call->fn (call);
+  call->op_errno = errno;
+}
+
+/* with the lock held: the first queued call, of batch if given */
+static struct fanout_call *
+queue_take (struct fanout_pool *pool, struct fanout_batch *batch)
+{
+  struct fanout_call **trav = &pool->first;
+  struct fanout_call *prev = NULL;
+  struct fanout_call *call;
+
+  while (*trav && batch && (*trav)->batch != batch) {
+    prev = *trav;
+    trav = &(*trav)->next;
+  }
+  call = *trav;
+  if (!call)
+    return NULL;
+
+  *trav = call->next;
+  if (pool->last == call)
+    pool->last = prev;
+  return call;
+}
+
+static void *
+fanout_worker (void *arg)
+{
+  struct fanout_pool *pool = arg;
+
+  pthread_mutex_lock (&pool->lock);
+  while (1) {
+    struct fanout_call *call = queue_take (pool, NULL);
+
+    if (!call) {
+      if (pool->stopping)
+	break;
+      pthread_cond_wait (&pool->queued, &pool->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock (&pool->lock);
+    call_run (call);
+    pthread_mutex_lock (&pool->lock);
+    if (--call->batch->left == 0)
+      pthread_cond_signal (&call->batch->done);
+  }
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+struct fanout_pool *
+fanout_pool_new (int nr_threads)
+{
+  struct fanout_pool *pool = calloc (1, sizeof (*pool));
+  int i;
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->queued, NULL);
+  pool->threads = calloc (nr_threads, sizeof (pthread_t));
+  for (i = 0; i < nr_threads; i++) {
+    if (pthread_create (&pool->threads[i], NULL, fanout_worker, pool) != 0) {
+      gf_log ("unify", LOG_CRITICAL, "fanout.c->fanout_pool_new: only %d of %d threads started\n",
+	      i, nr_threads);
+      break;
+    }
+  }
+  pool->nr_threads = i;
+  return pool;
+}
+
+void
+fanout_pool_destroy (struct fanout_pool *pool)
+{
+  int i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast (&pool->queued);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < pool->nr_threads; i++)
+    pthread_join (pool->threads[i], NULL);
+
+  pthread_cond_destroy (&pool->queued);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->threads);
+  free (pool);
+}
+
+/* every call of calls[] run once, returns when all of them have */
+void
+fanout_run (struct fanout_pool *pool,
+	    struct fanout_call *calls,
+	    int count)
+{
+  struct fanout_batch batch;
+  int i;
+
+  if (!pool || !pool->nr_threads || count == 1) {
+    for (i = 0; i < count; i++)
+      call_run (&calls[i]);
+    return;
+  }
+
+  batch.left = count;
+  pthread_cond_init (&batch.done, NULL);
+
+  pthread_mutex_lock (&pool->lock);
+  for (i = 0; i < count; i++) {
+    calls[i].batch = &batch;
+    calls[i].next = NULL;
+    if (pool->last)
+      pool->last->next = &calls[i];
+    else
+      pool->first = &calls[i];
+    pool->last = &calls[i];
+  }
+  pthread_cond_broadcast (&pool->queued);
+
+  while (batch.left) {
+    struct fanout_call *call = queue_take (pool, &batch);
+
+    if (!call) {
+      pthread_cond_wait (&batch.done, &pool->lock);
+      continue;
+    }
+    pthread_mutex_unlock (&pool->lock);
+    call_run (call);
+    pthread_mutex_lock (&pool->lock);
+    batch.left--;
+  }
+  pthread_mutex_unlock (&pool->lock);
+
+  pthread_cond_destroy (&batch.done);
+}
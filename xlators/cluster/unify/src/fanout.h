@@ -0,0 +1,49 @@
+#ifndef _FANOUT_H
+#define _FANOUT_H
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "xlator.h"
+
+/*
+  One fop sent to every child of unify at once. The calls of a batch are
+  queued to a pool of threads, and the caller runs calls of its own
+  batch while it waits, so a batch completes even with every thread busy
+  (a unify below another one). A batch takes as long as its slowest
+  child instead of the sum of them.
+*/
+
+struct fanout_batch;
+
+struct fanout_call {
+  struct fanout_call *next;      /* the queue */
+  struct fanout_batch *batch;
+  struct xlator *child;
+  int (*fn) (struct fanout_call *call);
+  void *args;                    /* shared by the calls of a batch */
+  int ret;
+  int op_errno;
+  union {                        /* what the child answered */
+    struct stat stbuf;
+    struct statvfs statvfs;
+    char *names;
+  } out;
+};
+
+struct fanout_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t queued;
+  struct fanout_call *first;
+  struct fanout_call *last;
+  pthread_t *threads;
+  int nr_threads;
+  char stopping;
+};
+
+struct fanout_pool *fanout_pool_new (int nr_threads);
+void fanout_pool_destroy (struct fanout_pool *pool);
+
+void fanout_run (struct fanout_pool *pool, struct fanout_call *calls, int count);
+
+#endif /* _FANOUT_H */
@@ -1,12 +1,129 @@
 
+#include <limits.h>
 #include "glusterfs.h"
 #include "unify.h"
 #include "dict.h"
 #include "xlator.h"
+#include "common-utils.h"
+
+/* the arguments of a fop sent to every child */
+struct cement_args {
+  const char *path;
+  const char *newpath;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  off_t offset;
+};
+
+/* calls fn for each child, all at once when there is a pool; the calls
+   come back in the order of the children, to be freed by the caller */
+static struct fanout_call *
+cement_fanout (struct xlator *xl,
+	       int (*fn) (struct fanout_call *),
+	       struct cement_args *args)
+{
+  struct cement_private *priv = xl->private;
+  struct fanout_call *calls = calloc (priv->childnode_cnt, sizeof (*calls));
+  struct xlator *trav_xl = xl->first_child;
+  int i;
 
+  for (i = 0; trav_xl; i++, trav_xl = trav_xl->next_sibling) {
+    calls[i].child = trav_xl;
+    calls[i].fn = fn;
+    calls[i].args = args;
+  }
+  fanout_run (priv->fanout, calls, priv->childnode_cnt);
+  return calls;
+}
+
+/* what the children answered, as when they were called in turn: the last
+   one that succeeded, otherwise the error of the last one */
+static int
+cement_result (struct fanout_call *calls, int count)
+{
+  int i;
 
+  for (i = count - 1; i >= 0; i--)
+    if (calls[i].ret >= 0)
+      return calls[i].ret;
+  errno = calls[count - 1].op_errno;
+  return -1;
+}
 
+/* the child that last answered for path, NULL when unknown */
+static struct xlator *
+cement_hint (struct xlator *xl, const char *path)
+{
+  struct cement_private *priv = xl->private;
+  return priv->hints ? loc_hint_lookup (priv->hints, path) : NULL;
+}
 
+static void
+cement_hint_set (struct xlator *xl, const char *path, struct xlator *child)
+{
+  struct cement_private *priv = xl->private;
+  if (priv->hints)
+    loc_hint_insert (priv->hints, path, child);
+}
+
+static void
+cement_hint_drop (struct xlator *xl, const char *path)
+{
+  struct cement_private *priv = xl->private;
+  if (priv->hints)
+    loc_hint_invalidate (priv->hints, path);
+}
+
+static int
+fanout_mkdir (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->mkdir (call->child, args->path, args->mode, args->uid, args->gid);
+}
+
+static int
+fanout_unlink (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->unlink (call->child, args->path);
+}
+
+static int
+fanout_rename (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->rename (call->child, args->path, args->newpath, args->uid, args->gid);
+}
+
+static int
+fanout_rmdir (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->rmdir (call->child, args->path);
+}
+
+static int
+fanout_getattr (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->getattr (call->child, args->path, &call->out.stbuf);
+}
+
+static int
+fanout_statfs (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  return call->child->fops->statfs (call->child, args->path, &call->out.statvfs);
+}
+
+static int
+fanout_readdir (struct fanout_call *call)
+{
+  struct cement_args *args = call->args;
+  call->out.names = call->child->fops->readdir (call->child, args->path, args->offset);
+  return call->out.names ? 0 : -1;
+}
 
 static int
 cement_mkdir (struct xlator *xl,
@@ -25,16 +142,11 @@ cement_mkdir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  int flag = -1;
-  struct xlator *trav_xl = xl->first_child;
+  struct cement_args args = { .path = path, .mode = mode, .uid = uid, .gid = gid };
+  struct fanout_call *calls = cement_fanout (xl, fanout_mkdir, &args);
 
-  while (trav_xl) {
-    ret = trav_xl->fops->mkdir (trav_xl, path, mode, uid, gid);
-    trav_xl = trav_xl->next_sibling;
-    if (ret >= 0)
-      flag = ret;
-  }
-  ret = flag;
+  ret = cement_result (calls, priv->childnode_cnt);
+  free (calls);
 
   return ret;
 
@@ -55,16 +167,12 @@ cement_unlink (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  int flag = -1;
-  struct xlator *trav_xl = xl->first_child;
+  struct cement_args args = { .path = path };
+  struct fanout_call *calls = cement_fanout (xl, fanout_unlink, &args);
 
-  while (trav_xl) {
-    ret = trav_xl->fops->unlink (trav_xl, path);
-    trav_xl = trav_xl->next_sibling;
-    if (ret >= 0)
-      flag = ret;
-  }
-  ret = flag;
+  ret = cement_result (calls, priv->childnode_cnt);
+  free (calls);
+  cement_hint_drop (xl, path);
 
   return ret;
 
@@ -83,19 +191,127 @@ cement_rmdir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  int flag = -1;
+  struct cement_args args = { .path = path };
+  struct fanout_call *calls = cement_fanout (xl, fanout_rmdir, &args);
+
+  ret = cement_result (calls, priv->childnode_cnt);
+  free (calls);
+  cement_hint_drop (xl, path);
+
+  return ret;
+
+}
+
+
+/* a file is on one child and a directory on all of them, each renames
+   what it has */
+static int
+cement_rename (struct xlator *xl,
+	       const char *oldpath,
+	       const char *newpath,
+	       uid_t uid,
+	       gid_t gid)
+{
+  int ret = 0;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct cement_args args = { .path = oldpath, .newpath = newpath, .uid = uid, .gid = gid };
+  struct fanout_call *calls = cement_fanout (xl, fanout_rename, &args);
+  int i;
+
+  ret = cement_result (calls, priv->childnode_cnt);
+  if (ret >= 0) {
+    /* a file at newpath on a child without oldpath is what the rename
+       replaced, it must not come back from there */
+    for (i = 0; i < priv->childnode_cnt; i++) {
+      struct xlator *child = calls[i].child;
+      struct stat stbuf;
+
+      if (calls[i].ret >= 0 || calls[i].op_errno != ENOENT)
+	continue;
+      if (child->fops->getattr (child, newpath, &stbuf) == 0 &&
+	  !S_ISDIR (stbuf.st_mode))
+	child->fops->unlink (child, newpath);
+    }
+  }
+  free (calls);
+  /* hints below a renamed directory fail with ENOENT and go then */
+  cement_hint_drop (xl, oldpath);
+  cement_hint_drop (xl, newpath);
+
+  return ret;
+}
+
+static int
+cement_readlink (struct xlator *xl,
+		 const char *path,
+		 char *dest,
+		 size_t size)
+{
+  int ret = -1;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct xlator *hint_xl = cement_hint (xl, path);
   struct xlator *trav_xl = xl->first_child;
 
+  if (hint_xl) {
+    ret = hint_xl->fops->readlink (hint_xl, path, dest, size);
+    if (ret >= 0)
+      return ret;
+    cement_hint_drop (xl, path);
+  }
+
   while (trav_xl) {
-    ret = trav_xl->fops->rmdir (trav_xl, path);
+    if (trav_xl != hint_xl) {
+      ret = trav_xl->fops->readlink (trav_xl, path, dest, size);
+      if (ret >= 0) {
+	cement_hint_set (xl, path, trav_xl);
+	break;
+      }
+    }
     trav_xl = trav_xl->next_sibling;
-    if (ret >= 0)
-      flag = ret;
   }
-  ret = flag;
 
   return ret;
+}
 
+static int
+cement_access (struct xlator *xl,
+	       const char *path,
+	       mode_t mode)
+{
+  int ret = -1;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct xlator *hint_xl = cement_hint (xl, path);
+  struct xlator *trav_xl = xl->first_child;
+
+  /* EACCES is an answer, only ENOENT sends us elsewhere */
+  if (hint_xl) {
+    ret = hint_xl->fops->access (hint_xl, path, mode);
+    if (ret >= 0 || errno != ENOENT)
+      return ret;
+    cement_hint_drop (xl, path);
+  }
+
+  while (trav_xl) {
+    if (trav_xl != hint_xl) {
+      ret = trav_xl->fops->access (trav_xl, path, mode);
+      if (ret >= 0 || errno != ENOENT) {
+	cement_hint_set (xl, path, trav_xl);
+	break;
+      }
+    }
+    trav_xl = trav_xl->next_sibling;
+  }
+
+  return ret;
 }
 
 
@@ -126,14 +342,36 @@ cement_open (struct xlator *xl,
   struct xlator *trav_xl = xl->first_child;
   if (create_flag) {
     struct sched_ops *sched = ((struct cement_private *)xl->private)->sched_ops;
-    struct xlator *sched_xl = sched->schedule (xl, 0);
+    int sched_size = (priv->size_hint > INT_MAX) ? INT_MAX : priv->size_hint;
+    struct xlator *sched_xl = sched->schedule (xl, sched_size);
     flag = sched_xl->fops->open (sched_xl, path, flags, mode, ctx);
+
+    /* let the brick reserve the space before the data comes */
+    if (flag >= 0 && priv->size_hint) {
+      char hint[32];
+      int len = sprintf (hint, "%lld", priv->size_hint);
+
+      sched_xl->fops->setxattr (sched_xl, path, GF_XATTR_SIZE_HINT, hint, len, 0);
+    }
+    if (flag >= 0)
+      cement_hint_set (xl, path, sched_xl);
   } else {
-    while (trav_xl) {
-      ret = trav_xl->fops->open (trav_xl, path, flags, mode, ctx);
+    struct xlator *hint_xl = cement_hint (xl, path);
+
+    if (hint_xl) {
+      flag = hint_xl->fops->open (hint_xl, path, flags, mode, ctx);
+      if (flag < 0)
+	cement_hint_drop (xl, path);
+    }
+    while (flag < 0 && trav_xl) {
+      if (trav_xl != hint_xl) {
+	ret = trav_xl->fops->open (trav_xl, path, flags, mode, ctx);
+	if (ret >= 0) {
+	  flag = ret;
+	  cement_hint_set (xl, path, trav_xl);
+	}
+      }
       trav_xl = trav_xl->next_sibling;
-      if (ret >= 0)
-	flag = ret;
     }
   }
   ret = flag;
@@ -157,12 +395,22 @@ cement_read (struct xlator *xl,
   struct file_context *tmp;
   FILL_MY_CTX (tmp, ctx, xl);
 
+  /* the child that opened the file, when known */
+  struct xlator *hint_xl = cement_hint (xl, path);
+  if (hint_xl) {
+    ret = hint_xl->fops->read (hint_xl, path, buf, size, offset, ctx);
+    if (ret >= 0)
+      return ret;
+  }
+
   struct xlator *trav_xl = xl->first_child;
   while (trav_xl) {
-    ret = trav_xl->fops->read (trav_xl, path, buf, size, offset, ctx);
+    if (trav_xl != hint_xl) {
+      ret = trav_xl->fops->read (trav_xl, path, buf, size, offset, ctx);
+      if (ret > 0)
+	break;
+    }
     trav_xl = trav_xl->next_sibling;
-    if (ret > 0)
-      break;
   }
 
   return ret;
@@ -184,12 +432,21 @@ cement_write (struct xlator *xl,
   struct file_context *tmp;
   FILL_MY_CTX (tmp, ctx, xl);
   
+  struct xlator *hint_xl = cement_hint (xl, path);
+  if (hint_xl) {
+    ret = hint_xl->fops->write (hint_xl, path, buf, size, offset, ctx);
+    if (ret >= 0)
+      return ret;
+  }
+
   struct xlator *trav_xl = xl->first_child;
   while (trav_xl) {
-    ret = trav_xl->fops->write (trav_xl, path, buf, size, offset, ctx);
+    if (trav_xl != hint_xl) {
+      ret = trav_xl->fops->write (trav_xl, path, buf, size, offset, ctx);
+      if (ret >= 0)
+	break;
+    }
     trav_xl = trav_xl->next_sibling;
-    if (ret >= 0)
-      break;
   }
 
   return ret;
@@ -201,13 +458,13 @@ cement_statfs (struct xlator *xl,
 	       struct statvfs *stbuf)
 {
   int ret = 0;
-  struct statvfs buf = {0,};
   struct cement_private *priv = xl->private;
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  int flag = -1;
-  struct xlator *trav_xl = xl->first_child;
+  struct cement_args args = { .path = path };
+  struct fanout_call *calls = cement_fanout (xl, fanout_statfs, &args);
+  int i;
   /* Initialize structure variable */
   stbuf->f_bsize = 0;
   stbuf->f_frsize = 0;
@@ -221,11 +478,10 @@ cement_statfs (struct xlator *xl,
   stbuf->f_flag = 0;
   stbuf->f_namemax = 0;
   
-  while (trav_xl) {
-    ret = trav_xl->fops->statfs (trav_xl, path, &buf);
-    trav_xl = trav_xl->next_sibling;
-    if (ret >= 0) {
-      flag = ret;
+  for (i = 0; i < priv->childnode_cnt; i++) {
+    struct statvfs buf = calls[i].out.statvfs;
+
+    if (calls[i].ret >= 0) {
       stbuf->f_bsize = buf.f_bsize;
       stbuf->f_frsize = buf.f_frsize;
       stbuf->f_blocks += buf.f_blocks;
@@ -239,7 +495,8 @@ cement_statfs (struct xlator *xl,
       stbuf->f_namemax = buf.f_namemax;
     }
   }
-  ret = flag;
+  ret = cement_result (calls, priv->childnode_cnt);
+  free (calls);
 
   return ret;
 }
@@ -347,17 +604,20 @@ cement_readdir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  struct xlator *trav_xl = xl->first_child;
-  
-  while (trav_xl) {
-    ret = trav_xl->fops->readdir (trav_xl, path, offset);
-    trav_xl = trav_xl->next_sibling;
+  struct cement_args args = { .path = path, .offset = offset };
+  struct fanout_call *calls = cement_fanout (xl, fanout_readdir, &args);
+  int i;
+
+  /* in the order of the children, as before */
+  for (i = 0; i < priv->childnode_cnt; i++) {
+    ret = calls[i].out.names;
     if (ret != NULL) {
       buffer = update_buffer (buffer, ret);
       free (ret); 
       ret = NULL;
     }
   }
+  free (calls);
 
 
   return buffer;
@@ -421,6 +681,130 @@ static int
 cement_getattr (struct xlator *xl,
 		const char *path,
 		struct stat *stbuf)
+{
+  int ret = 0;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct xlator *hint_xl = cement_hint (xl, path);
+  struct cement_args args = { .path = path };
+  struct fanout_call *calls;
+  int i;
+
+  /* one child is asked once we know where the file is */
+  if (hint_xl) {
+    ret = hint_xl->fops->getattr (hint_xl, path, stbuf);
+    if (ret >= 0)
+      return ret;
+    cement_hint_drop (xl, path);
+  }
+
+  calls = cement_fanout (xl, fanout_getattr, &args);
+  /* the attributes from the last child that has the file */
+  for (i = priv->childnode_cnt - 1; i >= 0; i--) {
+    if (calls[i].ret >= 0) {
+      *stbuf = calls[i].out.stbuf;
+      cement_hint_set (xl, path, calls[i].child);
+      break;
+    }
+  }
+  ret = cement_result (calls, priv->childnode_cnt);
+  free (calls);
+
+  return ret;
+}
+
+static int
+cement_bulk_getattr (struct xlator *xl,
+		     const char *path,
+		     off_t offset,
+		     struct bulk_stat *bstbuf,
+		     off_t *next)
+{
+  return 0;
+}
+
+/* pages of different children can not share one cookie, use readdir */
+static int
+cement_getdents (struct xlator *xl,
+		 const char *path,
+		 off_t offset,
+		 char *buf,
+		 size_t size,
+		 off_t *next)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+/* only a child holding both files can copy, otherwise EXDEV tells the
+   caller to move the bytes itself */
+static int
+cement_copy (struct xlator *xl,
+	     const char *from,
+	     off_t from_offset,
+	     const char *to,
+	     off_t to_offset,
+	     size_t size)
+{
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct xlator *trav_xl = xl->first_child;
+  struct stat stbuf;
+
+  while (trav_xl) {
+    if (trav_xl->fops->getattr (trav_xl, from, &stbuf) >= 0 &&
+	S_ISREG (stbuf.st_mode)) {
+      if (trav_xl->fops->getattr (trav_xl, to, &stbuf) >= 0)
+	return trav_xl->fops->copy (trav_xl, from, from_offset,
+				    to, to_offset, size);
+      break;
+    }
+    trav_xl = trav_xl->next_sibling;
+  }
+
+  errno = trav_xl ? EXDEV : ENOENT;
+  return -1;
+}
+
+static int
+cement_seek (struct xlator *xl,
+	     const char *path,
+	     off_t offset,
+	     int whence,
+	     off_t *result,
+	     struct file_context *ctx)
+{
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct xlator *trav_xl = xl->first_child;
+  int op_errno = EBADF;
+
+  /* only the child that opened the file has a context for it */
+  while (trav_xl) {
+    if (trav_xl->fops->seek (trav_xl, path, offset, whence, result, ctx) == 0)
+      return 0;
+    if (errno == ENXIO)
+      op_errno = ENXIO;
+    trav_xl = trav_xl->next_sibling;
+  }
+
+  errno = op_errno;
+  return -1;
+}
+
+static int
+cement_fallocate (struct xlator *xl,
+		  const char *path,
+		  int keep_size,
+		  off_t offset,
+		  size_t len,
+		  struct file_context *ctx)
 {
   int ret = 0;
   struct cement_private *priv = xl->private;
@@ -429,9 +813,33 @@ cement_getattr (struct xlator *xl,
   }
   int flag = -1;
   struct xlator *trav_xl = xl->first_child;
+  while (trav_xl) {
+    ret = trav_xl->fops->fallocate (trav_xl, path, keep_size, offset, len, ctx);
+    trav_xl = trav_xl->next_sibling;
+    if (ret >= 0)
+      flag = ret;
+  }
+  ret = flag;
 
+  return ret;
+}
+
+static int
+cement_discard (struct xlator *xl,
+		const char *path,
+		off_t offset,
+		size_t len,
+		struct file_context *ctx)
+{
+  int ret = 0;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  int flag = -1;
+  struct xlator *trav_xl = xl->first_child;
   while (trav_xl) {
-    ret = trav_xl->fops->getattr (trav_xl, path, stbuf);
+    ret = trav_xl->fops->discard (trav_xl, path, offset, len, ctx);
     trav_xl = trav_xl->next_sibling;
     if (ret >= 0)
       flag = ret;
@@ -442,11 +850,28 @@ cement_getattr (struct xlator *xl,
 }
 
 static int
-cement_bulk_getattr (struct xlator *xl,
-		     const char *path,
-		     struct stat *bstbuf)
+cement_zerofill (struct xlator *xl,
+		 const char *path,
+		 off_t offset,
+		 size_t len,
+		 struct file_context *ctx)
 {
-  return 0;
+  int ret = 0;
+  struct cement_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  int flag = -1;
+  struct xlator *trav_xl = xl->first_child;
+  while (trav_xl) {
+    ret = trav_xl->fops->zerofill (trav_xl, path, offset, len, ctx);
+    trav_xl = trav_xl->next_sibling;
+    if (ret >= 0)
+      flag = ret;
+  }
+  ret = flag;
+
+  return ret;
 }
 
 static int
@@ -468,6 +893,45 @@ init (struct xlator *xl)
   }
   _private->sched_ops = get_scheduler (scheduler->data);
 
+  {
+    data_t *size_hint = dict_get (xl->options, "size-hint");
+
+    if (size_hint && str2size (size_hint->data, &_private->size_hint) != 0) {
+      gf_log ("unify", LOG_CRITICAL, "unify.c->init: invalid size-hint \"%s\"\n", size_hint->data);
+      _private->size_hint = 0;
+    }
+  }
+
+  {
+    struct xlator *trav_xl = xl->first_child;
+
+    while (trav_xl) {
+      _private->childnode_cnt++;
+      trav_xl = trav_xl->next_sibling;
+    }
+  }
+
+  /* namespace operations go to all the children at once */
+  {
+    data_t *fanout_threads = dict_get (xl->options, "fanout-threads");
+    int nr_threads = _private->childnode_cnt;
+
+    if (fanout_threads)
+      nr_threads = data_to_int (fanout_threads);
+    if (nr_threads > FANOUT_MAX_THREADS)
+      nr_threads = FANOUT_MAX_THREADS;
+    if (nr_threads > 0 && _private->childnode_cnt > 1)
+      _private->fanout = fanout_pool_new (nr_threads);
+  }
+
+  {
+    data_t *loc_hints = dict_get (xl->options, "loc-hint-entries");
+    int nr_entries = loc_hints ? data_to_int (loc_hints) : LOC_HINT_ENTRIES;
+
+    if (nr_entries > 0 && _private->childnode_cnt > 1)
+      _private->hints = loc_hint_table_new (nr_entries);
+  }
+
   _private->is_debug = 0;
   if (debug && strcasecmp (debug->data, "on") == 0) {
     _private->is_debug = 1;
@@ -485,6 +949,10 @@ fini (struct xlator *xl)
 {
   struct cement_private *priv = xl->private;
   priv->sched_ops->fini (xl);
+  if (priv->fanout)
+    fanout_pool_destroy (priv->fanout);
+  if (priv->hints)
+    loc_hint_table_destroy (priv->hints);
   free (priv);
   return;
 }
@@ -495,6 +963,9 @@ struct xlator_fops fops = {
   .mkdir       = cement_mkdir,
   .unlink      = cement_unlink,
   .rmdir       = cement_rmdir,
+  .rename      = cement_rename,
+  .readlink    = cement_readlink,
+  .access      = cement_access,
   .open        = cement_open,
   .read        = cement_read,
   .write       = cement_write,
@@ -504,7 +975,13 @@ struct xlator_fops fops = {
   .readdir     = cement_readdir,
   .ftruncate   = cement_ftruncate,
   .fgetattr    = cement_fgetattr,
-  .bulk_getattr = cement_bulk_getattr
+  .bulk_getattr = cement_bulk_getattr,
+  .getdents    = cement_getdents,
+  .copy        = cement_copy,
+  .seek        = cement_seek,
+  .fallocate   = cement_fallocate,
+  .discard     = cement_discard,
+  .zerofill    = cement_zerofill
 };
 
 struct xlator_mgmt_ops mgmt_ops = {
@@ -2,14 +2,21 @@
 #define _UNIFY_H
 
 #include "scheduler.h"
+#include "fanout.h"
+#include "loc_hint.h"
 
 #define MAX_DIR_ENTRY_STRING     (32 * 1024)
+#define FANOUT_MAX_THREADS       64
+#define LOC_HINT_ENTRIES         16384
 
 struct cement_private {
   /* Update this structure depending on requirement */
   void *scheduler; /* THIS SHOULD BE THE FIRST VARIABLE */
   struct sched_ops *sched_ops;
   int childnode_cnt;
+  long long size_hint; /* expected size of new files, 0 for none */
+  struct fanout_pool *fanout; /* NULL to call the children one by one */
+  loc_hint_table *hints; /* the child that answered for a path, NULL for none */
   unsigned char is_debug;
 };
 
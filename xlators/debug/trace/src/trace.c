@@ -648,18 +648,20 @@ trace_fgetattr (struct xlator *this,
 static int
 trace_bulk_getattr (struct xlator *this,
 		      const char *path,
-		      struct bulk_stat *bstbuf)
+		      off_t offset,
+		      struct bulk_stat *bstbuf,
+		      off_t *next)
 {
   int rv;
   
-  if (!this || !path || !bstbuf)
+  if (!this || !path || !bstbuf || !next)
     return -1;
   
-  gf_log ("trace", LOG_DEBUG, "trace_bulk_getattr (*this=%p, path=%s, *bstbuf=%p)",
-	  this, path, bstbuf);
-  rv = this->first_child->fops->bulk_getattr (this->first_child, path, bstbuf);
-  gf_log ("trace", LOG_DEBUG, "trace_bulk_getattr (*this=%p, path=%s, *bstbuf=%p {*stbuf=%p, pathname=%s, *next=%p}) => ret=%d, errno=%d",
-	  this, path, bstbuf, bstbuf->stbuf, bstbuf->pathname, bstbuf->next, rv, errno);
+  gf_log ("trace", LOG_DEBUG, "trace_bulk_getattr (*this=%p, path=%s, offset=%lld, *bstbuf=%p)",
+	  this, path, (long long)offset, bstbuf);
+  rv = this->first_child->fops->bulk_getattr (this->first_child, path, offset, bstbuf, next);
+  gf_log ("trace", LOG_DEBUG, "trace_bulk_getattr (*this=%p, path=%s, offset=%lld, *bstbuf=%p {*stbuf=%p, pathname=%s, *next=%p}, next=%lld) => ret=%d, errno=%d",
+	  this, path, (long long)offset, bstbuf, bstbuf->stbuf, bstbuf->pathname, bstbuf->next, (long long)*next, rv, errno);
   return rv;
 }
 
@@ -776,7 +778,7 @@ trace_stats (struct xlator *this, struct xlator_stats *stats)
   {
     int ret;
     ret = (this->first_child->mgmt_ops->stats (this->first_child, stats));
-    gf_log ("trace", LOG_DEBUG, "trace_stats (*this=%p, *stats=%p {nr_files=%ld, free_disk=%lld, disk_usage=%lld, disk_speed=%lu, nr_clients=%ld, write_usage=%llu, read_usage=%llu}) => ret=%d, errno=%d", this, stats, stats->nr_files, stats->free_disk, stats->disk_usage, stats->disk_speed, stats->nr_clients, stats->write_usage, stats->read_usage, ret, errno);
+    gf_log ("trace", LOG_DEBUG, "trace_stats (*this=%p, *stats=%p {nr_files=%ld, free_disk=%lld, disk_usage=%lld, disk_speed=%lu, nr_clients=%ld, write_usage=%llu, read_usage=%llu, read_iops=%lu, write_iops=%lu, latency_p50=%lu, latency_p90=%lu, latency_p99=%lu}) => ret=%d, errno=%d", this, stats, stats->nr_files, stats->free_disk, stats->disk_usage, stats->disk_speed, stats->nr_clients, stats->write_usage, stats->read_usage, stats->read_iops, stats->write_iops, stats->latency_p50, stats->latency_p90, stats->latency_p99, ret, errno);
     return ret;
   }
 }
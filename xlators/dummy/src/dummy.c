@@ -473,13 +473,15 @@ dummy_fgetattr (struct xlator *this,
 static int
 dummy_bulk_getattr (struct xlator *this,
 		      const char *path,
-		      struct bulk_stat *bstbuf)
+		      off_t offset,
+		      struct bulk_stat *bstbuf,
+		      off_t *next)
 {
   if (!this || !path || !bstbuf)
     return -1;
 
   if (this->first_child)
-    return this->first_child->fops->bulk_getattr (this->first_child, path, bstbuf);
+    return this->first_child->fops->bulk_getattr (this->first_child, path, offset, bstbuf, next);
   
   return 0;
 }
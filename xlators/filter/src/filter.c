@@ -464,7 +464,9 @@ filter_fgetattr (struct xlator *xl,
 static int
 filter_bulk_getattr (struct xlator *xl,
 		     const char *path,
-		     struct stat *bstatbuf)
+		     off_t offset,
+		     struct bulk_stat *bstbuf,
+		     off_t *next)
 {
   return 0;
 }
@@ -772,9 +772,15 @@ getattr_readdir (struct xlator *xl,
     prev = head;
 
     while (trav_xl) {
-      ret_bg = trav_xl->fops->bulk_getattr (trav_xl, path, bstbuf);
+      off_t offset = 0;
+      off_t next = 0;
+
+      while ((ret_bg = trav_xl->fops->bulk_getattr (trav_xl, path, offset,
+						    bstbuf, &next)) > 0)
+	offset = next;
       trav_xl = trav_xl->next_sibling;
-      if (ret_bg >= 0)
+      /* a child that failed half way still gave us its first pages */
+      if (ret_bg >= 0 || bstbuf->next)
 	break;
     }
 
@@ -937,7 +943,9 @@ getattr_fgetattr (struct xlator *xl,
 static int
 getattr_bulk_getattr (struct xlator *xl,
 		      const char *path,
-		      struct bulk_stat *bstbuf)
+		      off_t offset,
+		      struct bulk_stat *bstbuf,
+		      off_t *next)
 {
   return 0;
 }
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "attr-cache.h"
+#include "hashfn.h"
+#include "logging.h"
+
+#define ATTR_WATCH_BUCKETS 1024
+#define ATTR_WATCH_MASK (IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | \
+			 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | \
+			 IN_MOVE_SELF)
+
+/* path without trailing slashes, "/" stays as it is */
+static int
+key_of (const char *path, char *key)
+{
+  int len = strlen (path);
+
+  if (len >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  while (len > 1 && path[len - 1] == '/')
+    len--;
+  memcpy (key, path, len);
+  key[len] = '\0';
+  return len;
+}
+
+/* the directory holding key, as clients see it */
+static void
+parent_of (const char *key, char *parent)
+{
+  const char *slash = strrchr (key, '/');
+  int len = slash ? slash - key : 0;
+
+  if (!len) {
+    strcpy (parent, "/");
+    return;
+  }
+  memcpy (parent, key, len);
+  parent[len] = '\0';
+}
+
+static void
+lru_unlink (struct attr_cache *cache, struct attr_cache_entry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->lru_first = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->lru_last = entry->prev;
+}
+
+static void
+lru_push (struct attr_cache *cache, struct attr_cache_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->lru_first;
+  if (cache->lru_first)
+    cache->lru_first->prev = entry;
+  else
+    cache->lru_last = entry;
+  cache->lru_first = entry;
+}
+
+static struct attr_cache_entry *
+cache_lookup (struct attr_cache *cache, const char *key, unsigned int hash)
+{
+  struct attr_cache_entry *entry = cache->table[hash % cache->table_size];
+
+  while (entry && (entry->hash != hash || strcmp (entry->path, key) != 0))
+    entry = entry->hash_next;
+  return entry;
+}
+
+static void
+cache_remove (struct attr_cache *cache, struct attr_cache_entry *entry)
+{
+  struct attr_cache_entry **trav = &cache->table[entry->hash % cache->table_size];
+
+  while (*trav != entry)
+    trav = &(*trav)->hash_next;
+  *trav = entry->hash_next;
+  lru_unlink (cache, entry);
+  cache->count--;
+
+  free (entry->link);
+  free (entry->path);
+  free (entry);
+}
+
+/* with the lock held: drop key, and make a stat of it in flight stale */
+static void
+invalidate_locked (struct attr_cache *cache, const char *key)
+{
+  unsigned int hash = SuperFastHash (key, strlen (key));
+  struct attr_cache_entry *entry = cache_lookup (cache, key, hash);
+
+  cache->gens[hash % cache->table_size]++;
+  if (entry)
+    cache_remove (cache, entry);
+}
+
+static void
+invalidate_tree_locked (struct attr_cache *cache, const char *key)
+{
+  struct attr_cache_entry *trav = cache->lru_first;
+  int len = strlen (key);
+
+  if (len == 1)
+    len = 0; /* everything is below "/" */
+  cache->gen++;
+  while (trav) {
+    struct attr_cache_entry *next = trav->next;
+
+    if (strncmp (trav->path, key, len) == 0 &&
+	(trav->path[len] == '\0' || trav->path[len] == '/'))
+      cache_remove (cache, trav);
+    trav = next;
+  }
+}
+
+static struct attr_watch *
+watch_lookup (struct attr_cache *cache, int wd)
+{
+  struct attr_watch *watch = cache->watches[wd % ATTR_WATCH_BUCKETS];
+
+  while (watch && watch->wd != wd)
+    watch = watch->next;
+  return watch;
+}
+
+static void
+watch_forget (struct attr_cache *cache, int wd)
+{
+  struct attr_watch **trav = &cache->watches[wd % ATTR_WATCH_BUCKETS];
+
+  while (*trav && (*trav)->wd != wd)
+    trav = &(*trav)->next;
+  if (*trav) {
+    struct attr_watch *watch = *trav;
+
+    *trav = watch->next;
+    free (watch->path);
+    free (watch);
+    cache->nr_watches--;
+  }
+}
+
+/* everything goes, the watches too; with the lock held */
+static void
+flush_locked (struct attr_cache *cache)
+{
+  int i;
+
+  invalidate_tree_locked (cache, "/");
+  for (i = 0; i < ATTR_WATCH_BUCKETS; i++) {
+    while (cache->watches[i]) {
+      inotify_rm_watch (cache->notify_fd, cache->watches[i]->wd);
+      watch_forget (cache, cache->watches[i]->wd);
+    }
+  }
+}
+
+/* watch dirfd, or name in it, for changes to what key is about */
+static int
+watch_add (struct attr_cache *cache,
+	   int dirfd,
+	   const char *name,
+	   const char *key)
+{
+  struct attr_watch *watch;
+  char proc[PATH_MAX];
+  int wd;
+
+  if (name)
+    snprintf (proc, sizeof (proc), "/proc/self/fd/%d/%s", dirfd, name);
+  else
+    snprintf (proc, sizeof (proc), "/proc/self/fd/%d", dirfd);
+  wd = inotify_add_watch (cache->notify_fd, proc,
+			  ATTR_WATCH_MASK | IN_ONLYDIR | (name ? IN_DONT_FOLLOW : 0));
+  if (wd == -1)
+    return -1;
+
+  pthread_mutex_lock (&cache->lock);
+  watch = watch_lookup (cache, wd);
+  if (watch && strcmp (watch->path, key) != 0) {
+    /* the directory was renamed since it was watched */
+    free (watch->path);
+    watch->path = strdup (key);
+  } else if (!watch) {
+    /* as many directories watched as entries cached at most */
+    if (cache->nr_watches >= cache->max)
+      flush_locked (cache);
+    watch = calloc (1, sizeof (*watch));
+    watch->wd = wd;
+    watch->path = strdup (key);
+    watch->next = cache->watches[wd % ATTR_WATCH_BUCKETS];
+    cache->watches[wd % ATTR_WATCH_BUCKETS] = watch;
+    cache->nr_watches++;
+  }
+  pthread_mutex_unlock (&cache->lock);
+  return 0;
+}
+
+static void
+notify_event (struct attr_cache *cache, struct inotify_event *event)
+{
+  struct attr_watch *watch;
+
+  if (event->mask & IN_Q_OVERFLOW) {
+    /* events were lost, so is everything cached */
+    invalidate_tree_locked (cache, "/");
+    return;
+  }
+
+  watch = watch_lookup (cache, event->wd);
+  if (!watch) {
+    /* a watch still being set up, stats taken meanwhile are stale */
+    cache->gen++;
+    return;
+  }
+
+  if (event->len) {
+    char key[PATH_MAX];
+
+    if (strcmp (watch->path, "/") == 0)
+      snprintf (key, sizeof (key), "/%s", event->name);
+    else
+      snprintf (key, sizeof (key), "%s/%s", watch->path, event->name);
+    if (event->mask & IN_ISDIR)
+      invalidate_tree_locked (cache, key);
+    else
+      invalidate_locked (cache, key);
+    /* an entry came or went, the directory changed too */
+    if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+      invalidate_locked (cache, watch->path);
+  } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+    invalidate_tree_locked (cache, watch->path);
+  } else if (!(event->mask & IN_IGNORED)) {
+    invalidate_locked (cache, watch->path);
+  }
+
+  if (event->mask & IN_IGNORED)
+    watch_forget (cache, event->wd);
+}
+
+static void *
+attr_notify (void *arg)
+{
+  struct attr_cache *cache = arg;
+  char buf[16 * 1024] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  struct pollfd fds[2];
+
+  fds[0].fd = cache->notify_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = cache->stop_pipe[0];
+  fds[1].events = POLLIN;
+
+  while (1) {
+    ssize_t len;
+    char *ptr;
+
+    if (poll (fds, 2, -1) == -1 && errno != EINTR)
+      break;
+    if (fds[1].revents)
+      break;
+    if (!(fds[0].revents & POLLIN))
+      continue;
+
+    len = read (cache->notify_fd, buf, sizeof (buf));
+    if (len <= 0)
+      continue;
+
+    pthread_mutex_lock (&cache->lock);
+    for (ptr = buf; ptr < buf + len; ) {
+      struct inotify_event *event = (struct inotify_event *)ptr;
+
+      notify_event (cache, event);
+      ptr += sizeof (struct inotify_event) + event->len;
+    }
+    pthread_mutex_unlock (&cache->lock);
+  }
+  return NULL;
+}
+
+struct attr_cache *
+attr_cache_new (int max, int timeout)
+{
+  struct attr_cache *cache = calloc (1, sizeof (*cache));
+
+  cache->max = max;
+  cache->timeout = (timeout > 0) ? timeout : 0;
+  cache->table_size = max;
+  cache->table = calloc (cache->table_size, sizeof (*cache->table));
+  cache->gens = calloc (cache->table_size, sizeof (*cache->gens));
+  cache->watches = calloc (ATTR_WATCH_BUCKETS, sizeof (*cache->watches));
+  pthread_mutex_init (&cache->lock, NULL);
+  cache->stop_pipe[0] = cache->stop_pipe[1] = -1;
+
+  cache->notify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (cache->notify_fd != -1 && pipe (cache->stop_pipe) == 0 &&
+      pthread_create (&cache->thread, NULL, attr_notify, cache) == 0)
+    return cache;
+
+  gf_log ("posix", LOG_NORMAL, "attr-cache.c->attr_cache_new: no inotify (%s), changes made around posix %s\n",
+	  strerror (errno), cache->timeout ? "show after the timeout" : "are not seen, not caching");
+  if (cache->notify_fd != -1)
+    close (cache->notify_fd);
+  cache->notify_fd = -1;
+  if (!cache->timeout) {
+    attr_cache_destroy (cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void
+attr_cache_destroy (struct attr_cache *cache)
+{
+  int i;
+
+  if (cache->notify_fd != -1) {
+    if (write (cache->stop_pipe[1], "", 1) == 1)
+      pthread_join (cache->thread, NULL);
+    close (cache->notify_fd);
+  }
+  if (cache->stop_pipe[0] != -1) {
+    close (cache->stop_pipe[0]);
+    close (cache->stop_pipe[1]);
+  }
+
+  while (cache->lru_first)
+    cache_remove (cache, cache->lru_first);
+  for (i = 0; i < ATTR_WATCH_BUCKETS; i++)
+    while (cache->watches[i])
+      watch_forget (cache, cache->watches[i]->wd);
+
+  pthread_mutex_destroy (&cache->lock);
+  free (cache->watches);
+  free (cache->gens);
+  free (cache->table);
+  free (cache);
+}
+
+/* with the lock held, the live entry of key */
+static struct attr_cache_entry *
+cache_find (struct attr_cache *cache, const char *key)
+{
+  struct attr_cache_entry *entry;
+
+  entry = cache_lookup (cache, key, SuperFastHash (key, strlen (key)));
+  if (entry && entry->expires && entry->expires <= time (NULL)) {
+    cache_remove (cache, entry);
+    return NULL;
+  }
+  if (entry) {
+    lru_unlink (cache, entry);
+    lru_push (cache, entry);
+  }
+  return entry;
+}
+
+int
+attr_cache_get (struct attr_cache *cache,
+		const char *path,
+		struct stat *stbuf)
+{
+  struct attr_cache_entry *entry;
+  char key[PATH_MAX];
+  int ret = ATTR_CACHE_MISS;
+
+  if (key_of (path, key) == -1)
+    return ATTR_CACHE_MISS;
+
+  pthread_mutex_lock (&cache->lock);
+  entry = cache_find (cache, key);
+  if (entry && !entry->stbuf.st_mode) {
+    ret = ATTR_CACHE_NOENT;
+  } else if (entry) {
+    *stbuf = entry->stbuf;
+    ret = ATTR_CACHE_HIT;
+  }
+  pthread_mutex_unlock (&cache->lock);
+
+  if (ret == ATTR_CACHE_NOENT)
+    errno = ENOENT;
+  return ret;
+}
+
+/* with the lock held; the count to compare against before caching key */
+static unsigned int
+gen_locked (struct attr_cache *cache, const char *key)
+{
+  unsigned int hash = SuperFastHash (key, strlen (key));
+
+  return cache->gen + cache->gens[hash % cache->table_size];
+}
+
+unsigned int
+attr_cache_gen (struct attr_cache *cache, const char *path)
+{
+  char key[PATH_MAX];
+  unsigned int gen;
+
+  if (key_of (path, key) == -1)
+    return 0;
+  pthread_mutex_lock (&cache->lock);
+  gen = gen_locked (cache, key);
+  pthread_mutex_unlock (&cache->lock);
+  return gen;
+}
+
+/*
+  fstatat () of name in dirfd, which is path, cached. The directory is
+  watched before the stat is taken, and a directory found is watched and
+  stat'ed again, so no change can fall between the stat and its watch.
+*/
+int
+attr_cache_stat (struct attr_cache *cache,
+		 const char *path,
+		 int dirfd,
+		 const char *name,
+		 struct stat *stbuf)
+{
+  struct attr_cache_entry *entry;
+  char key[PATH_MAX];
+  char parent[PATH_MAX];
+  unsigned int gen, hash;
+  int watched = 1;
+  int ret;
+
+  if (key_of (path, key) == -1)
+    return fstatat (dirfd, name, stbuf, AT_SYMLINK_NOFOLLOW);
+  parent_of (key, parent);
+
+  gen = attr_cache_gen (cache, key);
+  if (cache->notify_fd != -1 && strcmp (key, "/") != 0)
+    watched = (watch_add (cache, dirfd, NULL, parent) == 0);
+  ret = fstatat (dirfd, name, stbuf, AT_SYMLINK_NOFOLLOW);
+  if (ret == 0 && S_ISDIR (stbuf->st_mode) && cache->notify_fd != -1) {
+    if (watch_add (cache, dirfd, name, key) == 0)
+      ret = fstatat (dirfd, name, stbuf, AT_SYMLINK_NOFOLLOW);
+    else
+      watched = 0;
+  }
+  if (!watched && !cache->timeout)
+    return ret;
+  if (ret == -1 && errno != ENOENT)
+    return ret;
+
+  hash = SuperFastHash (key, strlen (key));
+  pthread_mutex_lock (&cache->lock);
+  if (gen_locked (cache, key) != gen) {
+    pthread_mutex_unlock (&cache->lock);
+    if (ret == -1)
+      errno = ENOENT;
+    return ret;
+  }
+
+  entry = cache_lookup (cache, key, hash);
+  if (entry) {
+    lru_unlink (cache, entry);
+    free (entry->link);
+    entry->link = NULL;
+  } else {
+    entry = calloc (1, sizeof (*entry));
+    entry->hash = hash;
+    entry->path = strdup (key);
+    entry->hash_next = cache->table[hash % cache->table_size];
+    cache->table[hash % cache->table_size] = entry;
+    cache->count++;
+  }
+  if (ret == 0)
+    entry->stbuf = *stbuf;
+  else
+    memset (&entry->stbuf, 0, sizeof (entry->stbuf));
+  entry->expires = cache->timeout ? time (NULL) + cache->timeout : 0;
+  lru_push (cache, entry);
+  if (cache->count > cache->max)
+    cache_remove (cache, cache->lru_last);
+  pthread_mutex_unlock (&cache->lock);
+
+  if (ret == -1)
+    errno = ENOENT;
+  return ret;
+}
+
+/* the cached target of symlink path, -1 if there is none */
+int
+attr_cache_readlink (struct attr_cache *cache,
+		     const char *path,
+		     char *buf,
+		     size_t size)
+{
+  struct attr_cache_entry *entry;
+  char key[PATH_MAX];
+  int ret = -1;
+
+  if (key_of (path, key) == -1)
+    return -1;
+
+  pthread_mutex_lock (&cache->lock);
+  entry = cache_find (cache, key);
+  if (entry && entry->link) {
+    ret = (entry->link_len < (int)size) ? entry->link_len : (int)size;
+    memcpy (buf, entry->link, ret);
+  }
+  pthread_mutex_unlock (&cache->lock);
+  return ret;
+}
+
+/* the target of a symlink whose attributes are cached already */
+void
+attr_cache_put_link (struct attr_cache *cache,
+		     const char *path,
+		     unsigned int gen,
+		     const char *link,
+		     int len)
+{
+  struct attr_cache_entry *entry;
+  char key[PATH_MAX];
+
+  if (len < 0 || key_of (path, key) == -1)
+    return;
+
+  pthread_mutex_lock (&cache->lock);
+  entry = cache_find (cache, key);
+  if (entry && S_ISLNK (entry->stbuf.st_mode) && !entry->link &&
+      gen_locked (cache, key) == gen) {
+    entry->link = malloc (len);
+    memcpy (entry->link, link, len);
+    entry->link_len = len;
+  }
+  pthread_mutex_unlock (&cache->lock);
+}
+
+/* path changed, and with parent set the directory holding it as well */
+void
+attr_cache_invalidate (struct attr_cache *cache,
+		       const char *path,
+		       int parent)
+{
+  char key[PATH_MAX];
+  char dir[PATH_MAX];
+
+  if (key_of (path, key) == -1)
+    return;
+
+  pthread_mutex_lock (&cache->lock);
+  invalidate_locked (cache, key);
+  if (parent) {
+    parent_of (key, dir);
+    invalidate_locked (cache, dir);
+  }
+  pthread_mutex_unlock (&cache->lock);
+}
+
+/* path and everything below it */
+void
+attr_cache_invalidate_tree (struct attr_cache *cache,
+			    const char *path)
+{
+  char key[PATH_MAX];
+
+  if (key_of (path, key) == -1)
+    return;
+
+  pthread_mutex_lock (&cache->lock);
+  invalidate_tree_locked (cache, key);
+  pthread_mutex_unlock (&cache->lock);
+}
@@ -0,0 +1,79 @@
+#ifndef _ATTR_CACHE_H
+#define _ATTR_CACHE_H
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/*
+  Bounded cache of the attributes of paths under the export, symlink
+  targets and paths found missing included, keyed by the path clients
+  see. posix drops an entry itself whenever one of its fops changes the
+  path. Changes made around posix are caught by inotify watches on the
+  directories holding cached entries, and on cached directories
+  themselves, read by a thread of the cache. Each bucket counts its
+  invalidations; a stat is only cached if the count of its bucket did
+  not move while it was taken, so one racing with a change is not.
+*/
+
+/* what attr_cache_get () found */
+#define ATTR_CACHE_MISS  0
+#define ATTR_CACHE_HIT   1
+#define ATTR_CACHE_NOENT 2
+
+struct attr_cache_entry {
+  struct attr_cache_entry *hash_next;
+  struct attr_cache_entry *prev;   /* lru, most recently used first */
+  struct attr_cache_entry *next;
+  unsigned int hash;
+  char *path;
+  struct stat stbuf;               /* st_mode 0 for a missing path */
+  char *link;                      /* symlink target, NULL until read */
+  int link_len;
+  time_t expires;                  /* 0 for never */
+};
+
+/* the directory an inotify watch reports on, as clients see it */
+struct attr_watch {
+  struct attr_watch *next;
+  int wd;
+  char *path;
+};
+
+struct attr_cache {
+  pthread_mutex_t lock;
+  struct attr_cache_entry **table;
+  unsigned int *gens;              /* invalidations per bucket */
+  unsigned int gen;                /* flushes of the whole cache */
+  int table_size;
+  struct attr_cache_entry *lru_first;
+  struct attr_cache_entry *lru_last;
+  int count;
+  int max;
+  int timeout;                     /* seconds, 0 to rely on invalidations */
+
+  int notify_fd;                   /* inotify, -1 without */
+  struct attr_watch **watches;     /* hashed on wd */
+  int nr_watches;
+  int stop_pipe[2];
+  pthread_t thread;
+};
+
+struct attr_cache *attr_cache_new (int max, int timeout);
+void attr_cache_destroy (struct attr_cache *cache);
+
+int attr_cache_get (struct attr_cache *cache, const char *path,
+		    struct stat *stbuf);
+int attr_cache_stat (struct attr_cache *cache, const char *path,
+		     int dirfd, const char *name, struct stat *stbuf);
+int attr_cache_readlink (struct attr_cache *cache, const char *path,
+			 char *buf, size_t size);
+unsigned int attr_cache_gen (struct attr_cache *cache, const char *path);
+void attr_cache_put_link (struct attr_cache *cache, const char *path,
+			  unsigned int gen, const char *link, int len);
+
+void attr_cache_invalidate (struct attr_cache *cache, const char *path,
+			    int parent);
+void attr_cache_invalidate_tree (struct attr_cache *cache, const char *path);
+
+#endif /* _ATTR_CACHE_H */
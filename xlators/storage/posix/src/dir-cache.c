@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "dir-cache.h"
+#include "hashfn.h"
+
+#ifndef O_PATH
+#define O_PATH O_RDONLY
+#endif
+
+struct dir_cache *
+dir_cache_new (int root_fd, int max, int fanout)
+{
+  struct dir_cache *cache = calloc (1, sizeof (*cache));
+
+  cache->root_fd = root_fd;
+  cache->max = (max > 0) ? max : 0;
+  cache->fanout = (fanout > 0) ? fanout : 0;
+  cache->table_size = cache->max ? cache->max : 1;
+  cache->table = calloc (cache->table_size, sizeof (struct dir_cache_entry *));
+  pthread_mutex_init (&cache->lock, NULL);
+
+  return cache;
+}
+
+void
+dir_cache_hide (struct dir_cache *cache, const char *name)
+{
+  if (cache->nr_hidden < DIR_CACHE_HIDDEN)
+    cache->hidden[cache->nr_hidden++] = name;
+}
+
+/* whether the first component of path is a hidden name */
+int
+dir_cache_hidden (struct dir_cache *cache, const char *path)
+{
+  const char *end;
+  int i;
+
+  while (*path == '/')
+    path++;
+  end = strchr (path, '/');
+  if (!end)
+    end = path + strlen (path);
+
+  for (i = 0; i < cache->nr_hidden; i++) {
+    if (strncmp (cache->hidden[i], path, end - path) == 0 &&
+	cache->hidden[i][end - path] == '\0')
+      return 1;
+  }
+  return 0;
+}
+
+static void
+entry_free (struct dir_cache_entry *entry)
+{
+  close (entry->fd);
+  free (entry->path);
+  free (entry);
+}
+
+static void
+shard_name (struct dir_cache *cache, const char *name, int len, char *buf)
+{
+  unsigned int hash = SuperFastHash (name, len);
+
+  sprintf (buf, ".%02x/%02x", hash % cache->fanout,
+	   (hash / cache->fanout) % cache->fanout);
+}
+
+/* the shard name of an entry is stored under */
+void
+dir_cache_shard (struct dir_cache *cache, const char *name, char *buf)
+{
+  shard_name (cache, name, strlen (name), buf);
+}
+
+/* the shards of a directory one after the other, nth from 0 on */
+void
+dir_cache_shard_nth (struct dir_cache *cache, int nth, char *buf)
+{
+  sprintf (buf, ".%02x/%02x", nth / cache->fanout, nth % cache->fanout);
+}
+
+/* the first len bytes of path as stored, relative to the export root */
+static int
+stored_path (struct dir_cache *cache,
+	     const char *path,
+	     int len,
+	     char *buf,
+	     int size)
+{
+  const char *end = path + len;
+  int used = 0;
+
+  while (path < end) {
+    const char *comp;
+    int clen;
+
+    while (path < end && *path == '/')
+      path++;
+    comp = path;
+    while (path < end && *path != '/')
+      path++;
+    clen = path - comp;
+    if (!clen || (clen == 1 && comp[0] == '.'))
+      continue;
+
+    if (used + DIR_CACHE_SHARD_LEN + clen + 3 > size) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    if (used)
+      buf[used++] = '/';
+    shard_name (cache, comp, clen, buf + used);
+    used += DIR_CACHE_SHARD_LEN;
+    buf[used++] = '/';
+    memcpy (buf + used, comp, clen);
+    used += clen;
+  }
+  buf[used] = '\0';
+  return used;
+}
+
+/* path as stored under the export, with its leading '/' */
+int
+dir_cache_backend (struct dir_cache *cache,
+		   const char *path,
+		   char *buf,
+		   int size)
+{
+  if (dir_cache_hidden (cache, path)) {
+    errno = ENOENT;
+    return -1;
+  }
+  if (!cache->fanout) {
+    if (strlen (path) >= size) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy (buf, path);
+    return 0;
+  }
+
+  buf[0] = '/';
+  return (stored_path (cache, path, strlen (path), buf + 1, size - 1) < 0) ? -1 : 0;
+}
+
+static int
+entry_bucket (struct dir_cache *cache, const char *path, int len)
+{
+  return SuperFastHash (path, len) % cache->table_size;
+}
+
+static struct dir_cache_entry *
+cache_lookup (struct dir_cache *cache, const char *path, int len)
+{
+  struct dir_cache_entry *entry = cache->table[entry_bucket (cache, path, len)];
+
+  while (entry) {
+    if (strncmp (entry->path, path, len) == 0 && entry->path[len] == '\0')
+      return entry;
+    entry = entry->hash_next;
+  }
+
+  return NULL;
+}
+
+static void
+lru_unlink (struct dir_cache *cache, struct dir_cache_entry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->lru_first = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->lru_last = entry->prev;
+
+  entry->prev = entry->next = NULL;
+}
+
+static void
+lru_push (struct dir_cache *cache, struct dir_cache_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->lru_first;
+  if (cache->lru_first)
+    cache->lru_first->prev = entry;
+  else
+    cache->lru_last = entry;
+  cache->lru_first = entry;
+}
+
+static void
+cache_insert (struct dir_cache *cache, struct dir_cache_entry *entry)
+{
+  int bucket = entry_bucket (cache, entry->path, strlen (entry->path));
+
+  entry->hash_next = cache->table[bucket];
+  cache->table[bucket] = entry;
+  entry->cached = 1;
+  lru_push (cache, entry);
+  cache->count++;
+}
+
+/* take entry out of the table, the caller frees it if unused */
+static void
+cache_remove (struct dir_cache *cache, struct dir_cache_entry *entry)
+{
+  struct dir_cache_entry **trav;
+
+  trav = &cache->table[entry_bucket (cache, entry->path, strlen (entry->path))];
+  while (*trav != entry)
+    trav = &(*trav)->hash_next;
+  *trav = entry->hash_next;
+
+  lru_unlink (cache, entry);
+  entry->cached = 0;
+  cache->count--;
+}
+
+static void
+cache_shrink (struct dir_cache *cache)
+{
+  struct dir_cache_entry *trav = cache->lru_last;
+
+  while (trav && cache->count > cache->max) {
+    struct dir_cache_entry *prev = trav->prev;
+
+    if (!trav->refs) {
+      cache_remove (cache, trav);
+      entry_free (trav);
+    }
+    trav = prev;
+  }
+}
+
+/*
+  Returns the fd of the directory containing path, and in *name the last
+  component to pass to the *at () call. The export root and paths
+  directly under it use the root fd. Release *entry with dir_cache_put ().
+  A missing shard is made only with create, for a fop about to make the
+  entry; for any other one the entry is not there, ENOENT.
+*/
+int
+dir_cache_get (struct dir_cache *cache,
+	       const char *path,
+	       int create,
+	       const char **name,
+	       struct dir_cache_entry **entryp)
+{
+  const char *slash = strrchr (path, '/');
+  const char *parent = path;
+  struct dir_cache_entry *entry;
+  char stored[PATH_MAX];
+  int sharded = 0;
+  int len;
+  int fd;
+
+  *entryp = NULL;
+  if (dir_cache_hidden (cache, path)) {
+    errno = ENOENT;
+    return -1;
+  }
+  if (!slash) {
+    *name = path[0] ? path : ".";
+    if (!cache->fanout || !path[0])
+      return cache->root_fd;
+    len = 0;
+  } else {
+    *name = slash[1] ? slash + 1 : ".";
+
+    while (parent < slash && *parent == '/')
+      parent++;
+    len = slash - parent;
+  }
+
+  if (cache->fanout) {
+    /* the parent as stored, and in it the shard of name */
+    len = stored_path (cache, parent, len, stored, sizeof (stored));
+    if (len == -1)
+      return -1;
+    if (strcmp (*name, ".") != 0) {
+      if (len + DIR_CACHE_SHARD_LEN + 2 > sizeof (stored)) {
+	errno = ENAMETOOLONG;
+	return -1;
+      }
+      if (len)
+	stored[len++] = '/';
+      shard_name (cache, *name, strlen (*name), stored + len);
+      len += DIR_CACHE_SHARD_LEN;
+      sharded = 1;
+    }
+    parent = stored;
+  }
+  if (!len)
+    return cache->root_fd;
+
+  pthread_mutex_lock (&cache->lock);
+  entry = cache_lookup (cache, parent, len);
+  if (entry) {
+    entry->refs++;
+    lru_unlink (cache, entry);
+    lru_push (cache, entry);
+    pthread_mutex_unlock (&cache->lock);
+    *entryp = entry;
+    return entry->fd;
+  }
+  pthread_mutex_unlock (&cache->lock);
+
+  entry = calloc (1, sizeof (*entry));
+  entry->path = strndup (parent, len);
+  entry->refs = 1;
+
+  fd = openat (cache->root_fd, entry->path, O_PATH | O_DIRECTORY);
+  if (fd == -1 && errno == ENOENT && sharded && create) {
+    /* the first entry of this shard */
+    entry->path[len - 3] = '\0';
+    mkdirat (cache->root_fd, entry->path, 0755);
+    entry->path[len - 3] = '/';
+    mkdirat (cache->root_fd, entry->path, 0755);
+    fd = openat (cache->root_fd, entry->path, O_PATH | O_DIRECTORY);
+  }
+  if (fd == -1) {
+    free (entry->path);
+    free (entry);
+    return -1;
+  }
+  entry->fd = fd;
+  *entryp = entry;
+
+  if (!cache->max)
+    return fd;
+
+  pthread_mutex_lock (&cache->lock);
+  if (cache_lookup (cache, parent, len)) {
+    /* raced with another thread, use ours once and drop it */
+    pthread_mutex_unlock (&cache->lock);
+    return fd;
+  }
+  cache_insert (cache, entry);
+  cache_shrink (cache);
+  pthread_mutex_unlock (&cache->lock);
+
+  return fd;
+}
+
+void
+dir_cache_put (struct dir_cache *cache,
+	       struct dir_cache_entry *entry)
+{
+  int saved_errno = errno;
+  int unused;
+
+  if (!entry)
+    return;
+
+  pthread_mutex_lock (&cache->lock);
+  unused = (--entry->refs == 0 && !entry->cached);
+  pthread_mutex_unlock (&cache->lock);
+
+  if (unused)
+    entry_free (entry);
+  errno = saved_errno;
+}
+
+/*
+  path was removed or renamed, drop it and everything below it. Needed
+  for every directory rename or removal done through this xlator;
+  changes made to the export behind glusterfs' back are not seen.
+*/
+void
+dir_cache_invalidate (struct dir_cache *cache,
+		      const char *path)
+{
+  struct dir_cache_entry *trav;
+  char stored[PATH_MAX];
+  int len;
+
+  while (*path == '/')
+    path++;
+  len = strlen (path);
+  if (cache->fanout) {
+    len = stored_path (cache, path, len, stored, sizeof (stored));
+    if (len == -1)
+      return;
+    path = stored;
+  }
+
+  pthread_mutex_lock (&cache->lock);
+  trav = cache->lru_first;
+  while (trav) {
+    struct dir_cache_entry *next = trav->next;
+
+    if (!len ||
+	(strncmp (trav->path, path, len) == 0 &&
+	 (trav->path[len] == '\0' || trav->path[len] == '/'))) {
+      cache_remove (cache, trav);
+      if (!trav->refs)
+	entry_free (trav);
+    }
+    trav = next;
+  }
+  pthread_mutex_unlock (&cache->lock);
+}
+
+void
+dir_cache_destroy (struct dir_cache *cache)
+{
+  struct dir_cache_entry *trav = cache->lru_first;
+
+  while (trav) {
+    struct dir_cache_entry *next = trav->next;
+    entry_free (trav);
+    trav = next;
+  }
+
+  pthread_mutex_destroy (&cache->lock);
+  free (cache->table);
+  free (cache);
+}
@@ -0,0 +1,68 @@
+#ifndef _DIR_CACHE_H
+#define _DIR_CACHE_H
+
+#include <pthread.h>
+
+/*
+  Bounded cache of O_PATH fds of the directories under the export, keyed
+  by path relative to the export root. posix resolves a path to its
+  parent's fd and the last component, so the kernel walks one component
+  per fop instead of the whole absolute path. Entries are ref counted
+  while in use; one invalidated or evicted meanwhile is closed by its
+  last dir_cache_put ().
+
+  With a fanout, every entry of a directory is stored two levels further
+  down, under a shard named after the hash of its name, ".xx/yy/name".
+  A directory then never holds more than fanout shards, and each shard
+  a fanout squared part of the entries. Paths given to and returned by
+  the cache are the ones clients see; shards are made by the first fop
+  creating an entry in them.
+*/
+
+#define DIR_CACHE_SHARD_LEN 6  /* ".xx/yy" */
+#define DIR_CACHE_HIDDEN    4  /* most names kept from clients */
+
+struct dir_cache_entry {
+  struct dir_cache_entry *hash_next;
+  struct dir_cache_entry *prev;  /* lru, most recently used first */
+  struct dir_cache_entry *next;
+  char *path;
+  int fd;
+  int refs;
+  char cached;                   /* still reachable from the table */
+};
+
+struct dir_cache {
+  int root_fd;                   /* owned by the caller */
+  struct dir_cache_entry **table;
+  int table_size;
+  struct dir_cache_entry *lru_first;
+  struct dir_cache_entry *lru_last;
+  int count;
+  int max;                       /* 0 disables caching */
+  int fanout;                    /* shards per level, 0 for the flat layout */
+  const char *hidden[DIR_CACHE_HIDDEN]; /* entries of the root only posix uses */
+  int nr_hidden;
+  pthread_mutex_t lock;
+};
+
+struct dir_cache *dir_cache_new (int root_fd, int max, int fanout);
+void dir_cache_destroy (struct dir_cache *cache);
+
+int dir_cache_get (struct dir_cache *cache, const char *path, int create,
+		   const char **name, struct dir_cache_entry **entry);
+void dir_cache_put (struct dir_cache *cache, struct dir_cache_entry *entry);
+
+void dir_cache_invalidate (struct dir_cache *cache, const char *path);
+
+/* paths under name, an entry of the root, fail with ENOENT; name is not
+   copied */
+void dir_cache_hide (struct dir_cache *cache, const char *name);
+int dir_cache_hidden (struct dir_cache *cache, const char *path);
+
+void dir_cache_shard (struct dir_cache *cache, const char *name, char *buf);
+void dir_cache_shard_nth (struct dir_cache *cache, int nth, char *buf);
+int dir_cache_backend (struct dir_cache *cache, const char *path,
+		       char *buf, int size);
+
+#endif /* _DIR_CACHE_H */
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "direct-io.h"
+
+struct direct_buf {
+  struct direct_buf *next;
+};
+
+static __thread struct direct_buf *pool = NULL;
+static __thread int pool_count = 0;
+
+static void *
+direct_buf_get (void)
+{
+  void *buf = NULL;
+
+  if (pool) {
+    buf = pool;
+    pool = pool->next;
+    pool_count--;
+    return buf;
+  }
+
+  if (posix_memalign (&buf, DIRECT_ALIGN, DIRECT_BUF_SIZE) != 0)
+    return NULL;
+  return buf;
+}
+
+static void
+direct_buf_put (void *buf)
+{
+  struct direct_buf *dbuf = buf;
+
+  if (pool_count < DIRECT_POOL_MAX) {
+    dbuf->next = pool;
+    pool = dbuf;
+    pool_count++;
+    return;
+  }
+
+  free (buf);
+}
+
+#define IS_ALIGNED(x) (((uintptr_t)(x) & (DIRECT_ALIGN - 1)) == 0)
+
+/* a second fd on the same file with O_DIRECT, -1 if it can not have one */
+int
+direct_reopen (int fd)
+{
+  char proc_path[64];
+  int flags = fcntl (fd, F_GETFL);
+
+  if (flags == -1)
+    return -1;
+
+  sprintf (proc_path, "/proc/self/fd/%d", fd);
+  return open (proc_path, (flags & O_ACCMODE) | O_DIRECT);
+}
+
+/* split [offset, offset + size) at the alignment boundaries */
+static void
+direct_split (off_t offset,
+	      size_t size,
+	      size_t *head,
+	      size_t *middle)
+{
+  off_t start = (offset + DIRECT_ALIGN - 1) & ~((off_t)DIRECT_ALIGN - 1);
+  off_t end = (offset + size) & ~((off_t)DIRECT_ALIGN - 1);
+
+  if (end <= start) {
+    *head = size;
+    *middle = 0;
+    return;
+  }
+  *head = start - offset;
+  *middle = end - start;
+}
+
+static ssize_t
+direct_read_middle (int direct_fd, char *buf, size_t size, off_t offset)
+{
+  size_t done = 0;
+  char *bounce;
+
+  if (IS_ALIGNED (buf))
+    return pread (direct_fd, buf, size, offset);
+
+  bounce = direct_buf_get ();
+  if (!bounce)
+    return -1;
+
+  while (done < size) {
+    size_t chunk = size - done;
+    ssize_t ret;
+
+    if (chunk > DIRECT_BUF_SIZE)
+      chunk = DIRECT_BUF_SIZE;
+    ret = pread (direct_fd, bounce, chunk, offset + done);
+    if (ret <= 0) {
+      direct_buf_put (bounce);
+      return done ? (ssize_t)done : ret;
+    }
+    memcpy (buf + done, bounce, ret);
+    done += ret;
+    if (ret < (ssize_t)chunk)
+      break;
+  }
+
+  direct_buf_put (bounce);
+  return done;
+}
+
+static ssize_t
+direct_write_middle (int direct_fd, const char *buf, size_t size, off_t offset)
+{
+  size_t done = 0;
+  char *bounce;
+
+  if (IS_ALIGNED (buf))
+    return pwrite (direct_fd, buf, size, offset);
+
+  bounce = direct_buf_get ();
+  if (!bounce)
+    return -1;
+
+  while (done < size) {
+    size_t chunk = size - done;
+    ssize_t ret;
+
+    if (chunk > DIRECT_BUF_SIZE)
+      chunk = DIRECT_BUF_SIZE;
+    memcpy (bounce, buf + done, chunk);
+    ret = pwrite (direct_fd, bounce, chunk, offset + done);
+    if (ret <= 0) {
+      direct_buf_put (bounce);
+      return done ? (ssize_t)done : ret;
+    }
+    done += ret;
+    if (ret < (ssize_t)chunk)
+      break;
+  }
+
+  direct_buf_put (bounce);
+  return done;
+}
+
+ssize_t
+direct_pread (int fd,
+	      int direct_fd,
+	      char *buf,
+	      size_t size,
+	      off_t offset)
+{
+  size_t head, middle;
+  ssize_t ret;
+
+  direct_split (offset, size, &head, &middle);
+  if (!middle)
+    return pread (fd, buf, size, offset);
+
+  if (head) {
+    ret = pread (fd, buf, head, offset);
+    if (ret < (ssize_t)head)
+      return ret;
+  }
+
+  ret = direct_read_middle (direct_fd, buf + head, middle, offset + head);
+  if (ret < 0)
+    return head ? head : ret;
+  if (ret < (ssize_t)middle)
+    return head + ret;  /* end of file */
+
+  if (head + middle < size) {
+    ret = pread (fd, buf + head + middle, size - head - middle,
+		 offset + head + middle);
+    if (ret < 0)
+      ret = 0;
+    return head + middle + ret;
+  }
+  return size;
+}
+
+ssize_t
+direct_pwrite (int fd,
+	       int direct_fd,
+	       const char *buf,
+	       size_t size,
+	       off_t offset)
+{
+  size_t head, middle;
+  ssize_t ret;
+
+  direct_split (offset, size, &head, &middle);
+  if (!middle)
+    return pwrite (fd, buf, size, offset);
+
+  if (head) {
+    ret = pwrite (fd, buf, head, offset);
+    if (ret < (ssize_t)head)
+      return ret;
+  }
+
+  ret = direct_write_middle (direct_fd, buf + head, middle, offset + head);
+  if (ret < 0)
+    return head ? head : ret;
+  if (ret < (ssize_t)middle)
+    return head + ret;
+
+  if (head + middle < size) {
+    ret = pwrite (fd, buf + head + middle, size - head - middle,
+		  offset + head + middle);
+    if (ret < 0)
+      ret = 0;
+    return head + middle + ret;
+  }
+  return size;
+}
@@ -0,0 +1,24 @@
+#ifndef _DIRECT_IO_H
+#define _DIRECT_IO_H
+
+#include <sys/types.h>
+
+/*
+  O_DIRECT side of posix. The aligned middle of a request goes through
+  the O_DIRECT fd, the unaligned head and tail through the buffered one.
+  A middle whose memory is not aligned either is bounced through a
+  buffer from a small per-thread pool of aligned buffers.
+*/
+
+#define DIRECT_ALIGN     4096
+#define DIRECT_BUF_SIZE  (1024 * 1024)
+#define DIRECT_POOL_MAX  4  /* idle buffers kept per thread */
+
+ssize_t direct_pread (int fd, int direct_fd, char *buf, size_t size,
+		      off_t offset);
+ssize_t direct_pwrite (int fd, int direct_fd, const char *buf, size_t size,
+		       off_t offset);
+
+int direct_reopen (int fd);
+
+#endif /* _DIRECT_IO_H */
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "disk-queue.h"
+
+static void
+disk_call_run (struct disk_call *call)
+{
+  errno = 0;
+  call->ret = call->fn (call->disk, call);
+  call->op_errno = errno;
+}
+
+static void *
+disk_worker (void *arg)
+{
+  struct disk_queue *queue = arg;
+
+  pthread_mutex_lock (&queue->lock);
+  while (1) {
+    struct disk_call *call;
+    struct disk_wait *wait;
+
+    while (!queue->head && !queue->stopping)
+      pthread_cond_wait (&queue->work, &queue->lock);
+    if (queue->stopping)
+      break;
+
+    call = queue->head;
+    queue->head = call->next;
+    if (!queue->head)
+      queue->tail = NULL;
+    pthread_mutex_unlock (&queue->lock);
+
+    disk_call_run (call);
+
+    /* the call lives on the stack of its waiter, done with it now */
+    wait = call->wait;
+    pthread_mutex_lock (&wait->lock);
+    if (--wait->pending == 0)
+      pthread_cond_signal (&wait->cond);
+    pthread_mutex_unlock (&wait->lock);
+
+    pthread_mutex_lock (&queue->lock);
+  }
+  pthread_mutex_unlock (&queue->lock);
+
+  return NULL;
+}
+
+struct disk_queue *
+disk_queue_new (int nr_threads)
+{
+  struct disk_queue *queue = calloc (1, sizeof (*queue));
+  int i;
+
+  pthread_mutex_init (&queue->lock, NULL);
+  pthread_cond_init (&queue->work, NULL);
+  queue->threads = calloc (nr_threads, sizeof (pthread_t));
+
+  for (i = 0; i < nr_threads; i++) {
+    if (pthread_create (&queue->threads[i], NULL, disk_worker, queue) != 0)
+      break;
+    queue->nr_threads++;
+  }
+
+  if (!queue->nr_threads) {
+    disk_queue_destroy (queue);
+    return NULL;
+  }
+  return queue;
+}
+
+void
+disk_queue_destroy (struct disk_queue *queue)
+{
+  int i;
+
+  pthread_mutex_lock (&queue->lock);
+  queue->stopping = 1;
+  pthread_cond_broadcast (&queue->work);
+  pthread_mutex_unlock (&queue->lock);
+
+  for (i = 0; i < queue->nr_threads; i++)
+    pthread_join (queue->threads[i], NULL);
+
+  pthread_cond_destroy (&queue->work);
+  pthread_mutex_destroy (&queue->lock);
+  free (queue->threads);
+  free (queue);
+}
+
+void
+disk_queue_run (struct disk_call *calls,
+		int count)
+{
+  struct disk_wait wait;
+  int i;
+
+  if (count <= 0)
+    return;
+  if (count == 1) {
+    disk_call_run (calls);
+    return;
+  }
+
+  pthread_mutex_init (&wait.lock, NULL);
+  pthread_cond_init (&wait.cond, NULL);
+  wait.pending = count - 1;
+
+  for (i = 1; i < count; i++) {
+    struct disk_queue *queue = calls[i].queue;
+
+    calls[i].wait = &wait;
+    calls[i].next = NULL;
+
+    pthread_mutex_lock (&queue->lock);
+    if (queue->tail)
+      queue->tail->next = &calls[i];
+    else
+      queue->head = &calls[i];
+    queue->tail = &calls[i];
+    pthread_cond_signal (&queue->work);
+    pthread_mutex_unlock (&queue->lock);
+  }
+
+  /* the first disk is served by this thread, which would only wait */
+  disk_call_run (calls);
+
+  pthread_mutex_lock (&wait.lock);
+  while (wait.pending)
+    pthread_cond_wait (&wait.cond, &wait.lock);
+  pthread_mutex_unlock (&wait.lock);
+
+  pthread_cond_destroy (&wait.cond);
+  pthread_mutex_destroy (&wait.lock);
+}
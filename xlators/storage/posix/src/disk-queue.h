@@ -0,0 +1,69 @@
+#ifndef _DISK_QUEUE_H
+#define _DISK_QUEUE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "xlator.h"
+
+/*
+  A queue of fop calls in front of one disk of a multi-disk brick,
+  served by threads of its own, so that a call made on several disks runs
+  on all of them at once. disk_queue_run () makes the first call itself
+  and hands the others to the queues of their disks; it returns when all
+  of them are done, with ret and op_errno filled in. A call on one disk
+  only never goes through a queue, queuing it would only add a switch to
+  a worker and back while the caller waits.
+*/
+
+struct disk_call;
+typedef int (*disk_fn_t) (struct xlator *disk, struct disk_call *call);
+
+struct disk_wait {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int pending;
+};
+
+struct disk_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  struct disk_call *head;
+  struct disk_call *tail;
+  pthread_t *threads;
+  int nr_threads;
+  char stopping;
+};
+
+struct disk_call {
+  struct disk_call *next;
+  disk_fn_t fn;
+  struct xlator *disk;
+  struct disk_queue *queue;
+  struct disk_wait *wait;
+  int index;        /* of the disk within the brick */
+  int ret;
+  int op_errno;
+
+  /* arguments, as the fop needs them */
+  const char *path;
+  const char *path2;
+  const char *name;
+  void *buf;
+  size_t size;
+  off_t offset;
+  off_t offset2;
+  off_t *result;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  dev_t dev;
+  int flags;
+  struct file_context *ctx;
+};
+
+struct disk_queue *disk_queue_new (int nr_threads);
+void disk_queue_destroy (struct disk_queue *queue);
+
+void disk_queue_run (struct disk_call *calls, int count);
+
+#endif /* _DISK_QUEUE_H */
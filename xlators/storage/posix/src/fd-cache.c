@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "fd-cache.h"
+#include "hashfn.h"
+
+struct fd_cache *
+fd_cache_new (int max)
+{
+  struct fd_cache *cache = calloc (1, sizeof (*cache));
+
+  cache->max = max;
+  cache->table_size = max;
+  cache->table = calloc (cache->table_size, sizeof (*cache->table));
+  cache->gens = calloc (cache->table_size, sizeof (*cache->gens));
+  pthread_mutex_init (&cache->lock, NULL);
+
+  return cache;
+}
+
+static void
+lru_unlink (struct fd_cache *cache, struct fd_cache_entry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->lru_first = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->lru_last = entry->prev;
+}
+
+/* unlinks entry and frees it, the fd is the caller's */
+static int
+cache_remove (struct fd_cache *cache, struct fd_cache_entry *entry)
+{
+  struct fd_cache_entry **trav = &cache->table[entry->hash % cache->table_size];
+  int fd = entry->fd;
+
+  while (*trav != entry)
+    trav = &(*trav)->hash_next;
+  *trav = entry->hash_next;
+  lru_unlink (cache, entry);
+  cache->count--;
+
+  free (entry->path);
+  free (entry);
+  return fd;
+}
+
+void
+fd_cache_destroy (struct fd_cache *cache)
+{
+  while (cache->lru_first)
+    close (cache_remove (cache, cache->lru_first));
+
+  pthread_mutex_destroy (&cache->lock);
+  free (cache->gens);
+  free (cache->table);
+  free (cache);
+}
+
+/* what an open with flags leaves on its fd, -1 for an open which
+   does more than open the file as it is */
+int
+fd_cache_flags (int flags)
+{
+  if (flags & (O_TRUNC | O_EXCL | O_DIRECTORY | O_PATH))
+    return -1;
+  return flags & ~(O_CREAT | O_NOCTTY | O_CLOEXEC | O_NOFOLLOW);
+}
+
+unsigned int
+fd_cache_gen (struct fd_cache *cache, const char *path)
+{
+  unsigned int hash = SuperFastHash (path, strlen (path));
+  unsigned int gen;
+
+  pthread_mutex_lock (&cache->lock);
+  gen = cache->gen + cache->gens[hash % cache->table_size];
+  pthread_mutex_unlock (&cache->lock);
+  return gen;
+}
+
+/* a released fd of path opened with flags, or -1 */
+int
+fd_cache_take (struct fd_cache *cache,
+	       const char *path,
+	       int flags)
+{
+  unsigned int hash = SuperFastHash (path, strlen (path));
+  struct fd_cache_entry *entry;
+  int fd = -1;
+
+  flags = fd_cache_flags (flags);
+  if (flags == -1)
+    return -1;
+
+  pthread_mutex_lock (&cache->lock);
+  entry = cache->table[hash % cache->table_size];
+  while (entry && (entry->hash != hash || entry->flags != flags ||
+		   strcmp (entry->path, path) != 0))
+    entry = entry->hash_next;
+  if (entry)
+    fd = cache_remove (cache, entry);
+  pthread_mutex_unlock (&cache->lock);
+
+  return fd;
+}
+
+/*
+  Keeps fd for the next open of path with flags. gen is what
+  fd_cache_gen () gave before the fd was opened; -1 when path changed
+  since, or the fd is not one to keep, the caller closes it then.
+*/
+int
+fd_cache_put (struct fd_cache *cache,
+	      const char *path,
+	      int flags,
+	      int fd,
+	      unsigned int gen)
+{
+  unsigned int hash = SuperFastHash (path, strlen (path));
+  struct fd_cache_entry *entry;
+  int victim = -1;
+
+  flags = fd_cache_flags (flags);
+  if (flags == -1)
+    return -1;
+
+  pthread_mutex_lock (&cache->lock);
+  if (cache->gen + cache->gens[hash % cache->table_size] != gen) {
+    pthread_mutex_unlock (&cache->lock);
+    return -1;
+  }
+
+  entry = calloc (1, sizeof (*entry));
+  entry->hash = hash;
+  entry->path = strdup (path);
+  entry->flags = flags;
+  entry->fd = fd;
+  entry->hash_next = cache->table[hash % cache->table_size];
+  cache->table[hash % cache->table_size] = entry;
+  entry->next = cache->lru_first;
+  if (cache->lru_first)
+    cache->lru_first->prev = entry;
+  else
+    cache->lru_last = entry;
+  cache->lru_first = entry;
+  cache->count++;
+
+  if (cache->count > cache->max)
+    victim = cache_remove (cache, cache->lru_last);
+  pthread_mutex_unlock (&cache->lock);
+
+  if (victim != -1)
+    close (victim);
+  return 0;
+}
+
+/* the fds of path are of a file which is not there any more */
+void
+fd_cache_invalidate (struct fd_cache *cache,
+		     const char *path)
+{
+  unsigned int hash = SuperFastHash (path, strlen (path));
+  struct fd_cache_entry **trav;
+
+  pthread_mutex_lock (&cache->lock);
+  cache->gens[hash % cache->table_size]++;
+  trav = &cache->table[hash % cache->table_size];
+  while (*trav) {
+    struct fd_cache_entry *entry = *trav;
+
+    if (entry->hash == hash && strcmp (entry->path, path) == 0) {
+      close (cache_remove (cache, entry));
+      continue;
+    }
+    trav = &entry->hash_next;
+  }
+  pthread_mutex_unlock (&cache->lock);
+}
+
+/* path and everything below it, for a directory renamed */
+void
+fd_cache_invalidate_tree (struct fd_cache *cache,
+			  const char *path)
+{
+  struct fd_cache_entry *trav;
+  int len = strlen (path);
+
+  while (len > 0 && path[len - 1] == '/')
+    len--;
+
+  pthread_mutex_lock (&cache->lock);
+  cache->gen++;
+  trav = cache->lru_first;
+  while (trav) {
+    struct fd_cache_entry *next = trav->next;
+
+    if (strncmp (trav->path, path, len) == 0 &&
+	(trav->path[len] == '\0' || trav->path[len] == '/'))
+      close (cache_remove (cache, trav));
+    trav = next;
+  }
+  pthread_mutex_unlock (&cache->lock);
+}
@@ -0,0 +1,50 @@
+#ifndef _FD_CACHE_H
+#define _FD_CACHE_H
+
+#include <pthread.h>
+
+/*
+  Bounded cache of released file fds, keyed by the path clients see and
+  the flags the file was opened with. The next open of the path with the
+  same flags gets the fd back instead of opening the file again. posix
+  drops the fds of a path it unlinks, renames or truncates; a release
+  racing with that is told so by the count of invalidations of its
+  bucket, taken before the open, and closes its fd. Files changed around
+  posix are not seen, as with the directory fd cache.
+*/
+
+struct fd_cache_entry {
+  struct fd_cache_entry *hash_next;
+  struct fd_cache_entry *prev;   /* lru, most recently released first */
+  struct fd_cache_entry *next;
+  unsigned int hash;             /* of path, all flags share a bucket */
+  char *path;
+  int flags;
+  int fd;
+};
+
+struct fd_cache {
+  pthread_mutex_t lock;
+  struct fd_cache_entry **table;
+  unsigned int *gens;            /* invalidations per bucket */
+  unsigned int gen;              /* invalidations of whole trees */
+  int table_size;
+  struct fd_cache_entry *lru_first;
+  struct fd_cache_entry *lru_last;
+  int count;
+  int max;
+};
+
+struct fd_cache *fd_cache_new (int max);
+void fd_cache_destroy (struct fd_cache *cache);
+
+int fd_cache_flags (int flags);
+unsigned int fd_cache_gen (struct fd_cache *cache, const char *path);
+int fd_cache_take (struct fd_cache *cache, const char *path, int flags);
+int fd_cache_put (struct fd_cache *cache, const char *path, int flags,
+		  int fd, unsigned int gen);
+
+void fd_cache_invalidate (struct fd_cache *cache, const char *path);
+void fd_cache_invalidate_tree (struct fd_cache *cache, const char *path);
+
+#endif /* _FD_CACHE_H */
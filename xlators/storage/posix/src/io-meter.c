@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "io-meter.h"
+#include "logging.h"
+
+#define CALIBRATE_CHUNK (1024 * 1024)
+#define CALIBRATE_NAME  ".glusterfs-calibrate"
+
+static double
+seconds_between (const struct timeval *from, const struct timeval *to)
+{
+  return (to->tv_sec - from->tv_sec) + (to->tv_usec - from->tv_usec) / 1e6;
+}
+
+/* with the lock held */
+static void
+fold_locked (struct io_meter *meter, const struct timeval *now)
+{
+  double elapsed = seconds_between (&meter->folded, now);
+  double weight;
+  int dir;
+
+  if (elapsed < 1.0)
+    return;
+
+  weight = elapsed / meter->window;
+  if (weight > 1.0)
+    weight = 1.0;
+  for (dir = IO_METER_READ; dir <= IO_METER_WRITE; dir++) {
+    meter->bps[dir] += weight * (meter->bytes[dir] / elapsed - meter->bps[dir]);
+    meter->iops[dir] += weight * (meter->ops[dir] / elapsed - meter->iops[dir]);
+    meter->bytes[dir] = 0;
+    meter->ops[dir] = 0;
+  }
+  meter->folded = *now;
+
+  if (seconds_between (&meter->halved, now) >= meter->window) {
+    for (dir = 0; dir < IO_METER_BUCKETS; dir++)
+      meter->latency[dir] /= 2;
+    meter->halved = *now;
+  }
+}
+
+/* one read or write of bytes, begun at start */
+void
+io_meter_account (struct io_meter *meter,
+		  int dir,
+		  ssize_t bytes,
+		  const struct timeval *start)
+{
+  struct timeval now;
+  long long usecs;
+  int bucket = 0;
+
+  gettimeofday (&now, NULL);
+  usecs = (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_usec - start->tv_usec);
+  while (usecs > 0 && bucket < IO_METER_BUCKETS - 1) {
+    usecs >>= 1;
+    bucket++;
+  }
+
+  pthread_mutex_lock (&meter->lock);
+  fold_locked (meter, &now);
+  if (bytes > 0)
+    meter->bytes[dir] += bytes;
+  meter->ops[dir]++;
+  meter->total_ops++;
+  meter->latency[bucket]++;
+  pthread_mutex_unlock (&meter->lock);
+}
+
+/* microseconds under which percent of the latencies are, bucket 0 is
+   under 1us and bucket n from 2^(n-1) to 2^n */
+static unsigned long
+percentile (const unsigned long *latency, unsigned long total, int percent)
+{
+  double target = (double)total * percent / 100;
+  double seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < IO_METER_BUCKETS; bucket++) {
+    double low = bucket ? (double)(1UL << (bucket - 1)) : 0;
+    double high = (double)(1UL << bucket);
+
+    if (latency[bucket] && seen + latency[bucket] >= target)
+      return low + (high - low) * (target - seen) / latency[bucket];
+    seen += latency[bucket];
+  }
+  return 0;
+}
+
+void
+io_meter_get (struct io_meter *meter,
+	      struct xlator_stats *stats)
+{
+  unsigned long latency[IO_METER_BUCKETS];
+  unsigned long total = 0;
+  struct timeval now;
+  int bucket;
+
+  gettimeofday (&now, NULL);
+  pthread_mutex_lock (&meter->lock);
+  fold_locked (meter, &now);
+  stats->read_usage = meter->bps[IO_METER_READ] / 1024;
+  stats->write_usage = meter->bps[IO_METER_WRITE] / 1024;
+  stats->read_iops = meter->iops[IO_METER_READ];
+  stats->write_iops = meter->iops[IO_METER_WRITE];
+  stats->disk_speed = meter->disk_speed;
+  memcpy (latency, meter->latency, sizeof (latency));
+  pthread_mutex_unlock (&meter->lock);
+
+  for (bucket = 0; bucket < IO_METER_BUCKETS; bucket++)
+    total += latency[bucket];
+  stats->latency_p50 = percentile (latency, total, 50);
+  stats->latency_p90 = percentile (latency, total, 90);
+  stats->latency_p99 = percentile (latency, total, 99);
+}
+
+/* a file nobody else sees, O_DIRECT if the filesystem has it */
+static int
+calibrate_open (struct io_meter *meter, int *direct)
+{
+  int fd;
+
+#ifdef O_TMPFILE
+  *direct = 1;
+  fd = openat (meter->dir_fd, ".", O_TMPFILE | O_RDWR | O_DIRECT, 0600);
+  if (fd == -1 && errno == EINVAL) {
+    *direct = 0;
+    fd = openat (meter->dir_fd, ".", O_TMPFILE | O_RDWR, 0600);
+  }
+  if (fd != -1 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL))
+    return fd;
+#endif
+
+  /* no O_TMPFILE, a name for as long as it takes to open it */
+  *direct = 1;
+  fd = openat (meter->dir_fd, CALIBRATE_NAME, O_CREAT | O_EXCL | O_RDWR | O_DIRECT, 0600);
+  if (fd == -1 && errno == EINVAL) {
+    *direct = 0;
+    fd = openat (meter->dir_fd, CALIBRATE_NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd != -1)
+    unlinkat (meter->dir_fd, CALIBRATE_NAME, 0);
+  return fd;
+}
+
+/* MB/s of writing calibrate_size bytes to the disk and reading them
+   back, 0 if that could not be done */
+static unsigned long
+calibrate (struct io_meter *meter)
+{
+  struct timeval start, written, finished;
+  void *buf = NULL;
+  size_t done;
+  int direct, fd;
+  double elapsed;
+
+  fd = calibrate_open (meter, &direct);
+  if (fd == -1 || posix_memalign (&buf, 4096, CALIBRATE_CHUNK) != 0) {
+    gf_log ("posix", LOG_NORMAL, "io-meter.c->calibrate: %s\n", strerror (errno));
+    if (fd != -1)
+      close (fd);
+    return 0;
+  }
+  memset (buf, 0xa5, CALIBRATE_CHUNK);
+
+  gettimeofday (&start, NULL);
+  for (done = 0; done < meter->calibrate_size; done += CALIBRATE_CHUNK)
+    if (pwrite (fd, buf, CALIBRATE_CHUNK, done) != CALIBRATE_CHUNK)
+      goto fail;
+  if (fdatasync (fd) == -1)
+    goto fail;
+  gettimeofday (&written, NULL);
+
+  /* without O_DIRECT the data would come from memory */
+  if (!direct)
+    posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+  for (done = 0; done < meter->calibrate_size; done += CALIBRATE_CHUNK)
+    if (pread (fd, buf, CALIBRATE_CHUNK, done) != CALIBRATE_CHUNK)
+      goto fail;
+  gettimeofday (&finished, NULL);
+
+  close (fd);
+  free (buf);
+  elapsed = seconds_between (&start, &finished);
+  gf_log ("posix", LOG_DEBUG, "io-meter.c->calibrate: %lu bytes written in %.3fs, read in %.3fs\n",
+	  (unsigned long)done, seconds_between (&start, &written),
+	  seconds_between (&written, &finished));
+  /* both ways, what a mixed load would see */
+  return (elapsed > 0) ? (2.0 * done / (1024 * 1024)) / elapsed : 0;
+
+ fail:
+  gf_log ("posix", LOG_NORMAL, "io-meter.c->calibrate: %s\n", strerror (errno));
+  close (fd);
+  free (buf);
+  return 0;
+}
+
+/* sleeps seconds, returns 1 if told to stop meanwhile */
+static int
+meter_sleep (struct io_meter *meter, int seconds)
+{
+  struct timespec until;
+  int stopping;
+
+  clock_gettime (CLOCK_REALTIME, &until);
+  until.tv_sec += seconds;
+  pthread_mutex_lock (&meter->stop_lock);
+  while (!meter->stopping &&
+	 pthread_cond_timedwait (&meter->stop_cond, &meter->stop_lock,
+				 &until) != ETIMEDOUT)
+    ;
+  stopping = meter->stopping;
+  pthread_mutex_unlock (&meter->stop_lock);
+  return stopping;
+}
+
+static void *
+io_meter_calibrator (void *arg)
+{
+  struct io_meter *meter = arg;
+
+  while (1) {
+    unsigned long speed = calibrate (meter);
+
+    if (speed) {
+      pthread_mutex_lock (&meter->lock);
+      meter->disk_speed = speed;
+      pthread_mutex_unlock (&meter->lock);
+    }
+    if (!meter->calibrate_interval || meter_sleep (meter, meter->calibrate_interval))
+      break;
+
+    /* the benchmark would slow down clients and be slowed down by them */
+    while (1) {
+      unsigned long ops;
+
+      pthread_mutex_lock (&meter->lock);
+      ops = meter->total_ops;
+      pthread_mutex_unlock (&meter->lock);
+      if (meter_sleep (meter, 1))
+	return NULL;
+      pthread_mutex_lock (&meter->lock);
+      ops = meter->total_ops - ops;
+      pthread_mutex_unlock (&meter->lock);
+      if (!ops)
+	break;
+    }
+  }
+  return NULL;
+}
+
+struct io_meter *
+io_meter_new (int window,
+	      int dir_fd,
+	      size_t calibrate_size,
+	      int calibrate_interval)
+{
+  struct io_meter *meter = calloc (1, sizeof (*meter));
+
+  meter->window = (window > 0) ? window : IO_METER_WINDOW;
+  gettimeofday (&meter->folded, NULL);
+  meter->halved = meter->folded;
+  pthread_mutex_init (&meter->lock, NULL);
+
+  meter->dir_fd = dir_fd;
+  /* whole chunks */
+  meter->calibrate_size = (calibrate_size + CALIBRATE_CHUNK - 1) / CALIBRATE_CHUNK * CALIBRATE_CHUNK;
+  meter->calibrate_interval = (calibrate_interval > 0) ? calibrate_interval : 0;
+  pthread_mutex_init (&meter->stop_lock, NULL);
+  pthread_cond_init (&meter->stop_cond, NULL);
+
+  if (meter->calibrate_size &&
+      pthread_create (&meter->thread, NULL, io_meter_calibrator, meter) != 0) {
+    gf_log ("posix", LOG_CRITICAL, "io-meter.c->io_meter_new: could not start the calibration thread: %s\n",
+	    strerror (errno));
+    meter->calibrate_size = 0;
+  }
+  return meter;
+}
+
+void
+io_meter_destroy (struct io_meter *meter)
+{
+  if (meter->calibrate_size) {
+    pthread_mutex_lock (&meter->stop_lock);
+    meter->stopping = 1;
+    pthread_cond_signal (&meter->stop_cond);
+    pthread_mutex_unlock (&meter->stop_lock);
+    pthread_join (meter->thread, NULL);
+  }
+
+  pthread_cond_destroy (&meter->stop_cond);
+  pthread_mutex_destroy (&meter->stop_lock);
+  pthread_mutex_destroy (&meter->lock);
+  free (meter);
+}
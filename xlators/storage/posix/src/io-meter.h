@@ -0,0 +1,55 @@
+#ifndef _IO_METER_H
+#define _IO_METER_H
+
+#include <pthread.h>
+#include <sys/time.h>
+#include "xlator.h"
+
+/*
+  What posix_stats () reports of the traffic of a brick. Bytes and
+  operations are folded at most once a second into averages decaying
+  over 'window' seconds, so a brick gone quiet reads as quiet. Latencies
+  go into a histogram of power of two microseconds which is halved every
+  window. The speed of the disk is measured by writing a file with
+  O_DIRECT and reading it back, when the meter starts and then every
+  'interval' seconds, as soon as a second goes by without traffic.
+*/
+
+#define IO_METER_READ     0
+#define IO_METER_WRITE    1
+#define IO_METER_BUCKETS  32   /* 1us up to over an hour */
+#define IO_METER_WINDOW   10   /* default seconds averaged over */
+#define IO_METER_CALIBRATE_SIZE     (8 * 1024 * 1024)
+#define IO_METER_CALIBRATE_INTERVAL 3600
+
+struct io_meter {
+  pthread_mutex_t lock;
+  int window;
+  struct timeval folded;             /* when the counts went into the averages */
+  struct timeval halved;             /* when the histogram was halved last */
+  unsigned long long bytes[2];       /* since folded, read and write */
+  unsigned long ops[2];
+  double bps[2];                     /* the averages, per second */
+  double iops[2];
+  unsigned long latency[IO_METER_BUCKETS];
+  unsigned long total_ops;           /* for telling an idle disk */
+  unsigned long disk_speed;          /* MB/s, 0 until measured */
+
+  int dir_fd;                        /* where the benchmark file goes */
+  size_t calibrate_size;             /* 0 to measure nothing */
+  int calibrate_interval;            /* 0 for once at the start */
+  pthread_mutex_t stop_lock;
+  pthread_cond_t stop_cond;
+  pthread_t thread;
+  char stopping;
+};
+
+struct io_meter *io_meter_new (int window, int dir_fd, size_t calibrate_size,
+			       int calibrate_interval);
+void io_meter_destroy (struct io_meter *meter);
+
+void io_meter_account (struct io_meter *meter, int dir, ssize_t bytes,
+		       const struct timeval *start);
+void io_meter_get (struct io_meter *meter, struct xlator_stats *stats);
+
+#endif /* _IO_METER_H */
@@ -0,0 +1,1543 @@
+#include "glusterfs.h"
+#include "dict.h"
+#include "logging.h"
+#include "hashfn.h"
+#include "posix.h"
+#include "multi-disk.h"
+
+#define MD(xl) (((struct posix_private *)(xl)->private)->multi_disk)
+
+/* the calls, one per disk, of a fop which is run on every disk */
+#define MD_CALLS(var) struct disk_call var[POSIX_MAX_DISKS]
+
+static int
+md_hash (struct multi_disk *md, const char *path)
+{
+  return SuperFastHash (path, strlen (path)) % md->nr_disks;
+}
+
+static void
+md_prepare (struct multi_disk *md, struct disk_call *call, int disk)
+{
+  call->index = disk;
+  call->disk = md->disks[disk].xl;
+  call->queue = md->disks[disk].queue;
+}
+
+/* a call on one disk, made by this thread */
+static int
+md_call (struct multi_disk *md, int disk, struct disk_call *call)
+{
+  md_prepare (md, call, disk);
+  disk_queue_run (call, 1);
+  errno = call->op_errno;
+  return call->ret;
+}
+
+/* a copy of proto for every disk but skip, returns their number */
+static int
+md_spread (struct multi_disk *md,
+	   struct disk_call *proto,
+	   struct disk_call *calls,
+	   int skip)
+{
+  int i, count = 0;
+
+  for (i = 0; i < md->nr_disks; i++) {
+    if (i == skip)
+      continue;
+    calls[count] = *proto;
+    md_prepare (md, &calls[count], i);
+    count++;
+  }
+  return count;
+}
+
+/* fine if the disks holding the path did it, there may be only one */
+static int
+md_any (struct disk_call *calls, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (calls[i].ret >= 0)
+      return calls[i].ret;
+  }
+  errno = ENOENT;
+  for (i = 0; i < count; i++) {
+    if (calls[i].op_errno != ENOENT) {
+      errno = calls[i].op_errno;
+      break;
+    }
+  }
+  return -1;
+}
+
+/* has to go through on every disk */
+static int
+md_all (struct disk_call *calls, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (calls[i].ret < 0) {
+      errno = calls[i].op_errno;
+      return -1;
+    }
+  }
+  return count ? calls[0].ret : 0;
+}
+
+/* take back a call on the disks where it went through */
+static void
+md_undo (struct disk_call *calls, int count, struct disk_call *undo)
+{
+  int i, nr = 0;
+
+  for (i = 0; i < count; i++) {
+    int index = calls[i].index;
+    struct xlator *disk = calls[i].disk;
+    struct disk_queue *queue = calls[i].queue;
+
+    if (calls[i].ret < 0)
+      continue;
+    calls[nr] = *undo;
+    calls[nr].index = index;
+    calls[nr].disk = disk;
+    calls[nr].queue = queue;
+    nr++;
+  }
+  disk_queue_run (calls, nr);
+}
+
+/* the calls as the fops take them */
+
+static int
+call_getattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->getattr (disk, call->path, call->buf);
+}
+
+static int
+call_readlink (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->readlink (disk, call->path, call->buf, call->size);
+}
+
+static int
+call_mknod (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->mknod (disk, call->path, call->mode, call->dev,
+			    call->uid, call->gid);
+}
+
+static int
+call_mkdir (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->mkdir (disk, call->path, call->mode, call->uid, call->gid);
+}
+
+static int
+call_unlink (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->unlink (disk, call->path);
+}
+
+static int
+call_rmdir (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->rmdir (disk, call->path);
+}
+
+static int
+call_symlink (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->symlink (disk, call->path, call->path2, call->uid, call->gid);
+}
+
+static int
+call_rename (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->rename (disk, call->path, call->path2, call->uid, call->gid);
+}
+
+static int
+call_link (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->link (disk, call->path, call->path2, call->uid, call->gid);
+}
+
+static int
+call_chmod (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->chmod (disk, call->path, call->mode);
+}
+
+static int
+call_chown (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->chown (disk, call->path, call->uid, call->gid);
+}
+
+static int
+call_truncate (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->truncate (disk, call->path, call->offset);
+}
+
+static int
+call_utime (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->utime (disk, call->path, call->buf);
+}
+
+static int
+call_open (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->open (disk, call->path, call->flags, call->mode, call->ctx);
+}
+
+static int
+call_read (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->read (disk, call->path, call->buf, call->size,
+			   call->offset, call->ctx);
+}
+
+static int
+call_write (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->write (disk, call->path, call->buf, call->size,
+			    call->offset, call->ctx);
+}
+
+static int
+call_statfs (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->statfs (disk, call->path, call->buf);
+}
+
+static int
+call_flush (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->flush (disk, call->path, call->ctx);
+}
+
+static int
+call_release (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->release (disk, call->path, call->ctx);
+}
+
+static int
+call_fsync (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->fsync (disk, call->path, call->flags, call->ctx);
+}
+
+static int
+call_setxattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->setxattr (disk, call->path, call->name, call->buf,
+			       call->size, call->flags);
+}
+
+static int
+call_getxattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->getxattr (disk, call->path, call->name, call->buf,
+			       call->size);
+}
+
+static int
+call_listxattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->listxattr (disk, call->path, call->buf, call->size);
+}
+
+static int
+call_removexattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->removexattr (disk, call->path, call->name);
+}
+
+static int
+call_opendir (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->opendir (disk, call->path, call->ctx);
+}
+
+static int
+call_releasedir (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->releasedir (disk, call->path, call->ctx);
+}
+
+static int
+call_fsyncdir (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->fsyncdir (disk, call->path, call->flags, call->ctx);
+}
+
+static int
+call_access (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->access (disk, call->path, call->mode);
+}
+
+static int
+call_ftruncate (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->ftruncate (disk, call->path, call->offset, call->ctx);
+}
+
+static int
+call_fgetattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->fgetattr (disk, call->path, call->buf, call->ctx);
+}
+
+static int
+call_bulk_getattr (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->bulk_getattr (disk, call->path, call->offset, call->buf,
+				   call->result);
+}
+
+static int
+call_readv (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->readv (disk, call->path, call->buf, call->size,
+			    call->offset, call->ctx);
+}
+
+static int
+call_writev (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->writev (disk, call->path, call->buf, call->size,
+			     call->offset, call->ctx);
+}
+
+static int
+call_getdents (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->getdents (disk, call->path, call->offset, call->buf,
+			       call->size, call->result);
+}
+
+static int
+call_copy (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->copy (disk, call->path, call->offset, call->path2,
+			   call->offset2, call->size);
+}
+
+static int
+call_seek (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->seek (disk, call->path, call->offset, call->flags,
+			   call->result, call->ctx);
+}
+
+static int
+call_fallocate (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->fallocate (disk, call->path, call->flags, call->offset,
+				call->size, call->ctx);
+}
+
+static int
+call_discard (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->discard (disk, call->path, call->offset, call->size,
+			      call->ctx);
+}
+
+static int
+call_zerofill (struct xlator *disk, struct disk_call *call)
+{
+  return disk->fops->zerofill (disk, call->path, call->offset, call->size,
+			       call->ctx);
+}
+
+/* a path not on the disk it hashes to, moved there by rename or link */
+static int
+md_find (struct multi_disk *md, const char *path, struct stat *stbuf, int skip)
+{
+  MD_CALLS (calls);
+  struct stat stbufs[POSIX_MAX_DISKS];
+  struct disk_call proto = {0,};
+  int i, count;
+
+  proto.fn = call_getattr;
+  proto.path = path;
+  count = md_spread (md, &proto, calls, skip);
+  for (i = 0; i < count; i++)
+    calls[i].buf = &stbufs[i];
+  disk_queue_run (calls, count);
+
+  for (i = 0; i < count; i++) {
+    if (calls[i].ret == 0) {
+      *stbuf = stbufs[i];
+      return calls[i].index;
+    }
+  }
+  errno = ENOENT;
+  return -1;
+}
+
+/* the disk holding path */
+static int
+md_locate (struct multi_disk *md, const char *path, struct stat *stbuf)
+{
+  struct disk_call call = {0,};
+  int home = md_hash (md, path);
+
+  call.fn = call_getattr;
+  call.path = path;
+  call.buf = stbuf;
+  if (md_call (md, home, &call) == 0)
+    return home;
+  if (errno != ENOENT || md->nr_disks == 1)
+    return -1;
+  return md_find (md, path, stbuf, home);
+}
+
+/* call on the disk path hashes to, or on the one it moved to */
+static int
+md_on_path (struct multi_disk *md, const char *path, struct disk_call *call)
+{
+  struct stat stbuf;
+  int home = md_hash (md, path);
+  int disk;
+  int ret = md_call (md, home, call);
+
+  if (ret >= 0 || errno != ENOENT || md->nr_disks == 1)
+    return ret;
+
+  disk = md_find (md, path, &stbuf, home);
+  if (disk < 0)
+    return -1;
+  return md_call (md, disk, call);
+}
+
+/* create where path hashes to, unless it already is somewhere else */
+static int
+md_create (struct multi_disk *md, const char *path, struct disk_call *call)
+{
+  struct stat stbuf;
+  int home = md_hash (md, path);
+
+  if (md->nr_disks > 1 && md_find (md, path, &stbuf, home) >= 0) {
+    errno = EEXIST;
+    return -1;
+  }
+  return md_call (md, home, call);
+}
+
+/* on every disk, fine where the path does not exist */
+static int
+md_on_every (struct multi_disk *md, struct disk_call *proto)
+{
+  MD_CALLS (calls);
+  int count = md_spread (md, proto, calls, -1);
+
+  disk_queue_run (calls, count);
+  return md_any (calls, count);
+}
+
+/* the disk whose posix opened the file */
+static int
+md_ctx_disk (struct multi_disk *md, struct file_context *ctx)
+{
+  int i;
+
+  for (i = 0; i < md->nr_disks; i++) {
+    struct file_context *tmp;
+
+    FILL_MY_CTX (tmp, ctx, md->disks[i].xl);
+    if (tmp)
+      return i;
+  }
+  errno = EBADF;
+  return -1;
+}
+
+static int
+md_on_ctx (struct multi_disk *md, struct disk_call *call)
+{
+  int disk = md_ctx_disk (md, call->ctx);
+
+  if (disk < 0)
+    return -1;
+  return md_call (md, disk, call);
+}
+
+static int
+md_getattr (struct xlator *xl,
+	    const char *path,
+	    struct stat *stbuf)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_getattr;
+  call.path = path;
+  call.buf = stbuf;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_readlink (struct xlator *xl,
+	     const char *path,
+	     char *dest,
+	     size_t size)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_readlink;
+  call.path = path;
+  call.buf = dest;
+  call.size = size;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_mknod (struct xlator *xl,
+	  const char *path,
+	  mode_t mode,
+	  dev_t dev,
+	  uid_t uid,
+	  gid_t gid)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_mknod;
+  call.path = path;
+  call.mode = mode;
+  call.dev = dev;
+  call.uid = uid;
+  call.gid = gid;
+  return md_create (MD (xl), path, &call);
+}
+
+/* on every disk, or on none */
+static int
+md_mkdir (struct xlator *xl,
+	  const char *path,
+	  mode_t mode,
+	  uid_t uid,
+	  gid_t gid)
+{
+  struct multi_disk *md = MD (xl);
+  MD_CALLS (calls);
+  struct disk_call proto = {0,};
+  int i, count, made = 0, failed = -1;
+
+  proto.fn = call_mkdir;
+  proto.path = path;
+  proto.mode = mode;
+  proto.uid = uid;
+  proto.gid = gid;
+  count = md_spread (md, &proto, calls, -1);
+  disk_queue_run (calls, count);
+
+  for (i = 0; i < count; i++) {
+    if (calls[i].ret == 0)
+      made++;
+    else if (calls[i].op_errno != EEXIST && failed == -1)
+      failed = i;
+  }
+
+  if (failed != -1) {
+    int op_errno = calls[failed].op_errno;
+
+    proto.fn = call_rmdir;
+    md_undo (calls, count, &proto);
+    errno = op_errno;
+    return -1;
+  }
+  if (!made) {
+    errno = EEXIST;
+    return -1;
+  }
+  return 0;
+}
+
+static int
+md_unlink (struct xlator *xl,
+	   const char *path)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_unlink;
+  call.path = path;
+  return md_on_path (MD (xl), path, &call);
+}
+
+/* on every disk, or on none */
+static int
+md_rmdir (struct xlator *xl,
+	  const char *path)
+{
+  struct multi_disk *md = MD (xl);
+  MD_CALLS (calls);
+  struct disk_call proto = {0,};
+  struct stat stbuf;
+  int i, count, failed = -1;
+
+  if (md_locate (md, path, &stbuf) < 0)
+    return -1;
+
+  proto.fn = call_rmdir;
+  proto.path = path;
+  count = md_spread (md, &proto, calls, -1);
+  disk_queue_run (calls, count);
+
+  for (i = 0; i < count; i++) {
+    if (calls[i].ret != 0 && calls[i].op_errno != ENOENT) {
+      failed = i;
+      break;
+    }
+  }
+
+  if (failed != -1) {
+    int op_errno = calls[failed].op_errno;
+
+    /* not empty on some disk, bring it back where it is gone */
+    proto.fn = call_mkdir;
+    proto.mode = stbuf.st_mode & 07777;
+    proto.uid = stbuf.st_uid;
+    proto.gid = stbuf.st_gid;
+    md_undo (calls, count, &proto);
+    errno = op_errno;
+    return -1;
+  }
+  return 0;
+}
+
+static int
+md_symlink (struct xlator *xl,
+	    const char *oldpath,
+	    const char *newpath,
+	    uid_t uid,
+	    gid_t gid)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_symlink;
+  call.path = oldpath;
+  call.path2 = newpath;
+  call.uid = uid;
+  call.gid = gid;
+  return md_create (MD (xl), newpath, &call);
+}
+
+/* a file is renamed on its disk, which may not be where newpath hashes
+   to; a directory on every disk */
+static int
+md_rename (struct xlator *xl,
+	   const char *oldpath,
+	   const char *newpath,
+	   uid_t uid,
+	   gid_t gid)
+{
+  struct multi_disk *md = MD (xl);
+  MD_CALLS (calls);
+  struct disk_call proto = {0,};
+  struct stat stbuf;
+  int i, count, disk;
+
+  disk = md_locate (md, oldpath, &stbuf);
+  if (disk < 0)
+    return -1;
+
+  proto.fn = call_rename;
+  proto.path = oldpath;
+  proto.path2 = newpath;
+  proto.uid = uid;
+  proto.gid = gid;
+
+  if (S_ISDIR (stbuf.st_mode)) {
+    count = md_spread (md, &proto, calls, -1);
+    disk_queue_run (calls, count);
+
+    for (i = 0; i < count; i++) {
+      if (calls[i].ret != 0 && calls[i].op_errno != ENOENT) {
+	int op_errno = calls[i].op_errno;
+
+	proto.path = newpath;
+	proto.path2 = oldpath;
+	md_undo (calls, count, &proto);
+	errno = op_errno;
+	return -1;
+      }
+    }
+    return 0;
+  }
+
+  if (md_call (md, disk, &proto) != 0)
+    return -1;
+
+  /* newpath is replaced, also where it was on another disk */
+  if (md->nr_disks > 1) {
+    proto.fn = call_unlink;
+    proto.path = newpath;
+    count = md_spread (md, &proto, calls, disk);
+    disk_queue_run (calls, count);
+  }
+  return 0;
+}
+
+/* the link stays on the disk of oldpath */
+static int
+md_link (struct xlator *xl,
+	 const char *oldpath,
+	 const char *newpath,
+	 uid_t uid,
+	 gid_t gid)
+{
+  struct multi_disk *md = MD (xl);
+  struct disk_call call = {0,};
+  struct stat stbuf;
+  int disk = md_locate (md, oldpath, &stbuf);
+
+  if (disk < 0)
+    return -1;
+  if (md->nr_disks > 1 && md_find (md, newpath, &stbuf, disk) >= 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  call.fn = call_link;
+  call.path = oldpath;
+  call.path2 = newpath;
+  call.uid = uid;
+  call.gid = gid;
+  return md_call (md, disk, &call);
+}
+
+static int
+md_chmod (struct xlator *xl,
+	  const char *path,
+	  mode_t mode)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_chmod;
+  proto.path = path;
+  proto.mode = mode;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_chown (struct xlator *xl,
+	  const char *path,
+	  uid_t uid,
+	  gid_t gid)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_chown;
+  proto.path = path;
+  proto.uid = uid;
+  proto.gid = gid;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_truncate (struct xlator *xl,
+	     const char *path,
+	     off_t offset)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_truncate;
+  call.path = path;
+  call.offset = offset;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_utime (struct xlator *xl,
+	  const char *path,
+	  struct utimbuf *buf)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_utime;
+  proto.path = path;
+  proto.buf = buf;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_open (struct xlator *xl,
+	 const char *path,
+	 int flags,
+	 mode_t mode,
+	 struct file_context *ctx)
+{
+  struct multi_disk *md = MD (xl);
+  struct disk_call call = {0,};
+  struct stat stbuf;
+  int disk = md_locate (md, path, &stbuf);
+
+  /* new files go where they hash to */
+  if (disk < 0)
+    disk = md_hash (md, path);
+
+  call.fn = call_open;
+  call.path = path;
+  call.flags = flags;
+  call.mode = mode;
+  call.ctx = ctx;
+  return md_call (md, disk, &call);
+}
+
+static int
+md_read (struct xlator *xl,
+	 const char *path,
+	 char *buf,
+	 size_t size,
+	 off_t offset,
+	 struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_read;
+  call.path = path;
+  call.buf = buf;
+  call.size = size;
+  call.offset = offset;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_write (struct xlator *xl,
+	  const char *path,
+	  const char *buf,
+	  size_t size,
+	  off_t offset,
+	  struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_write;
+  call.path = path;
+  call.buf = (void *) buf;
+  call.size = size;
+  call.offset = offset;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+/* the disks added up, in blocks of the first one */
+static int
+md_statfs (struct xlator *xl,
+	   const char *path,
+	   struct statvfs *buf)
+{
+  struct multi_disk *md = MD (xl);
+  MD_CALLS (calls);
+  struct statvfs bufs[POSIX_MAX_DISKS];
+  struct disk_call proto = {0,};
+  int i, count;
+
+  proto.fn = call_statfs;
+  proto.path = path;
+  count = md_spread (md, &proto, calls, -1);
+  for (i = 0; i < count; i++)
+    calls[i].buf = &bufs[i];
+  disk_queue_run (calls, count);
+
+  if (md_all (calls, count) != 0)
+    return -1;
+
+  *buf = bufs[0];
+  for (i = 1; i < count; i++) {
+    double scale = (double) bufs[i].f_frsize / bufs[0].f_frsize;
+
+    buf->f_blocks += bufs[i].f_blocks * scale;
+    buf->f_bfree += bufs[i].f_bfree * scale;
+    buf->f_bavail += bufs[i].f_bavail * scale;
+    buf->f_files += bufs[i].f_files;
+    buf->f_ffree += bufs[i].f_ffree;
+    buf->f_favail += bufs[i].f_favail;
+  }
+  return 0;
+}
+
+static int
+md_flush (struct xlator *xl,
+	  const char *path,
+	  struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_flush;
+  call.path = path;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_release (struct xlator *xl,
+	    const char *path,
+	    struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_release;
+  call.path = path;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_fsync (struct xlator *xl,
+	  const char *path,
+	  int flags,
+	  struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_fsync;
+  call.path = path;
+  call.flags = flags;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_setxattr (struct xlator *xl,
+	     const char *path,
+	     const char *name,
+	     const char *value,
+	     size_t size,
+	     int flags)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_setxattr;
+  proto.path = path;
+  proto.name = name;
+  proto.buf = (void *) value;
+  proto.size = size;
+  proto.flags = flags;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_getxattr (struct xlator *xl,
+	     const char *path,
+	     const char *name,
+	     char *value,
+	     size_t size)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_getxattr;
+  call.path = path;
+  call.name = name;
+  call.buf = value;
+  call.size = size;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_listxattr (struct xlator *xl,
+	      const char *path,
+	      char *list,
+	      size_t size)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_listxattr;
+  call.path = path;
+  call.buf = list;
+  call.size = size;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_removexattr (struct xlator *xl,
+		const char *path,
+		const char *name)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_removexattr;
+  proto.path = path;
+  proto.name = name;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_opendir (struct xlator *xl,
+	    const char *path,
+	    struct file_context *ctx)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_opendir;
+  proto.path = path;
+  proto.ctx = ctx;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_cursor_get (struct multi_disk *md,
+	       off_t cookie,
+	       int *disk,
+	       off_t *offset)
+{
+  struct md_cursor *cursor;
+  int ret = 0;
+
+  if (!cookie) {
+    *disk = 0;
+    *offset = 0;
+    return 0;
+  }
+
+  pthread_mutex_lock (&md->cursor_lock);
+  cursor = &md->cursors[cookie % MD_CURSORS];
+  if (cursor->cookie == cookie) {
+    *disk = cursor->disk;
+    *offset = cursor->offset;
+  } else {
+    ret = -1;
+  }
+  pthread_mutex_unlock (&md->cursor_lock);
+
+  /* too old, a newer listing took its place */
+  if (ret)
+    errno = ESTALE;
+  return ret;
+}
+
+static off_t
+md_cursor_put (struct multi_disk *md,
+	       int disk,
+	       off_t offset)
+{
+  struct md_cursor *cursor;
+  off_t cookie;
+
+  pthread_mutex_lock (&md->cursor_lock);
+  cookie = ++md->last_cookie;
+  cursor = &md->cursors[cookie % MD_CURSORS];
+  cursor->cookie = cookie;
+  cursor->disk = disk;
+  cursor->offset = offset;
+  pthread_mutex_unlock (&md->cursor_lock);
+
+  return cookie;
+}
+
+/* one page of a listing, the disks one after the other */
+static int
+md_walk (struct multi_disk *md,
+	 struct disk_call *proto,
+	 off_t offset,
+	 off_t *next)
+{
+  int count = 0;
+  off_t pos;
+  int disk;
+
+  if (md_cursor_get (md, offset, &disk, &pos) != 0)
+    return -1;
+
+  while (disk < md->nr_disks) {
+    struct disk_call call = *proto;
+
+    call.offset = pos;
+    call.result = &pos;
+    count = md_call (md, disk, &call);
+    /* a disk added later may not have the directory yet */
+    if (count < 0 && errno == ENOENT && disk > 0)
+      count = 0;
+    if (count != 0)
+      break;
+    disk++;
+    pos = 0;
+  }
+
+  *next = (count > 0) ? md_cursor_put (md, disk, pos) : 0;
+  return count;
+}
+
+static int
+md_getdents (struct xlator *xl,
+	     const char *path,
+	     off_t offset,
+	     char *buf,
+	     size_t size,
+	     off_t *next)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_getdents;
+  proto.path = path;
+  proto.buf = buf;
+  proto.size = size;
+  return md_walk (MD (xl), &proto, offset, next);
+}
+
+static int
+md_bulk_getattr (struct xlator *xl,
+		 const char *path,
+		 off_t offset,
+		 struct bulk_stat *bstbuf,
+		 off_t *next)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_bulk_getattr;
+  proto.path = path;
+  proto.buf = bstbuf;
+  return md_walk (MD (xl), &proto, offset, next);
+}
+
+/* the whole directory from offset on, as one '/' separated string */
+static char *
+md_readdir (struct xlator *xl,
+	    const char *path,
+	    off_t offset)
+{
+  size_t alloced = GF_GETDENTS_PAGE;
+  size_t length = 0;
+  char *buf = malloc (alloced);
+  int count;
+
+  if (!buf)
+    return NULL;
+
+  while ((count = md_getdents (xl, path, offset, buf + length,
+			       alloced - length, &offset)) > 0) {
+    length += strlen (buf + length);
+    buf[length++] = '/';
+
+    if (alloced - length < GF_GETDENTS_PAGE) {
+      alloced *= 2;
+      buf = realloc (buf, alloced);
+    }
+  }
+
+  if (count < 0) {
+    gf_log ("posix", LOG_DEBUG, "multi-disk.c->md_readdir: failed to read %s\n", path);
+    free (buf);
+    return NULL;
+  }
+
+  if (length)
+    buf[length - 1] = '\0';
+  else
+    buf[0] = '\0';
+  return buf;
+}
+
+static int
+md_releasedir (struct xlator *xl,
+	       const char *path,
+	       struct file_context *ctx)
+{
+  struct disk_call proto = {0,};
+
+  proto.fn = call_releasedir;
+  proto.path = path;
+  proto.ctx = ctx;
+  return md_on_every (MD (xl), &proto);
+}
+
+static int
+md_fsyncdir (struct xlator *xl,
+	     const char *path,
+	     int flags,
+	     struct file_context *ctx)
+{
+  struct multi_disk *md = MD (xl);
+  MD_CALLS (calls);
+  struct disk_call proto = {0,};
+  int count;
+
+  proto.fn = call_fsyncdir;
+  proto.path = path;
+  proto.flags = flags;
+  proto.ctx = ctx;
+  count = md_spread (md, &proto, calls, -1);
+  disk_queue_run (calls, count);
+  return md_all (calls, count);
+}
+
+static int
+md_access (struct xlator *xl,
+	   const char *path,
+	   mode_t mode)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_access;
+  call.path = path;
+  call.mode = mode;
+  return md_on_path (MD (xl), path, &call);
+}
+
+static int
+md_ftruncate (struct xlator *xl,
+	      const char *path,
+	      off_t offset,
+	      struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_ftruncate;
+  call.path = path;
+  call.offset = offset;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_fgetattr (struct xlator *xl,
+	     const char *path,
+	     struct stat *buf,
+	     struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_fgetattr;
+  call.path = path;
+  call.buf = buf;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_readv (struct xlator *xl,
+	  const char *path,
+	  const struct iovec *vector,
+	  int count,
+	  off_t offset,
+	  struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_readv;
+  call.path = path;
+  call.buf = (void *) vector;
+  call.size = count;
+  call.offset = offset;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_writev (struct xlator *xl,
+	   const char *path,
+	   const struct iovec *vector,
+	   int count,
+	   off_t offset,
+	   struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_writev;
+  call.path = path;
+  call.buf = (void *) vector;
+  call.size = count;
+  call.offset = offset;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+/* the kernel copies within one disk only */
+static int
+md_copy (struct xlator *xl,
+	 const char *from,
+	 off_t from_offset,
+	 const char *to,
+	 off_t to_offset,
+	 size_t size)
+{
+  struct multi_disk *md = MD (xl);
+  struct disk_call call = {0,};
+  struct stat stbuf;
+  int from_disk, to_disk;
+
+  from_disk = md_locate (md, from, &stbuf);
+  if (from_disk < 0)
+    return -1;
+  to_disk = md_locate (md, to, &stbuf);
+  if (to_disk < 0)
+    return -1;
+  if (from_disk != to_disk) {
+    errno = EXDEV;
+    return -1;
+  }
+
+  call.fn = call_copy;
+  call.path = from;
+  call.offset = from_offset;
+  call.path2 = to;
+  call.offset2 = to_offset;
+  call.size = size;
+  return md_call (md, from_disk, &call);
+}
+
+static int
+md_seek (struct xlator *xl,
+	 const char *path,
+	 off_t offset,
+	 int whence,
+	 off_t *result,
+	 struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_seek;
+  call.path = path;
+  call.offset = offset;
+  call.flags = whence;
+  call.result = result;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_fallocate (struct xlator *xl,
+	      const char *path,
+	      int keep_size,
+	      off_t offset,
+	      size_t len,
+	      struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_fallocate;
+  call.path = path;
+  call.flags = keep_size;
+  call.offset = offset;
+  call.size = len;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_discard (struct xlator *xl,
+	    const char *path,
+	    off_t offset,
+	    size_t len,
+	    struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_discard;
+  call.path = path;
+  call.offset = offset;
+  call.size = len;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_zerofill (struct xlator *xl,
+	     const char *path,
+	     off_t offset,
+	     size_t len,
+	     struct file_context *ctx)
+{
+  struct disk_call call = {0,};
+
+  call.fn = call_zerofill;
+  call.path = path;
+  call.offset = offset;
+  call.size = len;
+  call.ctx = ctx;
+  return md_on_ctx (MD (xl), &call);
+}
+
+static int
+md_stats (struct xlator *xl,
+	  struct xlator_stats *stats)
+{
+  struct multi_disk *md = MD (xl);
+  int i;
+
+  memset (stats, 0, sizeof (*stats));
+  for (i = 0; i < md->nr_disks; i++) {
+    struct xlator *disk = md->disks[i].xl;
+    struct xlator_stats one = {0,};
+
+    disk->mgmt_ops->stats (disk, &one);
+    stats->nr_files += one.nr_files;
+    stats->free_disk += one.free_disk;
+    stats->disk_usage += one.disk_usage;
+    stats->nr_clients = one.nr_clients;
+    stats->read_usage += one.read_usage;
+    stats->write_usage += one.write_usage;
+    stats->read_iops += one.read_iops;
+    stats->write_iops += one.write_iops;
+    /* the disks work side by side */
+    stats->disk_speed += one.disk_speed;
+    /* the slowest disk is what a client may get */
+    if (one.latency_p50 > stats->latency_p50)
+      stats->latency_p50 = one.latency_p50;
+    if (one.latency_p90 > stats->latency_p90)
+      stats->latency_p90 = one.latency_p90;
+    if (one.latency_p99 > stats->latency_p99)
+      stats->latency_p99 = one.latency_p99;
+  }
+  return 0;
+}
+
+static struct xlator_fops md_fops = {
+  .getattr     = md_getattr,
+  .readlink    = md_readlink,
+  .mknod       = md_mknod,
+  .mkdir       = md_mkdir,
+  .unlink      = md_unlink,
+  .rmdir       = md_rmdir,
+  .symlink     = md_symlink,
+  .rename      = md_rename,
+  .link        = md_link,
+  .chmod       = md_chmod,
+  .chown       = md_chown,
+  .truncate    = md_truncate,
+  .utime       = md_utime,
+  .open        = md_open,
+  .read        = md_read,
+  .write       = md_write,
+  .statfs      = md_statfs,
+  .flush       = md_flush,
+  .release     = md_release,
+  .fsync       = md_fsync,
+  .setxattr    = md_setxattr,
+  .getxattr    = md_getxattr,
+  .listxattr   = md_listxattr,
+  .removexattr = md_removexattr,
+  .opendir     = md_opendir,
+  .readdir     = md_readdir,
+  .releasedir  = md_releasedir,
+  .fsyncdir    = md_fsyncdir,
+  .access      = md_access,
+  .ftruncate   = md_ftruncate,
+  .fgetattr    = md_fgetattr,
+  .bulk_getattr = md_bulk_getattr,
+  .readv       = md_readv,
+  .writev      = md_writev,
+  .getdents    = md_getdents,
+  .copy        = md_copy,
+  .seek        = md_seek,
+  .fallocate   = md_fallocate,
+  .discard     = md_discard,
+  .zerofill    = md_zerofill
+};
+
+static struct xlator_mgmt_ops md_mgmt_ops;
+
+/* a posix of its own for one of the directories, with the options of xl */
+static struct xlator *
+md_disk_new (struct xlator *xl, const char *directory, int index)
+{
+  struct xlator *disk = calloc (1, sizeof (*disk));
+  data_pair_t *pair;
+
+  asprintf (&disk->name, "%s-disk%d", xl->name, index);
+  disk->parent = xl;
+  disk->fops = xl->fops;
+  disk->mgmt_ops = xl->mgmt_ops;
+  disk->init = xl->init;
+  disk->fini = xl->fini;
+  disk->getlayout = xl->getlayout;
+  disk->setlayout = xl->setlayout;
+
+  disk->options = get_new_dict ();
+  for (pair = xl->options->members; pair; pair = pair->next) {
+    if (strcmp (pair->key, "directories") != 0)
+      dict_set (disk->options, pair->key, pair->value);
+  }
+  dict_set (disk->options, "directory", str_to_data (strdup (directory)));
+
+  disk->init (disk);
+  /* directories are listed once, by the first disk */
+  ((struct posix_private *)disk->private)->files_only = (index > 0);
+  return disk;
+}
+
+int
+multi_disk_init (struct xlator *xl, const char *directories)
+{
+  struct posix_private *priv = xl->private;
+  struct multi_disk *md = calloc (1, sizeof (*md));
+  data_t *threads = dict_get (xl->options, "disk-threads");
+  int nr_threads = POSIX_DISK_THREADS;
+  char *list = strdup (directories);
+  char *directory, *saveptr = NULL;
+
+  if (threads)
+    nr_threads = atoi (threads->data);
+  if (nr_threads < 1)
+    nr_threads = 1;
+
+  md->disks = calloc (POSIX_MAX_DISKS, sizeof (struct md_disk));
+  pthread_mutex_init (&md->cursor_lock, NULL);
+
+  for (directory = strtok_r (list, ", ", &saveptr);
+       directory;
+       directory = strtok_r (NULL, ", ", &saveptr)) {
+    struct md_disk *disk = &md->disks[md->nr_disks];
+
+    if (md->nr_disks == POSIX_MAX_DISKS) {
+      gf_log ("posix", LOG_CRITICAL, "multi-disk.c->multi_disk_init: more than %d directories\n",
+	      POSIX_MAX_DISKS);
+      exit (1);
+    }
+    disk->xl = md_disk_new (xl, directory, md->nr_disks);
+    disk->queue = disk_queue_new (nr_threads);
+    if (!disk->queue) {
+      gf_log ("posix", LOG_CRITICAL, "multi-disk.c->multi_disk_init: could not start the threads of %s\n",
+	      directory);
+      exit (1);
+    }
+    md->nr_disks++;
+  }
+  free (list);
+
+  if (!md->nr_disks) {
+    gf_log ("posix", LOG_CRITICAL, "multi-disk.c->multi_disk_init: no directories given\n");
+    exit (1);
+  }
+
+  md_mgmt_ops = *xl->mgmt_ops;
+  md_mgmt_ops.stats = md_stats;
+
+  priv->multi_disk = md;
+  xl->fops = &md_fops;
+  xl->mgmt_ops = &md_mgmt_ops;
+
+  gf_log ("posix", LOG_NORMAL, "%s: %d disks, %d threads each",
+	  xl->name, md->nr_disks, nr_threads);
+  return 0;
+}
+
+void
+multi_disk_fini (struct xlator *xl)
+{
+  struct multi_disk *md = MD (xl);
+  int i;
+
+  for (i = 0; i < md->nr_disks; i++) {
+    struct xlator *disk = md->disks[i].xl;
+
+    disk_queue_destroy (md->disks[i].queue);
+    disk->fini (disk);
+    free (disk->name);
+    free (disk);
+  }
+  pthread_mutex_destroy (&md->cursor_lock);
+  free (md->disks);
+  free (md);
+}
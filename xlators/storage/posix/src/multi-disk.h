@@ -0,0 +1,44 @@
+#ifndef _MULTI_DISK_H
+#define _MULTI_DISK_H
+
+#include "xlator.h"
+#include "disk-queue.h"
+
+/*
+  One posix brick over several disks. Every disk is a posix instance of
+  its own, with its own fd caches and pools, and a queue of its own in
+  front of it. Only calls made on several disks at once (on directories,
+  statfs, the search for a file away from the disk it hashes to) go
+  through the queues and run in parallel; a call on the disk of one path
+  runs on the thread that made it. Directories exist on every disk, everything else lives on
+  the disk its path hashes to, or on the disk it was renamed or linked on
+  when that differs. Listings walk the disks one after the other, the
+  disks after the first one leave their directories out.
+*/
+
+#define MD_CURSORS 4096  /* listing cookies remembered */
+
+struct md_disk {
+  struct xlator *xl;
+  struct disk_queue *queue;
+};
+
+/* where a listing cookie continues: a disk and the cookie of that disk */
+struct md_cursor {
+  off_t cookie;
+  int disk;
+  off_t offset;
+};
+
+struct multi_disk {
+  struct md_disk *disks;
+  int nr_disks;
+  pthread_mutex_t cursor_lock;
+  off_t last_cookie;
+  struct md_cursor cursors[MD_CURSORS];
+};
+
+int multi_disk_init (struct xlator *xl, const char *directories);
+void multi_disk_fini (struct xlator *xl);
+
+#endif /* _MULTI_DISK_H */
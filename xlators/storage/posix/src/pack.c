@@ -0,0 +1,1492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/limits.h>
+
+#include "hashfn.h"
+#include "logging.h"
+#include "pack.h"
+
+#define PACK_JOURNAL     "index"
+#define PACK_JOURNAL_NEW "index.new"
+#define PACK_PUT 1
+#define PACK_DEL 2
+
+/* one change of the index as the journal keeps it, the path follows */
+struct pack_record {
+  uint32_t type;
+  uint32_t path_len;
+  uint32_t container;
+  uint32_t length;
+  uint64_t offset;
+  uint64_t ino;
+  uint32_t mode;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t pad;
+  int64_t atime;
+  int64_t mtime;
+  int64_t ctime;
+};
+
+static unsigned int
+path_hash (const char *path, int len)
+{
+  return SuperFastHash (path, len);
+}
+
+static ssize_t
+pread_all (int fd, void *buf, size_t size, off_t offset)
+{
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t len = pread (fd, (char *)buf + done, size - done, offset + done);
+
+    if (len <= 0)
+      return (len == 0) ? (ssize_t)done : -1;
+    done += len;
+  }
+  return done;
+}
+
+static ssize_t
+pwrite_all (int fd, const void *buf, size_t size, off_t offset)
+{
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t len = pwrite (fd, (const char *)buf + done, size - done, offset + done);
+
+    if (len <= 0)
+      return -1;
+    done += len;
+  }
+  return done;
+}
+
+/* the index, everything below runs under store->lock */
+
+static struct pack_entry *
+entry_find (struct pack_store *store, const char *path)
+{
+  unsigned int hash = path_hash (path, strlen (path));
+  struct pack_entry *entry = store->entries[hash % store->nr_buckets];
+
+  while (entry && (entry->hash != hash || strcmp (entry->path, path) != 0))
+    entry = entry->hash_next;
+  return entry;
+}
+
+static struct pack_entry *
+pending_find (struct pack_store *store, int fd)
+{
+  struct pack_entry *entry = store->pending;
+
+  while (entry && entry->pending_fd != fd)
+    entry = entry->pending_next;
+  return entry;
+}
+
+/* the entry is no longer pending, whoever has its fd open keeps what
+   they have */
+static void
+pending_del (struct pack_store *store, struct pack_entry *entry)
+{
+  struct pack_entry **trav = &store->pending;
+
+  while (*trav && *trav != entry)
+    trav = &(*trav)->pending_next;
+  if (*trav)
+    *trav = entry->pending_next;
+  entry->pending_fd = -1;
+}
+
+static struct pack_dir *
+dir_find (struct pack_store *store, const char *path, int len, int create)
+{
+  unsigned int hash = path_hash (path, len);
+  struct pack_dir **bucket = &store->dirs[hash % store->nr_dir_buckets];
+  struct pack_dir *dir = *bucket;
+
+  while (dir && (dir->hash != hash || strncmp (dir->path, path, len) != 0 ||
+		 dir->path[len] != '\0'))
+    dir = dir->hash_next;
+  if (dir || !create)
+    return dir;
+
+  dir = calloc (1, sizeof (*dir));
+  dir->hash = hash;
+  dir->path = strndup (path, len);
+  dir->hash_next = *bucket;
+  *bucket = dir;
+  store->nr_dirs++;
+  return dir;
+}
+
+static void
+dir_free (struct pack_store *store, struct pack_dir *dir)
+{
+  struct pack_dir **trav = &store->dirs[dir->hash % store->nr_dir_buckets];
+
+  while (*trav != dir)
+    trav = &(*trav)->hash_next;
+  *trav = dir->hash_next;
+  store->nr_dirs--;
+  free (dir->slots);
+  free (dir->path);
+  free (dir);
+}
+
+static void
+table_grow (struct pack_store *store)
+{
+  unsigned int nr = store->nr_buckets * 2;
+  struct pack_entry **table = calloc (nr, sizeof (*table));
+  unsigned int i;
+
+  for (i = 0; i < store->nr_buckets; i++) {
+    struct pack_entry *entry = store->entries[i];
+
+    while (entry) {
+      struct pack_entry *next = entry->hash_next;
+
+      entry->hash_next = table[entry->hash % nr];
+      table[entry->hash % nr] = entry;
+      entry = next;
+    }
+  }
+  free (store->entries);
+  store->entries = table;
+  store->nr_buckets = nr;
+}
+
+static void
+dirs_grow (struct pack_store *store)
+{
+  unsigned int nr = store->nr_dir_buckets * 2;
+  struct pack_dir **table = calloc (nr, sizeof (*table));
+  unsigned int i;
+
+  for (i = 0; i < store->nr_dir_buckets; i++) {
+    struct pack_dir *dir = store->dirs[i];
+
+    while (dir) {
+      struct pack_dir *next = dir->hash_next;
+
+      dir->hash_next = table[dir->hash % nr];
+      table[dir->hash % nr] = dir;
+      dir = next;
+    }
+  }
+  free (store->dirs);
+  store->dirs = table;
+  store->nr_dir_buckets = nr;
+}
+
+/* the entry goes into the table and the listing of its directory */
+static void
+entry_link (struct pack_store *store, struct pack_entry *entry)
+{
+  const char *slash = strrchr (entry->path, '/');
+  int len = slash - entry->path;
+  struct pack_entry **bucket;
+  struct pack_dir *dir;
+
+  entry->name = slash + 1;
+  entry->hash = path_hash (entry->path, strlen (entry->path));
+  bucket = &store->entries[entry->hash % store->nr_buckets];
+  entry->hash_next = *bucket;
+  *bucket = entry;
+  if (++store->nr_entries > store->nr_buckets * 2)
+    table_grow (store);
+
+  /* the parent of "/name" is "/" */
+  dir = dir_find (store, len ? entry->path : "/", len ? len : 1, 1);
+  if (dir->count == dir->alloced) {
+    dir->alloced = dir->alloced ? dir->alloced * 2 : 8;
+    dir->slots = realloc (dir->slots, dir->alloced * sizeof (*dir->slots));
+  }
+  entry->dir = dir;
+  entry->dir_index = dir->count;
+  dir->slots[dir->count].entry = entry;
+  dir->slots[dir->count++].seq = dir->next_seq++;
+  dir->live++;
+  if (store->nr_dirs > store->nr_dir_buckets * 2)
+    dirs_grow (store);
+}
+
+static void
+entry_unlink (struct pack_store *store, struct pack_entry *entry)
+{
+  struct pack_entry **trav = &store->entries[entry->hash % store->nr_buckets];
+  struct pack_dir *dir = entry->dir;
+
+  while (*trav != entry)
+    trav = &(*trav)->hash_next;
+  *trav = entry->hash_next;
+  store->nr_entries--;
+
+  /* the others keep their seq, a listing goes on where it was */
+  dir->slots[entry->dir_index].entry = NULL;
+  entry->dir = NULL;
+  if (!--dir->live) {
+    dir_free (store, dir);
+  } else if (dir->live * 2 < dir->count) {
+    int i, j = 0;
+
+    for (i = 0; i < dir->count; i++) {
+      if (!dir->slots[i].entry)
+	continue;
+      dir->slots[j] = dir->slots[i];
+      dir->slots[j].entry->dir_index = j;
+      j++;
+    }
+    dir->count = j;
+  }
+}
+
+/* the first slot of dir at seq or after */
+static int
+dir_seek (struct pack_dir *dir, int seq)
+{
+  int lo = 0, hi = dir->count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if (dir->slots[mid].seq < seq)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static struct pack_entry *
+entry_new (void)
+{
+  struct pack_entry *entry = calloc (1, sizeof (*entry));
+
+  pthread_mutex_init (&entry->lock, NULL);
+  entry->refs = 1;              /* that of the index */
+  entry->pending_fd = -1;
+  return entry;
+}
+
+/* a reference taken under store->lock keeps the entry after the index
+   dropped it, entry_put () lets go of one */
+static void
+entry_hold (struct pack_entry *entry)
+{
+  __sync_fetch_and_add (&entry->refs, 1);
+}
+
+static void
+entry_put (struct pack_entry *entry)
+{
+  if (__sync_sub_and_fetch (&entry->refs, 1))
+    return;
+  pthread_mutex_destroy (&entry->lock);
+  free (entry->path);
+  free (entry);
+}
+
+static void
+entry_stat (struct pack_store *store,
+	    struct pack_entry *entry,
+	    struct stat *stbuf)
+{
+  memset (stbuf, 0, sizeof (*stbuf));
+  stbuf->st_dev = store->dev;
+  stbuf->st_ino = entry->ino;
+  stbuf->st_mode = S_IFREG | entry->mode;
+  stbuf->st_nlink = 1;
+  stbuf->st_uid = entry->uid;
+  stbuf->st_gid = entry->gid;
+  stbuf->st_size = entry->length;
+  stbuf->st_atime = entry->atime;
+  stbuf->st_mtime = entry->mtime;
+  stbuf->st_ctime = entry->ctime;
+
+  if (entry->pending_fd != -1) {
+    struct stat mem;
+
+    /* size and times are those of the pending file */
+    if (fstat (entry->pending_fd, &mem) == 0) {
+      stbuf->st_size = mem.st_size;
+      stbuf->st_atime = mem.st_atime;
+      stbuf->st_mtime = mem.st_mtime;
+      stbuf->st_ctime = mem.st_ctime;
+    }
+  }
+  stbuf->st_blksize = 4096;
+  stbuf->st_blocks = (stbuf->st_size + 511) / 512;
+}
+
+/* the journal, appended to under the write lock */
+
+static void
+record_fill (struct pack_record *rec,
+	     int type,
+	     const char *path,
+	     struct pack_entry *entry)
+{
+  memset (rec, 0, sizeof (*rec));
+  rec->type = type;
+  rec->path_len = strlen (path);
+  if (!entry)
+    return;
+  rec->container = entry->container;
+  rec->length = entry->length;
+  rec->offset = entry->offset;
+  rec->ino = entry->ino;
+  rec->mode = entry->mode;
+  rec->uid = entry->uid;
+  rec->gid = entry->gid;
+  rec->atime = entry->atime;
+  rec->mtime = entry->mtime;
+  rec->ctime = entry->ctime;
+}
+
+/* the records of one change go down in one write, a crash can not split them */
+static void
+journal_append (struct pack_store *store,
+		struct iovec *vector,
+		int count)
+{
+  if (writev (store->journal_fd, vector, count) == -1)
+    gf_log ("posix", LOG_CRITICAL, "pack.c->journal_append: %s\n", strerror (errno));
+  store->journal_records += count / 2;
+}
+
+static void
+journal_put (struct pack_store *store, struct pack_entry *entry)
+{
+  struct pack_record rec;
+  struct iovec vector[2];
+
+  record_fill (&rec, PACK_PUT, entry->path, entry);
+  vector[0].iov_base = &rec;
+  vector[0].iov_len = sizeof (rec);
+  vector[1].iov_base = entry->path;
+  vector[1].iov_len = rec.path_len;
+  journal_append (store, vector, 2);
+}
+
+static void
+journal_del (struct pack_store *store, const char *path)
+{
+  struct pack_record rec;
+  struct iovec vector[2];
+
+  record_fill (&rec, PACK_DEL, path, NULL);
+  vector[0].iov_base = &rec;
+  vector[0].iov_len = sizeof (rec);
+  vector[1].iov_base = (char *)path;
+  vector[1].iov_len = rec.path_len;
+  journal_append (store, vector, 2);
+}
+
+static void
+journal_move (struct pack_store *store,
+	      const char *oldpath,
+	      struct pack_entry *entry)
+{
+  struct pack_record del, put;
+  struct iovec vector[4];
+
+  record_fill (&del, PACK_DEL, oldpath, NULL);
+  record_fill (&put, PACK_PUT, entry->path, entry);
+  vector[0].iov_base = &del;
+  vector[0].iov_len = sizeof (del);
+  vector[1].iov_base = (char *)oldpath;
+  vector[1].iov_len = del.path_len;
+  vector[2].iov_base = &put;
+  vector[2].iov_len = sizeof (put);
+  vector[3].iov_base = entry->path;
+  vector[3].iov_len = put.path_len;
+  journal_append (store, vector, 4);
+}
+
+static int
+journal_replay (struct pack_store *store)
+{
+  FILE *fp = fdopen (dup (store->journal_fd), "r");
+  struct pack_record rec;
+  char path[PATH_MAX];
+  off_t good = 0;
+
+  if (!fp)
+    return -1;
+  rewind (fp);
+
+  while (fread (&rec, sizeof (rec), 1, fp) == 1) {
+    struct pack_entry *entry;
+
+    if (rec.path_len == 0 || rec.path_len >= PATH_MAX ||
+	(rec.type != PACK_PUT && rec.type != PACK_DEL) ||
+	fread (path, 1, rec.path_len, fp) != rec.path_len)
+      break;
+    path[rec.path_len] = '\0';
+    good += sizeof (rec) + rec.path_len;
+    store->journal_records++;
+
+    entry = entry_find (store, path);
+    if (entry) {
+      entry_unlink (store, entry);
+      entry_put (entry);
+    }
+    if (rec.type == PACK_DEL)
+      continue;
+
+    entry = entry_new ();
+    entry->path = strdup (path);
+    entry->container = rec.container;
+    entry->offset = rec.offset;
+    entry->length = rec.length;
+    entry->ino = rec.ino;
+    entry->mode = rec.mode;
+    entry->uid = rec.uid;
+    entry->gid = rec.gid;
+    entry->atime = rec.atime;
+    entry->mtime = rec.mtime;
+    entry->ctime = rec.ctime;
+    entry_link (store, entry);
+    if (entry->ino >= store->next_ino)
+      store->next_ino = entry->ino + 1;
+  }
+
+  /* a record torn by a crash is cut off, appends go after the last whole one */
+  if (!feof (fp) || ftello (fp) != good) {
+    gf_log ("posix", LOG_NORMAL, "pack.c->journal_replay: dropping a torn record at %lld\n",
+	    (long long)good);
+    if (ftruncate (store->journal_fd, good) == -1)
+      gf_log ("posix", LOG_CRITICAL, "pack.c->journal_replay: %s\n", strerror (errno));
+  }
+  fclose (fp);
+  return 0;
+}
+
+/* a fresh journal with one record per entry, in place of the old one */
+static void
+journal_rewrite (struct pack_store *store)
+{
+  FILE *fp;
+  unsigned int i;
+  off_t records = 0;
+  int fd;
+
+  fd = openat (store->dir_fd, PACK_JOURNAL_NEW, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1 || !(fp = fdopen (fd, "w"))) {
+    if (fd != -1)
+      close (fd);
+    return;
+  }
+
+  for (i = 0; i < store->nr_buckets; i++) {
+    struct pack_entry *entry;
+
+    for (entry = store->entries[i]; entry; entry = entry->hash_next) {
+      struct pack_record rec;
+
+      record_fill (&rec, PACK_PUT, entry->path, entry);
+      fwrite (&rec, sizeof (rec), 1, fp);
+      fwrite (entry->path, 1, rec.path_len, fp);
+      records++;
+    }
+  }
+
+  if (fflush (fp) != 0 || fdatasync (fileno (fp)) != 0) {
+    fclose (fp);
+    unlinkat (store->dir_fd, PACK_JOURNAL_NEW, 0);
+    return;
+  }
+  fclose (fp);
+
+  if (renameat (store->dir_fd, PACK_JOURNAL_NEW, store->dir_fd, PACK_JOURNAL) == 0) {
+    fd = openat (store->dir_fd, PACK_JOURNAL, O_WRONLY | O_APPEND);
+    if (fd != -1) {
+      close (store->journal_fd);
+      store->journal_fd = fd;
+      store->journal_records = records;
+    }
+  }
+}
+
+/* containers */
+
+static int
+container_open (struct pack_store *store, int id, int create)
+{
+  struct pack_container *container = &store->containers[id];
+  char name[16];
+  struct stat stbuf;
+
+  sprintf (name, "%08x", id);
+  container->fd = openat (store->dir_fd, name,
+			  O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+  if (container->fd == -1)
+    return -1;
+  container->rfd = openat (store->dir_fd, name, O_RDONLY);
+  if (container->rfd == -1 || fstat (container->fd, &stbuf) == -1) {
+    if (container->rfd != -1)
+      close (container->rfd);
+    close (container->fd);
+    container->fd = -1;
+    return -1;
+  }
+  container->size = stbuf.st_size;
+  container->live = 0;
+  return 0;
+}
+
+static void
+container_close (struct pack_store *store, int id)
+{
+  struct pack_container *container = &store->containers[id];
+
+  if (container->fd == -1)
+    return;
+  close (container->rfd);
+  close (container->fd);
+  container->fd = -1;
+}
+
+/* the containers already there, by the hex number they are named by */
+static int
+containers_scan (struct pack_store *store)
+{
+  DIR *dir = fdopendir (dup (store->dir_fd));
+  struct dirent *dent;
+
+  if (!dir)
+    return -1;
+  while ((dent = readdir (dir))) {
+    char *end;
+    unsigned long id = strtoul (dent->d_name, &end, 16);
+
+    if (strlen (dent->d_name) != 8 || *end != '\0' || id >= INT32_MAX)
+      continue;
+    if ((int)id >= store->nr_containers) {
+      int i;
+
+      store->containers = realloc (store->containers,
+				   (id + 1) * sizeof (*store->containers));
+      for (i = store->nr_containers; i <= (int)id; i++)
+	store->containers[i].fd = -1;
+      store->nr_containers = id + 1;
+    }
+    if (container_open (store, id, 0) == -1) {
+      gf_log ("posix", LOG_CRITICAL, "pack.c->containers_scan: %s: %s\n",
+	      dent->d_name, strerror (errno));
+      closedir (dir);
+      return -1;
+    }
+  }
+  closedir (dir);
+  return 0;
+}
+
+/* a new container to fill, with append_lock held */
+static int
+container_rotate (struct pack_store *store)
+{
+  int id;
+
+  pthread_rwlock_wrlock (&store->lock);
+  id = store->nr_containers;
+  store->containers = realloc (store->containers,
+			       (id + 1) * sizeof (*store->containers));
+  store->containers[id].fd = -1;
+  store->nr_containers++;
+  if (container_open (store, id, 1) == -1) {
+    store->nr_containers--;
+    pthread_rwlock_unlock (&store->lock);
+    return -1;
+  }
+  store->active = id;
+  pthread_rwlock_unlock (&store->lock);
+  return 0;
+}
+
+/* data onto the end of the container being filled, where it went is
+   returned in *container and *offset */
+static int
+container_append (struct pack_store *store,
+		  const char *data,
+		  size_t len,
+		  int *container,
+		  off_t *offset)
+{
+  struct pack_container *active;
+
+  pthread_mutex_lock (&store->append_lock);
+  active = &store->containers[store->active];
+  if (active->size && active->size + len > store->container_size) {
+    if (container_rotate (store) == -1) {
+      pthread_mutex_unlock (&store->append_lock);
+      return -1;
+    }
+    active = &store->containers[store->active];
+  }
+
+  if (pwrite_all (active->fd, data, len, active->size) == -1) {
+    pthread_mutex_unlock (&store->append_lock);
+    return -1;
+  }
+  *container = store->active;
+  *offset = active->size;
+  active->size += len;
+  pthread_mutex_unlock (&store->append_lock);
+  return 0;
+}
+
+/*
+  Turning entries into regular files. The caller holds the lock of the
+  entry and the write lock; the entry is gone from the index afterwards.
+*/
+
+static int
+entry_fill (struct pack_store *store,
+	    struct pack_entry *entry,
+	    int fd)
+{
+  char buf[64 * 1024];
+  struct stat stbuf;
+  struct timespec times[2];
+  off_t done = 0;
+
+  if (entry->pending_fd != -1) {
+    if (fstat (entry->pending_fd, &stbuf) == -1)
+      return -1;
+    while (done < stbuf.st_size) {
+      ssize_t len = pread (entry->pending_fd, buf, sizeof (buf), done);
+
+      if (len <= 0 || pwrite_all (fd, buf, len, done) == -1)
+	return -1;
+      done += len;
+    }
+    times[0] = stbuf.st_atim;
+    times[1] = stbuf.st_mtim;
+  } else {
+    int rfd = store->containers[entry->container].rfd;
+
+    while (done < (off_t)entry->length) {
+      size_t chunk = entry->length - done;
+      ssize_t len;
+
+      if (chunk > sizeof (buf))
+	chunk = sizeof (buf);
+      len = pread_all (rfd, buf, chunk, entry->offset + done);
+      if (len != (ssize_t)chunk || pwrite_all (fd, buf, len, done) == -1) {
+	if (len >= 0)
+	  errno = EIO;
+	return -1;
+      }
+      done += len;
+    }
+    times[0].tv_sec = entry->atime;
+    times[0].tv_nsec = 0;
+    times[1].tv_sec = entry->mtime;
+    times[1].tv_nsec = 0;
+  }
+
+  if (fchown (fd, entry->uid, entry->gid) == -1)
+    gf_log ("posix", LOG_DEBUG, "pack.c->entry_fill: chown of %s: %s\n",
+	    entry->path, strerror (errno));
+  futimens (fd, times);
+  return 0;
+}
+
+static int
+entry_unpack (struct pack_store *store, struct pack_entry *entry)
+{
+  int fd = store->ops.create (store->ops.data, entry->path, entry->mode);
+  int op_errno;
+
+  if (fd == -1)
+    return -1;
+  if (entry_fill (store, entry, fd) == -1) {
+    op_errno = errno;
+    close (fd);
+    store->ops.remove (store->ops.data, entry->path);
+    errno = op_errno;
+    return -1;
+  }
+
+  entry_unlink (store, entry);
+  journal_del (store, entry->path);
+  if (entry->pending_fd != -1) {
+    /* whoever has the file open now has the regular one */
+    dup2 (fd, entry->pending_fd);
+    pending_del (store, entry);
+  } else {
+    store->containers[entry->container].live -= entry->length;
+  }
+  close (fd);
+  entry_put (entry);
+  return 0;
+}
+
+/* the pending entry of fd, held, NULL if fd is not pending */
+static struct pack_entry *
+pending_hold (struct pack_store *store, int fd)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_rdlock (&store->lock);
+  entry = pending_find (store, fd);
+  if (entry)
+    entry_hold (entry);
+  pthread_rwlock_unlock (&store->lock);
+  return entry;
+}
+
+/* with the lock of the entry held, whether fd is still the entry's */
+static int
+spill_locked (struct pack_store *store, struct pack_entry *entry, int fd)
+{
+  int ret = 0;
+
+  pthread_rwlock_wrlock (&store->lock);
+  if (entry->pending_fd == fd)
+    ret = entry_unpack (store, entry);
+  pthread_rwlock_unlock (&store->lock);
+  return ret;
+}
+
+/* a pending file into the container being filled; one too big or with
+   no room for it becomes a regular file */
+static int
+pending_commit (struct pack_store *store, int fd)
+{
+  struct pack_entry *entry = pending_hold (store, fd);
+  struct stat stbuf;
+  char *buf = NULL;
+  int container;
+  off_t offset;
+  int ret = 0;
+
+  if (!entry)
+    return 0;
+  pthread_mutex_lock (&entry->lock);
+  if (fstat (fd, &stbuf) == -1) {
+    pthread_mutex_unlock (&entry->lock);
+    entry_put (entry);
+    return -1;
+  }
+
+  if (stbuf.st_size <= (off_t)store->threshold) {
+    buf = malloc (stbuf.st_size + 1);
+    if (pread_all (fd, buf, stbuf.st_size, 0) != stbuf.st_size ||
+	container_append (store, buf, stbuf.st_size, &container, &offset) == -1) {
+      free (buf);
+      buf = NULL;
+    }
+  }
+
+  pthread_rwlock_wrlock (&store->lock);
+  if (entry->pending_fd == fd && buf) {
+    entry->container = container;
+    entry->offset = offset;
+    entry->length = stbuf.st_size;
+    entry->atime = stbuf.st_atime;
+    entry->mtime = stbuf.st_mtime;
+    entry->ctime = stbuf.st_ctime;
+    store->containers[container].live += entry->length;
+    journal_put (store, entry);
+    pending_del (store, entry);
+  } else if (entry->pending_fd == fd) {
+    /* too big or no room in the containers, it goes on as a regular file */
+    ret = entry_unpack (store, entry);
+  }
+  pthread_rwlock_unlock (&store->lock);
+  pthread_mutex_unlock (&entry->lock);
+  entry_put (entry);
+
+  free (buf);
+  return ret;
+}
+
+/* compaction */
+
+struct pack_move {
+  char *path;
+  off_t offset;
+  size_t length;
+};
+
+static void
+compact_container (struct pack_store *store, int id)
+{
+  struct pack_move *moves = NULL;
+  int nr_moves = 0, alloced = 0, i;
+  struct pack_container *container;
+  unsigned int bucket;
+  char *buf = NULL;
+  int rfd;
+
+  pthread_rwlock_rdlock (&store->lock);
+  container = &store->containers[id];
+  rfd = container->rfd;
+  if (id == store->active || container->fd == -1 || !container->size ||
+      (container->size - container->live) * 100 <
+      container->size * store->compact_ratio) {
+    pthread_rwlock_unlock (&store->lock);
+    return;
+  }
+  for (bucket = 0; bucket < store->nr_buckets; bucket++) {
+    struct pack_entry *entry;
+
+    for (entry = store->entries[bucket]; entry; entry = entry->hash_next) {
+      if (entry->container != id || entry->pending_fd != -1)
+	continue;
+      if (nr_moves == alloced) {
+	alloced = alloced ? alloced * 2 : 64;
+	moves = realloc (moves, alloced * sizeof (*moves));
+      }
+      moves[nr_moves].path = strdup (entry->path);
+      moves[nr_moves].offset = entry->offset;
+      moves[nr_moves].length = entry->length;
+      nr_moves++;
+    }
+  }
+  pthread_rwlock_unlock (&store->lock);
+
+  /* only this thread closes containers, rfd stays good while copying */
+  if (store->threshold)
+    buf = malloc (store->threshold);
+  for (i = 0; i < nr_moves; i++) {
+    struct pack_entry *entry;
+    int to;
+    off_t offset;
+
+    if (moves[i].length > store->threshold)
+      buf = realloc (buf, moves[i].length);
+    if (pread_all (rfd, buf, moves[i].length,
+		   moves[i].offset) != (ssize_t)moves[i].length ||
+	container_append (store, buf, moves[i].length, &to, &offset) == -1)
+      break;
+
+    /* unless it was removed or rewritten meanwhile, the copy is the entry */
+    pthread_rwlock_wrlock (&store->lock);
+    entry = entry_find (store, moves[i].path);
+    if (entry && entry->container == id && entry->offset == moves[i].offset) {
+      entry->container = to;
+      entry->offset = offset;
+      store->containers[id].live -= entry->length;
+      store->containers[to].live += entry->length;
+      journal_put (store, entry);
+    }
+    pthread_rwlock_unlock (&store->lock);
+  }
+  for (i = 0; i < nr_moves; i++)
+    free (moves[i].path);
+  free (moves);
+  free (buf);
+
+  pthread_rwlock_wrlock (&store->lock);
+  if (!store->containers[id].live) {
+    char name[16];
+
+    /* the copies and their records are on disk before the original goes */
+    fdatasync (store->containers[store->active].fd);
+    fdatasync (store->journal_fd);
+    sprintf (name, "%08x", id);
+    container_close (store, id);
+    unlinkat (store->dir_fd, name, 0);
+  }
+  pthread_rwlock_unlock (&store->lock);
+}
+
+static void *
+pack_compactor (void *arg)
+{
+  struct pack_store *store = arg;
+
+  while (1) {
+    struct timespec until;
+    int id, nr;
+
+    clock_gettime (CLOCK_REALTIME, &until);
+    until.tv_sec += PACK_COMPACT_INTERVAL;
+    pthread_mutex_lock (&store->stop_lock);
+    while (!store->stopping &&
+	   pthread_cond_timedwait (&store->stop_cond, &store->stop_lock,
+				   &until) != ETIMEDOUT)
+      ;
+    pthread_mutex_unlock (&store->stop_lock);
+    if (store->stopping)
+      break;
+
+    pthread_rwlock_rdlock (&store->lock);
+    nr = store->nr_containers;
+    pthread_rwlock_unlock (&store->lock);
+    for (id = 0; id < nr && !store->stopping; id++)
+      compact_container (store, id);
+
+    pthread_rwlock_wrlock (&store->lock);
+    if (store->journal_records > 2 * (off_t)store->nr_entries + 4096)
+      journal_rewrite (store);
+    pthread_rwlock_unlock (&store->lock);
+  }
+  return NULL;
+}
+
+struct pack_store *
+pack_store_new (int root_fd,
+		size_t threshold,
+		off_t container_size,
+		int compact_ratio,
+		const struct pack_ops *ops)
+{
+  struct pack_store *store = calloc (1, sizeof (*store));
+  struct pack_entry *entry, *next;
+  struct stat stbuf;
+  unsigned int bucket;
+  int id;
+
+  pthread_rwlock_init (&store->lock, NULL);
+  pthread_mutex_init (&store->append_lock, NULL);
+  pthread_mutex_init (&store->stop_lock, NULL);
+  pthread_cond_init (&store->stop_cond, NULL);
+  store->ops = *ops;
+  store->threshold = threshold;
+  store->container_size = container_size;
+  store->compact_ratio = compact_ratio;
+  store->next_ino = (ino_t)1 << 48; /* clear of the inodes of the export */
+  store->nr_buckets = 1024;
+  store->entries = calloc (store->nr_buckets, sizeof (*store->entries));
+  store->nr_dir_buckets = 256;
+  store->dirs = calloc (store->nr_dir_buckets, sizeof (*store->dirs));
+  store->journal_fd = -1;
+
+  if (fstat (root_fd, &stbuf) == 0)
+    store->dev = stbuf.st_dev;
+  if (mkdirat (root_fd, PACK_DIR, 0700) == -1 && errno != EEXIST)
+    goto err;
+  store->dir_fd = openat (root_fd, PACK_DIR, O_RDONLY | O_DIRECTORY);
+  if (store->dir_fd == -1)
+    goto err;
+  store->journal_fd = openat (store->dir_fd, PACK_JOURNAL,
+			      O_RDWR | O_CREAT | O_APPEND, 0600);
+  if (store->journal_fd == -1 || containers_scan (store) == -1 ||
+      journal_replay (store) == -1)
+    goto err;
+
+  /* live bytes per container, entries of containers that are gone go
+     too; the data of those pending at a crash was in memory */
+  for (bucket = 0; bucket < store->nr_buckets; bucket++) {
+    entry = store->entries[bucket];
+
+    while (entry) {
+      next = entry->hash_next;
+
+      if (entry->container == -1) {
+	entry->pending_next = store->pending;
+	store->pending = entry;
+      } else if (entry->container >= store->nr_containers ||
+		 store->containers[entry->container].fd == -1) {
+	gf_log ("posix", LOG_CRITICAL, "pack.c->pack_store_new: container of %s missing, dropped\n",
+		entry->path);
+	entry_unlink (store, entry);
+	journal_del (store, entry->path);
+	entry_put (entry);
+      } else {
+	store->containers[entry->container].live += entry->length;
+      }
+      entry = next;
+    }
+  }
+
+  store->active = -1;
+  for (id = store->nr_containers - 1; id >= 0; id--) {
+    if (store->containers[id].fd != -1) {
+      if (store->containers[id].size < container_size)
+	store->active = id;
+      break;
+    }
+  }
+  if (store->active == -1 && container_rotate (store) == -1)
+    goto err;
+
+  /* like a regular file never synced, what was pending is there empty */
+  for (entry = store->pending; entry; entry = next) {
+    next = entry->pending_next;
+    gf_log ("posix", LOG_NORMAL, "pack.c->pack_store_new: %s was not synced, it is empty\n",
+	    entry->path);
+    entry->pending_next = NULL;
+    entry->container = store->active;
+    entry->offset = 0;
+    entry->length = 0;
+    journal_put (store, entry);
+  }
+  store->pending = NULL;
+
+  if (pthread_create (&store->compactor, NULL, pack_compactor, store) != 0)
+    goto err;
+  return store;
+
+ err:
+  gf_log ("posix", LOG_CRITICAL, "pack.c->pack_store_new: %s\n", strerror (errno));
+  store->compactor = 0;
+  pack_store_destroy (store);
+  return NULL;
+}
+
+void
+pack_store_destroy (struct pack_store *store)
+{
+  unsigned int bucket;
+  int id;
+
+  if (store->compactor) {
+    pthread_mutex_lock (&store->stop_lock);
+    store->stopping = 1;
+    pthread_cond_signal (&store->stop_cond);
+    pthread_mutex_unlock (&store->stop_lock);
+    pthread_join (store->compactor, NULL);
+  }
+
+  for (bucket = 0; bucket < store->nr_buckets; bucket++) {
+    while (store->entries[bucket]) {
+      struct pack_entry *entry = store->entries[bucket];
+
+      entry_unlink (store, entry);
+      entry_put (entry);
+    }
+  }
+  for (id = 0; id < store->nr_containers; id++)
+    container_close (store, id);
+  if (store->journal_fd != -1)
+    close (store->journal_fd);
+  if (store->dir_fd > 0)
+    close (store->dir_fd);
+
+  free (store->containers);
+  free (store->entries);
+  free (store->dirs);
+  pthread_cond_destroy (&store->stop_cond);
+  pthread_mutex_destroy (&store->stop_lock);
+  pthread_mutex_destroy (&store->append_lock);
+  pthread_rwlock_destroy (&store->lock);
+  free (store);
+}
+
+int
+pack_exists (struct pack_store *store, const char *path)
+{
+  int ret;
+
+  pthread_rwlock_rdlock (&store->lock);
+  ret = entry_find (store, path) != NULL;
+  pthread_rwlock_unlock (&store->lock);
+  return ret;
+}
+
+int
+pack_stat (struct pack_store *store,
+	   const char *path,
+	   struct stat *stbuf)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_rdlock (&store->lock);
+  entry = entry_find (store, path);
+  if (entry)
+    entry_stat (store, entry, stbuf);
+  pthread_rwlock_unlock (&store->lock);
+
+  if (!entry) {
+    errno = ENOENT;
+    return -1;
+  }
+  return 0;
+}
+
+/* fstat of an open file, with the attributes the index keeps for it
+   while it is pending */
+int
+pack_fstat (struct pack_store *store,
+	    int fd,
+	    struct stat *stbuf)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_rdlock (&store->lock);
+  entry = pending_find (store, fd);
+  if (entry)
+    entry_stat (store, entry, stbuf);
+  pthread_rwlock_unlock (&store->lock);
+
+  return entry ? 0 : fstat (fd, stbuf);
+}
+
+int
+pack_remove (struct pack_store *store, const char *path)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_wrlock (&store->lock);
+  entry = entry_find (store, path);
+  if (!entry) {
+    pthread_rwlock_unlock (&store->lock);
+    errno = ENOENT;
+    return -1;
+  }
+
+  entry_unlink (store, entry);
+  if (entry->pending_fd != -1) {
+    /* it goes away with its release */
+    pending_del (store, entry);
+  } else {
+    store->containers[entry->container].live -= entry->length;
+  }
+  journal_del (store, path);
+  entry_put (entry);
+  pthread_rwlock_unlock (&store->lock);
+  return 0;
+}
+
+/* with the write lock held, an entry already at newpath is replaced */
+static void
+entry_move (struct pack_store *store,
+	    struct pack_entry *entry,
+	    const char *newpath)
+{
+  struct pack_entry *old = entry_find (store, newpath);
+  char *oldpath = entry->path;
+
+  if (old) {
+    entry_unlink (store, old);
+    if (old->pending_fd != -1)
+      pending_del (store, old);
+    else
+      store->containers[old->container].live -= old->length;
+    entry_put (old);
+  }
+
+  entry_unlink (store, entry);
+  entry->path = strdup (newpath);
+  entry->ctime = time (NULL);
+  entry_link (store, entry);
+  journal_move (store, oldpath, entry);
+  free (oldpath);
+}
+
+int
+pack_rename (struct pack_store *store,
+	     const char *oldpath,
+	     const char *newpath)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_wrlock (&store->lock);
+  entry = entry_find (store, oldpath);
+  if (!entry) {
+    pthread_rwlock_unlock (&store->lock);
+    errno = ENOENT;
+    return -1;
+  }
+  if (strcmp (oldpath, newpath) != 0)
+    entry_move (store, entry, newpath);
+  pthread_rwlock_unlock (&store->lock);
+  return 0;
+}
+
+/* a directory was renamed, the entries below it follow */
+void
+pack_rename_dir (struct pack_store *store,
+		 const char *olddir,
+		 const char *newdir)
+{
+  struct pack_entry **moves = NULL;
+  int nr_moves = 0, alloced = 0, i;
+  int oldlen = strlen (olddir);
+  unsigned int bucket;
+
+  pthread_rwlock_wrlock (&store->lock);
+  for (bucket = 0; bucket < store->nr_dir_buckets; bucket++) {
+    struct pack_dir *dir;
+
+    for (dir = store->dirs[bucket]; dir; dir = dir->hash_next) {
+      if (strncmp (dir->path, olddir, oldlen) != 0 ||
+	  (dir->path[oldlen] != '\0' && dir->path[oldlen] != '/'))
+	continue;
+      if (nr_moves + dir->live > alloced) {
+	alloced = (nr_moves + dir->live) * 2;
+	moves = realloc (moves, alloced * sizeof (*moves));
+      }
+      for (i = 0; i < dir->count; i++) {
+	if (dir->slots[i].entry)
+	  moves[nr_moves++] = dir->slots[i].entry;
+      }
+    }
+  }
+
+  for (i = 0; i < nr_moves; i++) {
+    const char *rest = moves[i]->path + oldlen;
+    char *newpath = malloc (strlen (newdir) + strlen (rest) + 1);
+
+    strcpy (newpath, newdir);
+    strcat (newpath, rest);
+    entry_move (store, moves[i], newpath);
+    free (newpath);
+  }
+  pthread_rwlock_unlock (&store->lock);
+  free (moves);
+}
+
+int
+pack_setattr (struct pack_store *store,
+	      const char *path,
+	      int valid,
+	      const struct stat *attr)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_wrlock (&store->lock);
+  entry = entry_find (store, path);
+  if (!entry) {
+    pthread_rwlock_unlock (&store->lock);
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (valid & PACK_SET_MODE)
+    entry->mode = attr->st_mode & 07777;
+  if (valid & PACK_SET_OWNER) {
+    if (attr->st_uid != (uid_t)-1)
+      entry->uid = attr->st_uid;
+    if (attr->st_gid != (gid_t)-1)
+      entry->gid = attr->st_gid;
+  }
+  if (valid & PACK_SET_TIMES) {
+    entry->atime = attr->st_atime;
+    entry->mtime = attr->st_mtime;
+    if (entry->pending_fd != -1) {
+      struct timespec times[2] = {{attr->st_atime, 0}, {attr->st_mtime, 0}};
+
+      futimens (entry->pending_fd, times);
+    }
+  }
+  entry->ctime = time (NULL);
+  journal_put (store, entry);
+  pthread_rwlock_unlock (&store->lock);
+  return 0;
+}
+
+int
+pack_dir_busy (struct pack_store *store, const char *path)
+{
+  int busy;
+
+  pthread_rwlock_rdlock (&store->lock);
+  busy = dir_find (store, path, strlen (path), 0) != NULL;
+  pthread_rwlock_unlock (&store->lock);
+  return busy;
+}
+
+/* the packed names of directory path from seq on, '/' separated as
+   getdents has them; *next is where the next page starts */
+int
+pack_list (struct pack_store *store,
+	   const char *path,
+	   int seq,
+	   char *buf,
+	   size_t size,
+	   int *next)
+{
+  struct pack_dir *dir;
+  size_t used = 0;
+  int count = 0;
+  int full = 0;
+  int i;
+
+  pthread_rwlock_rdlock (&store->lock);
+  dir = dir_find (store, path, strlen (path), 0);
+  for (i = dir ? dir_seek (dir, seq) : 0; dir && i < dir->count; i++) {
+    struct pack_entry *entry = dir->slots[i].entry;
+    int len;
+
+    if (!entry)
+      continue;
+    len = strlen (entry->name);
+    if (used + len + 1 > size) {
+      full = 1;
+      seq = dir->slots[i].seq;
+      break;
+    }
+    memcpy (buf + used, entry->name, len);
+    used += len;
+    buf[used++] = '/';
+    count++;
+    seq = dir->slots[i].seq + 1;
+  }
+  pthread_rwlock_unlock (&store->lock);
+
+  if (used)
+    buf[used - 1] = '\0';
+  else if (size)
+    buf[0] = '\0';
+  *next = seq;
+
+  if (!count && full) {
+    /* not even one name fits */
+    errno = EINVAL;
+    return -1;
+  }
+  return count;
+}
+
+/* a new file, pending until pack_commit (); the fd to use for it */
+int
+pack_create (struct pack_store *store,
+	     const char *path,
+	     mode_t mode,
+	     uid_t uid,
+	     gid_t gid)
+{
+  struct pack_entry *entry;
+  int fd = memfd_create ("pack", MFD_CLOEXEC);
+
+  if (fd == -1)
+    return -1;
+
+  pthread_rwlock_wrlock (&store->lock);
+  if (entry_find (store, path)) {
+    pthread_rwlock_unlock (&store->lock);
+    close (fd);
+    errno = EEXIST;
+    return -1;
+  }
+  entry = entry_new ();
+  entry->ino = store->next_ino++;
+  entry->path = strdup (path);
+  entry->container = -1;
+  entry->mode = mode & 07777;
+  entry->uid = uid;
+  entry->gid = gid;
+  entry->atime = entry->mtime = entry->ctime = time (NULL);
+  entry->pending_fd = fd;
+  entry_link (store, entry);
+  entry->pending_next = store->pending;
+  store->pending = entry;
+  /* the name is there after a crash, the data once it is synced */
+  journal_put (store, entry);
+  pthread_rwlock_unlock (&store->lock);
+  return fd;
+}
+
+/* a packed file for reading: an fd of its container and where in it the
+   file is */
+int
+pack_open (struct pack_store *store,
+	   const char *path,
+	   int *fd,
+	   off_t *base,
+	   size_t *len)
+{
+  struct pack_entry *entry;
+
+  pthread_rwlock_rdlock (&store->lock);
+  entry = entry_find (store, path);
+  if (!entry || entry->pending_fd != -1) {
+    pthread_rwlock_unlock (&store->lock);
+    errno = entry ? EBUSY : ENOENT;
+    return -1;
+  }
+  *fd = dup (store->containers[entry->container].rfd);
+  *base = entry->offset;
+  *len = entry->length;
+  pthread_rwlock_unlock (&store->lock);
+  return (*fd == -1) ? -1 : 0;
+}
+
+/*
+  Around every change to a pending file, up to end. Past the threshold it
+  becomes a regular file first. Returns the entry while it is still
+  pending, the caller changes the file and hands it to pack_write_end ();
+  NULL when fd is a regular file now.
+*/
+struct pack_entry *
+pack_write_begin (struct pack_store *store, int fd, off_t end)
+{
+  struct pack_entry *entry = pending_hold (store, fd);
+
+  if (!entry)
+    return NULL;
+  pthread_mutex_lock (&entry->lock);
+  if (entry->pending_fd == fd &&
+      (end <= (off_t)store->threshold || spill_locked (store, entry, fd) == -1))
+    return entry;
+
+  pthread_mutex_unlock (&entry->lock);
+  entry_put (entry);
+  return NULL;
+}
+
+void
+pack_write_end (struct pack_store *store, struct pack_entry *entry)
+{
+  pthread_mutex_unlock (&entry->lock);
+  entry_put (entry);
+}
+
+/* a pending file becomes a regular one now, for fsync */
+int
+pack_spill (struct pack_store *store, int fd)
+{
+  struct pack_entry *entry = pending_hold (store, fd);
+  int ret;
+
+  if (!entry)
+    return 0;
+  pthread_mutex_lock (&entry->lock);
+  ret = spill_locked (store, entry, fd);
+  pthread_mutex_unlock (&entry->lock);
+  entry_put (entry);
+  return ret;
+}
+
+/* the release of a pending file */
+int
+pack_commit (struct pack_store *store, int fd)
+{
+  return pending_commit (store, fd);
+}
+
+/* path becomes a regular file, if it is in the index at all */
+int
+pack_unpack (struct pack_store *store, const char *path)
+{
+  struct pack_entry *entry;
+  int ret = 0;
+
+  pthread_rwlock_rdlock (&store->lock);
+  entry = entry_find (store, path);
+  if (entry)
+    entry_hold (entry);
+  pthread_rwlock_unlock (&store->lock);
+  if (!entry)
+    return 0;
+
+  /* unless it was removed meanwhile */
+  pthread_mutex_lock (&entry->lock);
+  pthread_rwlock_wrlock (&store->lock);
+  if (entry->dir)
+    ret = entry_unpack (store, entry);
+  pthread_rwlock_unlock (&store->lock);
+  pthread_mutex_unlock (&entry->lock);
+  entry_put (entry);
+  return ret;
+}
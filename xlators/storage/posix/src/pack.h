@@ -0,0 +1,159 @@
+#ifndef _PACK_H
+#define _PACK_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+  Small files packed into append-only containers. A file created through
+  open () is journaled at once and its data kept in memory; at its release
+  it is appended to the container being filled and its path, place and
+  attributes go to an index, kept in memory and journaled. An fsync writes
+  it out as a regular file, a crash before either leaves it there empty,
+  as of a regular file never synced. Reading it hands out the container
+  along with where the file is in it. A file growing over the threshold,
+  opened for writing again or given anything the index does not keep
+  (xattrs, links) is written out as a regular file and leaves the index.
+  A thread copies the live entries out of containers which are mostly
+  dead and removes them.
+*/
+
+#define PACK_DIR              ".glusterfs-pack" /* at the root of the export */
+#define PACK_CONTAINER_SIZE   (64 * 1024 * 1024)
+#define PACK_COMPACT_RATIO    50   /* percent dead before a container is compacted */
+#define PACK_COMPACT_INTERVAL 30   /* seconds between compaction passes */
+
+/* listing cookies of the packed names of a directory, after its own;
+   seq numbers the names of the directory in the order they came, a
+   removal between two pages does not move the others */
+#define PACK_COOKIE(seq)      (-(off_t)(seq) - 1)
+#define PACK_SEQ(cookie)      ((int)(-(cookie) - 1))
+
+/* what pack_setattr () changes */
+#define PACK_SET_MODE  1
+#define PACK_SET_OWNER 2
+#define PACK_SET_TIMES 4
+
+/* how posix makes the regular file an entry turns into, O_EXCL and
+   read-write, and removes it again should filling it fail */
+struct pack_ops {
+  int (*create) (void *data, const char *path, mode_t mode);
+  int (*remove) (void *data, const char *path);
+  void *data;
+};
+
+struct pack_dir;
+
+struct pack_entry {
+  struct pack_entry *hash_next;
+  struct pack_entry *pending_next;
+  unsigned int hash;
+  struct pack_dir *dir;
+  int dir_index;          /* within dir->slots */
+  char *path;
+  const char *name;       /* last component of path */
+  int container;          /* -1 while pending */
+  off_t offset;
+  size_t length;
+  ino_t ino;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  time_t atime;
+  time_t mtime;
+  time_t ctime;
+  int pending_fd;         /* the memfd of it until its release, or -1 */
+  pthread_mutex_t lock;   /* changes to the memfd, writing it out */
+  int refs;
+};
+
+/* a name of a directory, entry is NULL once removed until compacted */
+struct pack_slot {
+  struct pack_entry *entry;
+  int seq;
+};
+
+/* the packed names of one directory, for listings, in seq order */
+struct pack_dir {
+  struct pack_dir *hash_next;
+  unsigned int hash;
+  char *path;
+  struct pack_slot *slots;
+  int count;              /* slots in use, removed ones included */
+  int live;
+  int alloced;
+  int next_seq;
+};
+
+struct pack_container {
+  int fd;                 /* -1 for a slot not in use */
+  int rfd;                /* read-only, what readers get a dup of */
+  off_t size;
+  off_t live;             /* bytes of it still indexed */
+};
+
+struct pack_store {
+  pthread_rwlock_t lock;        /* the index and the container table */
+  pthread_mutex_t append_lock;  /* the container being filled */
+  struct pack_ops ops;
+  int dir_fd;
+  int journal_fd;
+  off_t journal_records;
+  size_t threshold;
+  off_t container_size;
+  int compact_ratio;
+  dev_t dev;
+  ino_t next_ino;
+
+  struct pack_entry **entries;  /* hashed on path */
+  unsigned int nr_buckets;
+  unsigned int nr_entries;
+  struct pack_dir **dirs;       /* hashed on path */
+  unsigned int nr_dir_buckets;
+  unsigned int nr_dirs;
+  struct pack_entry *pending;
+
+  struct pack_container *containers;
+  int nr_containers;
+  int active;
+
+  pthread_mutex_t stop_lock;
+  pthread_cond_t stop_cond;
+  pthread_t compactor;
+  char stopping;
+};
+
+struct pack_store *pack_store_new (int root_fd, size_t threshold,
+				   off_t container_size, int compact_ratio,
+				   const struct pack_ops *ops);
+void pack_store_destroy (struct pack_store *store);
+
+/* the index */
+int pack_exists (struct pack_store *store, const char *path);
+int pack_stat (struct pack_store *store, const char *path, struct stat *stbuf);
+int pack_fstat (struct pack_store *store, int fd, struct stat *stbuf);
+int pack_remove (struct pack_store *store, const char *path);
+int pack_rename (struct pack_store *store, const char *oldpath,
+		 const char *newpath);
+void pack_rename_dir (struct pack_store *store, const char *olddir,
+		      const char *newdir);
+int pack_setattr (struct pack_store *store, const char *path, int valid,
+		  const struct stat *attr);
+int pack_dir_busy (struct pack_store *store, const char *path);
+int pack_list (struct pack_store *store, const char *path, int seq,
+	       char *buf, size_t size, int *next);
+
+/* the files */
+int pack_create (struct pack_store *store, const char *path, mode_t mode,
+		 uid_t uid, gid_t gid);
+int pack_open (struct pack_store *store, const char *path, int *fd,
+	       off_t *base, size_t *len);
+struct pack_entry *pack_write_begin (struct pack_store *store, int fd,
+				     off_t end);
+void pack_write_end (struct pack_store *store, struct pack_entry *entry);
+int pack_spill (struct pack_store *store, int fd);
+int pack_commit (struct pack_store *store, int fd);
+int pack_unpack (struct pack_store *store, const char *path);
+
+#endif /* _PACK_H */
@@ -4,8 +4,139 @@
 #include "logging.h"
 #include "posix.h"
 #include "xlator.h"
+#include "common-utils.h"
 
 
+/* path was changed by a fop, with parent its directory got or lost it;
+   cached attributes of either go before the fop returns */
+static void
+posix_attr_changed (struct posix_private *priv,
+		    const char *path,
+		    int parent)
+{
+  if (priv->attr_cache)
+    attr_cache_invalidate (priv->attr_cache, path, parent);
+}
+
+/* the released fds of path, or of everything below it with tree, are of
+   files no longer there */
+static void
+posix_fds_stale (struct posix_private *priv,
+		 const char *path,
+		 int tree)
+{
+  if (!priv->fd_cache)
+    return;
+  if (tree)
+    fd_cache_invalidate_tree (priv->fd_cache, path);
+  else
+    fd_cache_invalidate (priv->fd_cache, path);
+}
+
+static void
+dir_stream_free (struct posix_dir_stream *stream)
+{
+  if (stream->shard_fd != -1)
+    close (stream->shard_fd);
+  close (stream->fd);
+  free (stream->path);
+  free (stream);
+}
+
+/* drop the streams of owner, or without one those of path and below,
+   then a stream some page is reading is not kept either */
+static void
+dir_stream_drop (struct posix_private *priv,
+		 const char *path,
+		 void *owner)
+{
+  struct posix_dir_stream **trav;
+  struct posix_dir_stream *drop = NULL;
+  int len = strlen (path);
+
+  pthread_mutex_lock (&priv->export->stream_lock);
+  if (!owner)
+    priv->export->stream_gen++;
+  trav = &priv->export->streams;
+  while (*trav) {
+    struct posix_dir_stream *stream = *trav;
+    int match;
+
+    if (owner)
+      match = (stream->owner == owner);
+    else
+      match = (strncmp (stream->path, path, len) == 0 &&
+	       (stream->path[len] == '\0' || stream->path[len] == '/' ||
+		len == 1));
+    if (match) {
+      *trav = stream->next;
+      stream->next = drop;
+      drop = stream;
+      priv->export->nr_streams--;
+    } else {
+      trav = &stream->next;
+    }
+  }
+  pthread_mutex_unlock (&priv->export->stream_lock);
+
+  while (drop) {
+    struct posix_dir_stream *next = drop->next;
+
+    dir_stream_free (drop);
+    drop = next;
+  }
+}
+
+/* packed small files, see pack.h: the regular file an entry turns into */
+static int
+posix_pack_create (void *data,
+		   const char *path,
+		   mode_t mode)
+{
+  struct posix_export *export = data;
+  struct dir_cache_entry *entry;
+  const char *name;
+  int fd;
+  int dirfd = dir_cache_get (export->dir_cache, path, 1, &name, &entry);
+
+  if (dirfd == -1)
+    return -1;
+  fd = openat (dirfd, name, O_CREAT | O_EXCL | O_RDWR, mode);
+  dir_cache_put (export->dir_cache, entry);
+  if (export->attr_cache)
+    attr_cache_invalidate (export->attr_cache, path, 1);
+  return fd;
+}
+
+static int
+posix_pack_remove (void *data,
+		   const char *path)
+{
+  struct posix_export *export = data;
+  struct dir_cache_entry *entry;
+  const char *name;
+  int ret;
+  int dirfd = dir_cache_get (export->dir_cache, path, 0, &name, &entry);
+
+  if (dirfd == -1)
+    return -1;
+  ret = unlinkat (dirfd, name, 0);
+  dir_cache_put (export->dir_cache, entry);
+  if (export->attr_cache)
+    attr_cache_invalidate (export->attr_cache, path, 1);
+  return ret;
+}
+
+/* path as a regular file, for what the pack does not keep */
+static int
+posix_pack_unpack (struct xlator *xl,
+		   const char *path)
+{
+  struct posix_private *priv = xl->private;
+
+  return priv->pack ? pack_unpack (priv->pack, path) : 0;
+}
+
 static int
 posix_getattr (struct xlator *xl,
 	       const char *path,
@@ -16,9 +147,24 @@ posix_getattr (struct xlator *xl,
     FUNCTION_CALLED;
   }
 
-  WITH_DIR_PREPENDED (path, real_path, 
-    return lstat (real_path, stbuf);
-  )		      
+  int ret;
+  if (priv->pack && pack_stat (priv->pack, path, stbuf) == 0)
+    return 0;
+  if (priv->attr_cache) {
+    switch (attr_cache_get (priv->attr_cache, path, stbuf)) {
+    case ATTR_CACHE_HIT:
+      return 0;
+    case ATTR_CACHE_NOENT:
+      return -1;
+    }
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    if (priv->attr_cache)
+      ret = attr_cache_stat (priv->attr_cache, path, dirfd, name, stbuf);
+    else
+      ret = fstatat (dirfd, name, stbuf, AT_SYMLINK_NOFOLLOW);
+  )
+  return ret;
 }
 
 
@@ -32,9 +178,25 @@ posix_readlink (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return readlink (real_path, dest, size);
-  )		      
+  int ret;
+  unsigned int gen = 0;
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (priv->attr_cache) {
+    ret = attr_cache_readlink (priv->attr_cache, path, dest, size);
+    if (ret != -1)
+      return ret;
+    gen = attr_cache_gen (priv->attr_cache, path);
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    ret = readlinkat (dirfd, name, dest, size);
+  )
+  /* only a target which fit is whole */
+  if (priv->attr_cache && ret >= 0 && ret < size)
+    attr_cache_put_link (priv->attr_cache, path, gen, dest, ret);
+  return ret;
 }
 
 static int
@@ -49,14 +211,21 @@ posix_mknod (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path, 
-    int ret = mknod (real_path, mode, dev);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    errno = EEXIST;
+    return -1;
+  }
+  WITH_NEW_PARENT_FD (path, 1, dirfd, name,
+    ret = mknodat (dirfd, name, mode, dev);
 
     if (ret == 0) {
-      chown (real_path, uid, gid);
+      fchownat (dirfd, name, uid, gid, 0);
     }
-    return ret;
-  )		      
+  )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 1);
+  return ret;
 }
 
 static int
@@ -70,14 +239,21 @@ posix_mkdir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path, 
-    int ret = mkdir (real_path, mode);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    errno = EEXIST;
+    return -1;
+  }
+  WITH_NEW_PARENT_FD (path, 1, dirfd, name,
+    ret = mkdirat (dirfd, name, mode);
 
     if (ret == 0) {
-      chown (real_path, uid, gid);
+      fchownat (dirfd, name, uid, gid, 0);
     }
-    return ret;
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 1);
+  return ret;
 }
 
 
@@ -89,12 +265,69 @@ posix_unlink (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return unlink (real_path);
-  )		      
+  int ret;
+  if (priv->pack && pack_remove (priv->pack, path) == 0) {
+    posix_attr_changed (priv, path, 1);
+    return 0;
+  }
+  /* before, a racing release must not keep the fd of what goes */
+  posix_fds_stale (priv, path, 0);
+  WITH_PARENT_FD (path, dirfd, name,
+    if (priv->trash)
+      ret = trash_unlink (priv->trash, dirfd, name);
+    else
+      ret = unlinkat (dirfd, name, 0);
+  )
+  /* it may have been a symlink some cached directory was opened through */
+  if (ret == 0) {
+    dir_cache_invalidate (priv->dir_cache, path);
+    dir_stream_drop (priv, path, NULL);
+    posix_attr_changed (priv, path, 1);
+  }
+  return ret;
 }
 
 
+/* a directory of the hashed layout holds its shards, empty ones go
+   before it does */
+static int
+posix_prune_shards (int fd, int depth)
+{
+  DIR *dir = fdopendir (fd);
+  struct dirent *dent;
+  int ret = 0;
+
+  if (!dir) {
+    close (fd);
+    return -1;
+  }
+
+  while (ret == 0 && (dent = readdir (dir))) {
+    if (strcmp (dent->d_name, ".") == 0 || strcmp (dent->d_name, "..") == 0)
+      continue;
+
+    if (depth == 0) {
+      int sub;
+
+      if (dent->d_name[0] != '.' || strlen (dent->d_name) != 3) {
+	errno = ENOTEMPTY;
+	ret = -1;
+	break;
+      }
+      sub = openat (dirfd (dir), dent->d_name, O_RDONLY | O_DIRECTORY);
+      if (sub == -1 || posix_prune_shards (sub, 1) != 0) {
+	ret = -1;
+	break;
+      }
+    }
+    /* a shard with entries left fails with ENOTEMPTY */
+    ret = unlinkat (dirfd (dir), dent->d_name, AT_REMOVEDIR);
+  }
+
+  closedir (dir);
+  return ret;
+}
+
 static int
 posix_rmdir (struct xlator *xl,
 	     const char *path)
@@ -103,9 +336,26 @@ posix_rmdir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path, 
-    return rmdir (real_path);
+  int ret = 0;
+  if (priv->pack && pack_dir_busy (priv->pack, path)) {
+    errno = ENOTEMPTY;
+    return -1;
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    if (priv->dir_cache->fanout) {
+      int fd = openat (dirfd, name, O_RDONLY | O_DIRECTORY);
+
+      ret = (fd == -1) ? -1 : posix_prune_shards (fd, 0);
+    }
+    if (ret == 0)
+      ret = unlinkat (dirfd, name, AT_REMOVEDIR);
   )
+  if (ret == 0) {
+    dir_cache_invalidate (priv->dir_cache, path);
+    dir_stream_drop (priv, path, NULL);
+    posix_attr_changed (priv, path, 1);
+  }
+  return ret;
 }
 
 
@@ -122,14 +372,21 @@ posix_symlink (struct xlator *xl,
     FUNCTION_CALLED;
   }
 
-  WITH_DIR_PREPENDED (newpath, real_newpath,
-    int ret = symlink (oldpath, real_newpath);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, newpath)) {
+    errno = EEXIST;
+    return -1;
+  }
+  WITH_NEW_PARENT_FD (newpath, 1, dirfd, name,
+    ret = symlinkat (oldpath, dirfd, name);
 
     if (ret == 0) {
-      lchown (real_newpath, uid, gid);
+      fchownat (dirfd, name, uid, gid, AT_SYMLINK_NOFOLLOW);
     }
-    return ret;
   )
+  if (ret == 0)
+    posix_attr_changed (priv, newpath, 1);
+  return ret;
 }
 
 static int
@@ -143,17 +400,57 @@ posix_rename (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (oldpath, real_oldpath,
-    WITH_DIR_PREPENDED (newpath, real_newpath,		      
-      int ret = rename (real_oldpath, real_newpath);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, oldpath)) {
+    /* a regular file at newpath is replaced, a directory is not */
+    WITH_NEW_PARENT_FD (newpath, 1, dirfd, name,
+      ret = unlinkat (dirfd, name, 0);
+    )
+    if (ret == -1 && errno != ENOENT)
+      return -1;
+    posix_fds_stale (priv, newpath, 0);
+    ret = pack_rename (priv->pack, oldpath, newpath);
+    posix_attr_changed (priv, oldpath, 1);
+    posix_attr_changed (priv, newpath, 1);
+    return ret;
+  }
+  posix_fds_stale (priv, oldpath, 1);
+  posix_fds_stale (priv, newpath, 1);
+  WITH_PARENT_FD (oldpath, old_dirfd, old_name,
+    WITH_NEW_PARENT_FD (newpath, 1, new_dirfd, new_name,
+      ret = renameat (old_dirfd, old_name, new_dirfd, new_name);
 			/*
       if (ret == 0) {
         chown (real_newpath, uid, gid);
       }
 			*/
-      return ret;
     )
   )
+  if (ret == 0) {
+    dir_cache_invalidate (priv->dir_cache, oldpath);
+    dir_cache_invalidate (priv->dir_cache, newpath);
+    dir_stream_drop (priv, oldpath, NULL);
+    dir_stream_drop (priv, newpath, NULL);
+    if (priv->attr_cache) {
+      attr_cache_invalidate_tree (priv->attr_cache, oldpath);
+      attr_cache_invalidate_tree (priv->attr_cache, newpath);
+      posix_attr_changed (priv, oldpath, 1);
+      posix_attr_changed (priv, newpath, 1);
+    }
+  }
+  if (ret == 0 && priv->pack) {
+    struct stat stbuf;
+
+    /* a packed file at newpath was replaced, packed files below a
+       directory move along with it */
+    pack_remove (priv->pack, newpath);
+    WITH_PARENT_FD (newpath, dirfd, name,
+      if (fstatat (dirfd, name, &stbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+	  S_ISDIR (stbuf.st_mode))
+	pack_rename_dir (priv->pack, oldpath, newpath);
+    )
+  }
+  return ret;
 }
 
 static int
@@ -167,16 +464,28 @@ posix_link (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (oldpath, real_oldpath,
-    WITH_DIR_PREPENDED (newpath, real_newpath, 		      
-      int ret = link (real_oldpath, real_newpath);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, newpath)) {
+    errno = EEXIST;
+    return -1;
+  }
+  if (posix_pack_unpack (xl, oldpath) == -1)
+    return -1;
+  WITH_PARENT_FD (oldpath, old_dirfd, old_name,
+    WITH_NEW_PARENT_FD (newpath, 1, new_dirfd, new_name,
+      ret = linkat (old_dirfd, old_name, new_dirfd, new_name, 0);
 
       if (ret == 0) {
-        chown (real_newpath, uid, gid);
+	fchownat (new_dirfd, new_name, uid, gid, 0);
       }
-      return ret;
     )
   )
+  /* st_nlink of oldpath moved too */
+  if (ret == 0) {
+    posix_attr_changed (priv, oldpath, 0);
+    posix_attr_changed (priv, newpath, 1);
+  }
+  return ret;
 }
 
 
@@ -189,9 +498,20 @@ posix_chmod (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return chmod (real_path, mode);
+  int ret;
+  if (priv->pack) {
+    struct stat attr;
+
+    attr.st_mode = mode;
+    if (pack_setattr (priv->pack, path, PACK_SET_MODE, &attr) == 0)
+      return 0;
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    ret = fchmodat (dirfd, name, mode, 0);
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
 }
 
 
@@ -205,9 +525,21 @@ posix_chown (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path, 
-    return lchown (real_path, uid, gid);
+  int ret;
+  if (priv->pack) {
+    struct stat attr;
+
+    attr.st_uid = uid;
+    attr.st_gid = gid;
+    if (pack_setattr (priv->pack, path, PACK_SET_OWNER, &attr) == 0)
+      return 0;
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    ret = fchownat (dirfd, name, uid, gid, AT_SYMLINK_NOFOLLOW);
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
 }
 
 
@@ -220,9 +552,21 @@ posix_truncate (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return truncate (real_path, offset);
+  int ret = -1;
+  if (posix_pack_unpack (xl, path) == -1)
+    return -1;
+  posix_fds_stale (priv, path, 0);
+  WITH_PARENT_FD (path, dirfd, name,
+    /* there is no truncateat () */
+    int fd = openat (dirfd, name, O_WRONLY);
+    if (fd != -1) {
+      ret = ftruncate (fd, offset);
+      close (fd);
+    }
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
 }
 
 
@@ -235,11 +579,314 @@ posix_utime (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return utime (real_path, buf);
+  int ret;
+  struct timespec times[2];
+
+  if (buf) {
+    times[0].tv_sec = buf->actime;
+    times[0].tv_nsec = 0;
+    times[1].tv_sec = buf->modtime;
+    times[1].tv_nsec = 0;
+  }
+  if (priv->pack) {
+    struct stat attr;
+
+    attr.st_atime = buf ? buf->actime : time (NULL);
+    attr.st_mtime = buf ? buf->modtime : attr.st_atime;
+    if (pack_setattr (priv->pack, path, PACK_SET_TIMES, &attr) == 0)
+      return 0;
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    ret = utimensat (dirfd, name, buf ? times : NULL, 0);
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
+}
+
+
+static struct posix_fd *
+posix_fd_get (struct posix_private *priv, int fd)
+{
+  if (fd < 0 || fd >= priv->nr_fds)
+    return NULL;
+  return &priv->fds[fd];
+}
+
+/* a pending file is changed under the lock of its entry, and written out
+   as a regular file first should it grow past the threshold; returns the
+   entry for posix_pack_end (), NULL if fd is not pending */
+static struct pack_entry *
+posix_pack_begin (struct posix_private *priv,
+		  int fd,
+		  off_t end)
+{
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  struct pack_entry *entry;
+
+  if (!pfd || !pfd->pack_pending)
+    return NULL;
+  entry = pack_write_begin (priv->pack, fd, end);
+  if (!entry)
+    pfd->pack_pending = 0;
+  return entry;
+}
+
+static void
+posix_pack_end (struct posix_private *priv,
+		struct pack_entry *entry)
+{
+  if (entry)
+    pack_write_end (priv->pack, entry);
+}
+
+/* how much of size at offset a packed file has, its fd is the container */
+static size_t
+posix_pack_clamp (struct posix_fd *pfd,
+		  off_t offset,
+		  size_t size)
+{
+  if (offset < 0 || offset >= (off_t)pfd->pack_len)
+    return 0;
+  if (size > pfd->pack_len - offset)
+    size = pfd->pack_len - offset;
+  return size;
+}
+
+/* keep whole extents reserved ahead of a file being written, so it grows
+   into contiguous blocks however the writes trickle in */
+static void
+posix_preallocate (struct posix_private *priv,
+		   int fd,
+		   off_t offset,
+		   size_t size)
+{
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  off_t extent = priv->prealloc_extent;
+  off_t last = offset + size;
+  off_t start, end;
+
+  /* a pending small file goes into a container at its release */
+  if (!extent || !pfd || pfd->pack_pending)
+    return;
+
+  /* writes to one fd can come from several acceptors */
+  pthread_mutex_lock (&priv->fd_lock);
+  if (last <= pfd->prealloc_end) {
+    pthread_mutex_unlock (&priv->fd_lock);
+    return;
+  }
+  start = (offset > pfd->prealloc_end) ? offset : pfd->prealloc_end;
+  end = (last / extent + 1) * extent;
+  pfd->prealloc_end = end;
+  pthread_mutex_unlock (&priv->fd_lock);
+
+  if (fallocate (fd, FALLOC_FL_KEEP_SIZE, start, end - start) == -1 &&
+      errno == EOPNOTSUPP) {
+    gf_log ("posix", LOG_NORMAL, "posix.c->posix_preallocate: not supported by %s, disabled\n",
+	    priv->base_path);
+    priv->prealloc_extent = 0;
+  }
+}
+
+/* gives back the blocks reserved past the end of a file written through
+   fd, preallocate-extent and size hints keep them with KEEP_SIZE; only
+   done once no other fd has the file open, it could still be growing.
+   Returns 1 when the file was cut */
+static int
+posix_trim_reserved (struct posix_private *priv,
+		     struct posix_fd *pfd,
+		     int fd,
+		     const char *path)
+{
+  struct stat stbuf;
+  struct timespec times[2];
+  off_t end;
+  int ret = 0;
+
+  if ((pfd->open_flags & O_ACCMODE) == O_RDONLY || pfd->pack_pending || pfd->packed)
+    return 0;
+  if (fstat (fd, &stbuf) == -1 || !S_ISREG (stbuf.st_mode))
+    return 0;
+
+  /* no more blocks than the data takes, only a hint can be past the end */
+  end = (stbuf.st_size + stbuf.st_blksize - 1) / stbuf.st_blksize * stbuf.st_blksize;
+  if (pfd->prealloc_end <= end && (off_t)stbuf.st_blocks * 512 <= end)
+    return 0;
+
+  /* the lease is only had by the sole opener, see trash_idle (); the
+     released fds of the file in the cache would hold it open too. Held
+     until the cut is done, an open of the file meanwhile waits for it;
+     the break is told with SIGURG, ignored, the default SIGIO would kill
+     the brick */
+  fcntl (fd, F_SETSIG, SIGURG);
+  if (fcntl (fd, F_SETLEASE, F_WRLCK) == -1) {
+    if (!priv->fd_cache)
+      return 0;
+    posix_fds_stale (priv, path, 0);
+    if (fcntl (fd, F_SETLEASE, F_WRLCK) == -1)
+      return 0;
+  }
+
+  /* ext4 ignores holes punched past the end, a truncate to the same size
+     frees the blocks there on ext4 and xfs alike; it does not change the
+     mtime of the file */
+  if (fstat (fd, &stbuf) == 0 && ftruncate (fd, stbuf.st_size) == 0) {
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1] = stbuf.st_mtim;
+    futimens (fd, times);
+    ret = 1;
+  }
+  fcntl (fd, F_SETLEASE, F_UNLCK);
+  return ret;
+}
+
+/* the O_DIRECT fd for a request this big, -1 to go through the cache */
+static int
+posix_direct_fd (struct posix_private *priv,
+		 int fd,
+		 size_t size)
+{
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  int direct_fd;
+
+  if (!priv->direct_io || size < priv->direct_min || !pfd)
+    return -1;
+
+  pthread_mutex_lock (&priv->fd_lock);
+  if (pfd->direct_fd == -1 && !pfd->direct_failed) {
+    pfd->direct_fd = direct_reopen (fd);
+    if (pfd->direct_fd == -1)
+      pfd->direct_failed = 1;
+  }
+  direct_fd = pfd->direct_fd;
+  pthread_mutex_unlock (&priv->fd_lock);
+
+  return direct_fd;
+}
+
+/*
+  Keep a file streamed through the cache from filling it: every
+  POSIX_STREAM_WINDOW bytes of sequential access the pages behind are
+  dropped. Written pages are sent to disk first and dropped a window
+  later, once they are clean.
+*/
+static void
+posix_stream_advise (struct posix_private *priv,
+		     int fd,
+		     off_t offset,
+		     ssize_t len,
+		     int is_write)
+{
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  off_t advised, dropped, pos;
+  int start_streaming = 0;
+
+  if (!priv->stream_fadvise || len <= 0 || !pfd)
+    return;
+
+  /* the offsets are moved under the lock, the advice is given outside */
+  pthread_mutex_lock (&priv->fd_lock);
+  if (offset != pfd->stream_pos) {
+    pfd->advised = offset;
+    pfd->dropped = offset;
+    pfd->stream_pos = offset + len;
+    pthread_mutex_unlock (&priv->fd_lock);
+    return;
+  }
+
+  pfd->stream_pos += len;
+  if (pfd->stream_pos - pfd->advised < POSIX_STREAM_WINDOW) {
+    pthread_mutex_unlock (&priv->fd_lock);
+    return;
+  }
+
+  if (!pfd->streaming) {
+    pfd->streaming = 1;
+    start_streaming = 1;
+  }
+  advised = pfd->advised;
+  dropped = pfd->dropped;
+  pos = pfd->stream_pos;
+  pfd->dropped = is_write ? advised : pos;
+  pfd->advised = pos;
+  pthread_mutex_unlock (&priv->fd_lock);
+
+  if (start_streaming) {
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise (fd, 0, 0, POSIX_FADV_NOREUSE);
+  }
+
+  if (is_write) {
+    sync_file_range (fd, advised, pos - advised, SYNC_FILE_RANGE_WRITE);
+    posix_fadvise (fd, dropped, advised - dropped, POSIX_FADV_DONTNEED);
+  } else {
+    posix_fadvise (fd, dropped, pos - dropped, POSIX_FADV_DONTNEED);
+  }
 }
 
+/*
+  Opening through the pack: a packed file read-only gets its container, a
+  new file starts as a pending one, a packed file opened any other way is made a
+  regular file first. Returns 0 when *fd is the pack's (-1 with errno set
+  on failure), -1 when the regular file is to be opened.
+*/
+static int
+posix_pack_open (struct xlator *xl,
+		 const char *path,
+		 int flags,
+		 mode_t mode,
+		 struct posix_fd *state,
+		 int *fd)
+{
+  struct posix_private *priv = xl->private;
+  struct stat stbuf;
+  int ret;
+
+  if (pack_exists (priv->pack, path)) {
+    if ((flags & O_CREAT) && (flags & O_EXCL)) {
+      *fd = -1;
+      errno = EEXIST;
+      return 0;
+    }
+    if ((flags & O_ACCMODE) == O_RDONLY && !(flags & O_TRUNC) &&
+	pack_open (priv->pack, path, fd, &state->pack_base, &state->pack_len) == 0) {
+      if (posix_fd_get (priv, *fd)) {
+	state->packed = 1;
+	return 0;
+      }
+      close (*fd);
+    }
+    if (pack_unpack (priv->pack, path) == -1) {
+      *fd = -1;
+      return 0;
+    }
+    return -1;
+  }
+
+  if (!(flags & O_CREAT))
+    return -1;
+  WITH_NEW_PARENT_FD (path, 1, dirfd, name,
+    ret = fstatat (dirfd, name, &stbuf, AT_SYMLINK_NOFOLLOW);
+  )
+  if (ret == 0 || errno != ENOENT)
+    return -1;
+
+  *fd = pack_create (priv->pack, path, mode, getuid (), getgid ());
+  if (*fd == -1) {
+    /* somebody else created it just now */
+    if (errno == EEXIST)
+      return posix_pack_open (xl, path, flags, mode, state, fd);
+    return -1;
+  }
+  if (!posix_fd_get (priv, *fd)) {
+    pack_remove (priv->pack, path);
+    close (*fd);
+    return -1;
+  }
+  state->pack_pending = 1;
+  return 0;
+}
 
 static int
 posix_open (struct xlator *xl,
@@ -253,22 +900,41 @@ posix_open (struct xlator *xl,
     FUNCTION_CALLED;
   }
   struct file_context *posix_ctx = calloc (1, sizeof (struct file_context));
-  WITH_DIR_PREPENDED (path, real_path,
-    int fd = open (real_path, flags, mode);
+  struct posix_fd state = {0,};
+  int fd = -1;
+
+  state.direct_fd = -1;
+  state.open_flags = flags;
+  if (priv->fd_cache) {
+    /* taken before the open, see fd-cache.h */
+    state.fd_gen = fd_cache_gen (priv->fd_cache, path);
+    fd = fd_cache_take (priv->fd_cache, path, flags);
+  }
+  if (fd == -1 &&
+      (!priv->pack || posix_pack_open (xl, path, flags, mode, &state, &fd) == -1)) {
+    WITH_NEW_PARENT_FD (path, flags & O_CREAT, dirfd, name,
+      fd = openat (dirfd, name, flags, mode);
+    )
+  }
 
-    {
-      posix_ctx->volume = xl;
-      posix_ctx->next = ctx->next;
-      *(int *)&posix_ctx->context = fd;
+  {
+    posix_ctx->volume = xl;
+    posix_ctx->next = ctx->next;
+    *(int *)&posix_ctx->context = fd;
     
-      ctx->next = posix_ctx;
-    }
+    ctx->next = posix_ctx;
+  }
 
-    if (fd > 0) {
-      ((struct posix_private *)xl->private)->stats.nr_files++;
-    }
-			
-  )
+  if (fd != -1 && (flags & (O_CREAT | O_TRUNC)))
+    posix_attr_changed (priv, path, flags & O_CREAT);
+
+  if (fd > 0) {
+    struct posix_fd *pfd = posix_fd_get (priv, fd);
+
+    __sync_fetch_and_add (&((struct posix_private *)xl->private)->stats.nr_files, 1);
+    if (pfd)
+      *pfd = state;
+  }
   return 0;
 }
 
@@ -291,21 +957,33 @@ posix_read (struct xlator *xl,
   if (tmp == NULL) {
     return -1;
   }
-  priv->read_value += size;
-  priv->interval_read += size;
   int fd = (int)tmp->context;
-  {
-    lseek (fd, offset, SEEK_SET);
-    len = read(fd, buf, size);
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  struct timeval start;
+
+  gettimeofday (&start, NULL);
+  if (pfd && pfd->packed) {
+    len = pread (fd, buf, posix_pack_clamp (pfd, offset, size),
+		 pfd->pack_base + offset);
+  } else {
+    int direct_fd = posix_direct_fd (priv, fd, size);
+
+    /* positional, the fd is shared by every thread serving the file */
+    if (direct_fd != -1)
+      len = direct_pread (fd, direct_fd, buf, size, offset);
+    else
+      len = pread (fd, buf, size, offset);
+    posix_stream_advise (priv, fd, offset, len, 0);
   }
+  io_meter_account (priv->meter, IO_METER_READ, len, &start);
   return len;
 }
 
 static int
-posix_write (struct xlator *xl,
+posix_readv (struct xlator *xl,
 	     const char *path,
-	     const char *buf,
-	     size_t size,
+	     const struct iovec *vector,
+	     int count,
 	     off_t offset,
 	     struct file_context *ctx)
 {
@@ -316,59 +994,320 @@ posix_write (struct xlator *xl,
   int len = 0;
   struct file_context *tmp;
   FILL_MY_CTX (tmp, ctx, xl);
-  
+
   if (tmp == NULL) {
     return -1;
   }
   int fd = (int)tmp->context;
-  priv->write_value += size;
-  priv->interval_write += size;
-
-  {
-    lseek (fd, offset, SEEK_SET);
-    len = write (fd, buf, size);
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+  struct timeval start;
+
+  gettimeofday (&start, NULL);
+  if (pfd && pfd->packed) {
+    /* no further than the end of the file within its container */
+    struct iovec *trimmed = malloc (count * sizeof (*trimmed));
+    size_t left = posix_pack_clamp (pfd, offset, SIZE_MAX);
+    int i;
+
+    for (i = 0; i < count; i++) {
+      trimmed[i] = vector[i];
+      if (trimmed[i].iov_len > left)
+	trimmed[i].iov_len = left;
+      left -= trimmed[i].iov_len;
+    }
+    len = preadv (fd, trimmed, count, pfd->pack_base + offset);
+    free (trimmed);
+  } else {
+    len = preadv (fd, vector, count, offset);
   }
-
+  posix_stream_advise (priv, fd, offset, len, 0);
+  io_meter_account (priv->meter, IO_METER_READ, len, &start);
   return len;
 }
 
 static int
-posix_statfs (struct xlator *xl,
-	      const char *path,
-	      struct statvfs *buf)
-{
-  struct posix_private *priv = xl->private;
-  if (priv->is_debug) {
-    FUNCTION_CALLED;
-  }
-  WITH_DIR_PREPENDED (path, real_path,
-    return statvfs (real_path, buf);
-  )
-}
-
-static int
-posix_flush (struct xlator *xl,
+posix_write (struct xlator *xl,
 	     const char *path,
+	     const char *buf,
+	     size_t size,
+	     off_t offset,
 	     struct file_context *ctx)
 {
   struct posix_private *priv = xl->private;
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  int len = 0;
   struct file_context *tmp;
   FILL_MY_CTX (tmp, ctx, xl);
-
+  
   if (tmp == NULL) {
     return -1;
   }
-  //int fd = (int)tmp->context;
-  return 0;
+  int fd = (int)tmp->context;
+  struct timeval start;
+
+  gettimeofday (&start, NULL);
+  struct pack_entry *held = posix_pack_begin (priv, fd, offset + size);
+  int direct_fd = posix_direct_fd (priv, fd, size);
+
+  posix_preallocate (priv, fd, offset, size);
+  if (direct_fd != -1)
+    len = direct_pwrite (fd, direct_fd, buf, size, offset);
+  else
+    len = pwrite (fd, buf, size, offset);
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  posix_stream_advise (priv, fd, offset, len, 1);
+  io_meter_account (priv->meter, IO_METER_WRITE, len, &start);
+
+  return len;
 }
 
 static int
-posix_release (struct xlator *xl,
-	       const char *path,
-	       struct file_context *ctx)
+posix_writev (struct xlator *xl,
+	      const char *path,
+	      const struct iovec *vector,
+	      int count,
+	      off_t offset,
+	      struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  int len = 0;
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  
+  if (tmp == NULL) {
+    return -1;
+  }
+  int fd = (int)tmp->context;
+  size_t size = 0;
+  struct timeval start;
+  struct pack_entry *held;
+  int direct_fd, i;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < count; i++)
+    size += vector[i].iov_len;
+  held = posix_pack_begin (priv, fd, offset + size);
+  direct_fd = posix_direct_fd (priv, fd, size);
+  posix_preallocate (priv, fd, offset, size);
+  if (direct_fd != -1) {
+    /* a piece at a time, streamed pieces are page aligned */
+    for (i = 0; i < count; i++) {
+      ssize_t ret = direct_pwrite (fd, direct_fd, vector[i].iov_base,
+				   vector[i].iov_len, offset + len);
+
+      if (ret < 0) {
+	if (!len)
+	  len = -1;
+	break;
+      }
+      len += ret;
+      if (ret < vector[i].iov_len)
+	break;
+    }
+  } else {
+    len = pwritev (fd, vector, count, offset);
+  }
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  posix_stream_advise (priv, fd, offset, len, 1);
+  io_meter_account (priv->meter, IO_METER_WRITE, len, &start);
+  return len;
+}
+
+static int
+posix_seek (struct xlator *xl,
+	    const char *path,
+	    off_t offset,
+	    int whence,
+	    off_t *result,
+	    struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  
+  if (tmp == NULL) {
+    return -1;
+  }
+  int fd = (int)(long)tmp->context;
+
+  if (whence != SEEK_DATA && whence != SEEK_HOLE) {
+    errno = EINVAL;
+    return -1;
+  }
+  {
+    struct posix_fd *pfd = posix_fd_get (priv, fd);
+
+    /* a packed file has no holes */
+    if (pfd && pfd->packed) {
+      if (offset < 0 || offset >= (off_t)pfd->pack_len) {
+	errno = ENXIO;
+	return -1;
+      }
+      *result = (whence == SEEK_DATA) ? offset : (off_t)pfd->pack_len;
+      return 0;
+    }
+  }
+  /* the position of the fd means nothing, all i/o is positional */
+  *result = lseek (fd, offset, whence);
+  return (*result == -1) ? -1 : 0;
+}
+
+static int
+posix_falloc (struct xlator *xl,
+	      const char *path,
+	      int keep_size,
+	      off_t offset,
+	      size_t len,
+	      struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  
+  if (tmp == NULL) {
+    return -1;
+  }
+  int fd = (int)(long)tmp->context;
+  struct pack_entry *held = posix_pack_begin (priv, fd, keep_size ? 0 : offset + len);
+  int ret = fallocate (fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, offset, len);
+
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  return ret;
+}
+
+static int
+posix_discard (struct xlator *xl,
+	       const char *path,
+	       off_t offset,
+	       size_t len,
+	       struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  
+  if (tmp == NULL) {
+    return -1;
+  }
+  int fd = (int)(long)tmp->context;
+  struct pack_entry *held = posix_pack_begin (priv, fd, 0);
+  int ret = fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len);
+
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  return ret;
+}
+
+static int
+posix_zerofill_fd (int fd,
+		   off_t offset,
+		   size_t len)
+{
+  static const char zeros[64 * 1024];
+  size_t done = 0;
+
+  if (fallocate (fd, FALLOC_FL_ZERO_RANGE, offset, len) == 0)
+    return 0;
+  if (errno != EOPNOTSUPP)
+    return -1;
+
+  /* a punched hole reads as zeros, allocate it again */
+  if (fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) == 0)
+    return fallocate (fd, 0, offset, len);
+  if (errno != EOPNOTSUPP)
+    return -1;
+
+  while (done < len) {
+    size_t chunk = (len - done < sizeof (zeros)) ? len - done : sizeof (zeros);
+    ssize_t ret = pwrite (fd, zeros, chunk, offset + done);
+
+    if (ret <= 0)
+      return -1;
+    done += ret;
+  }
+  return 0;
+}
+
+static int
+posix_zerofill (struct xlator *xl,
+		const char *path,
+		off_t offset,
+		size_t len,
+		struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  
+  if (tmp == NULL) {
+    return -1;
+  }
+  int fd = (int)(long)tmp->context;
+  struct pack_entry *held = posix_pack_begin (priv, fd, offset + len);
+  int ret = posix_zerofill_fd (fd, offset, len);
+
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  return ret;
+}
+
+static int
+posix_statfs (struct xlator *xl,
+	      const char *path,
+	      struct statvfs *buf)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  WITH_DIR_PREPENDED (path, real_path,
+    return statvfs (real_path, buf);
+  )
+}
+
+static int
+posix_flush (struct xlator *xl,
+	     const char *path,
+	     struct file_context *ctx)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+
+  if (tmp == NULL) {
+    return -1;
+  }
+  //int fd = (int)tmp->context;
+  return 0;
+}
+
+static int
+posix_release (struct xlator *xl,
+	       const char *path,
+	       struct file_context *ctx)
 {
   struct posix_private *priv = xl->private;
   if (priv->is_debug) {
@@ -384,7 +1323,36 @@ posix_release (struct xlator *xl,
 
   RM_MY_CTX (ctx, tmp);
   free (tmp);
-  ((struct posix_private *)xl->private)->stats.nr_files--;
+  __sync_fetch_and_sub (&((struct posix_private *)xl->private)->stats.nr_files, 1);
+  {
+    struct posix_fd *pfd = posix_fd_get (priv, fd);
+    unsigned int gen;
+    int keep = 0, flags;
+
+    if (pfd) {
+      /* the pack's fds are not the file's */
+      keep = (priv->fd_cache && !pfd->pack_pending && !pfd->packed);
+      /* a new small file goes into the pack now */
+      if (pfd->pack_pending && pack_commit (priv->pack, fd) == -1)
+	gf_log ("posix", LOG_CRITICAL, "posix.c->posix_release: %s lost: %s\n",
+		path, strerror (errno));
+      if (pfd->direct_fd != -1)
+	close (pfd->direct_fd);
+      if (posix_trim_reserved (priv, pfd, fd, path))
+	posix_attr_changed (priv, path, 0);
+      if (pfd->streaming)
+	posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+      /* cleared before the fd is cached, an open can take it from there */
+      flags = pfd->open_flags;
+      gen = pfd->fd_gen;
+      memset (pfd, 0, sizeof (*pfd));
+      pfd->direct_fd = -1;
+      if (keep && fd_cache_put (priv->fd_cache, path, flags, fd, gen) == -1)
+	keep = 0;
+    }
+    if (keep)
+      return 0;
+  }
   return close (fd);
 }
 
@@ -406,8 +1374,21 @@ posix_fsync (struct xlator *xl,
     return -1;
   }
   int fd = (int)tmp->context; 
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+
+  /* a pending file is only packed at its release, synced in its place
+     it has to become a regular file */
+  if (pfd && pfd->packed)
+    return 0;
+  if (pfd && pfd->pack_pending) {
+    if (pack_spill (priv->pack, fd) == -1)
+      return -1;
+    pfd->pack_pending = 0;
+  }
  
-  if (datasync)
+  if (priv->sync_batch)
+    ret = sync_batch_fsync (priv->sync_batch, fd, datasync);
+  else if (datasync)
     ret = fdatasync (fd);
   else
     ret = fsync (fd);
@@ -415,6 +1396,50 @@ posix_fsync (struct xlator *xl,
   return ret;
 }
 
+/* reserve the expected size of a new file, its length stays as it is */
+static int
+posix_size_hint (struct xlator *xl,
+		 const char *path,
+		 const char *value,
+		 size_t size)
+{
+  struct posix_private *priv = xl->private;
+  char hint_str[32] = {0,};
+  long long hint;
+  int fd, ret;
+
+  if (size >= sizeof (hint_str)) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy (hint_str, value, size);
+  if (str2size (hint_str, &hint) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!hint)
+    return 0;
+  /* a file that small stays in the pack */
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    if (hint <= (long long)priv->pack->threshold)
+      return 0;
+    if (pack_unpack (priv->pack, path) == -1)
+      return -1;
+  }
+
+  WITH_PARENT_FD (path, dirfd, name,
+    fd = openat (dirfd, name, O_WRONLY);
+  )
+  if (fd == -1)
+    return -1;
+
+  ret = fallocate (fd, FALLOC_FL_KEEP_SIZE, 0, hint);
+  if (ret == -1 && errno == EOPNOTSUPP)
+    ret = 0; /* only a hint */
+  close (fd);
+  return ret;
+}
+
 static int
 posix_setxattr (struct xlator *xl,
 		const char *path,
@@ -427,9 +1452,19 @@ posix_setxattr (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return lsetxattr (real_path, name, value, size, flags);
-  )
+  int ret;
+  if (strcmp (name, GF_XATTR_SIZE_HINT) == 0) {
+    ret = posix_size_hint (xl, path, value, size);
+  } else {
+    if (posix_pack_unpack (xl, path) == -1)
+      return -1;
+    WITH_DIR_PREPENDED (path, real_path,
+      ret = lsetxattr (real_path, name, value, size, flags);
+    )
+  }
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
 }
 
 static int
@@ -443,6 +1478,10 @@ posix_getxattr (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    errno = ENODATA;
+    return -1;
+  }
   WITH_DIR_PREPENDED (path, real_path,
     return lgetxattr (real_path, name, value, size);
   )
@@ -458,6 +1497,8 @@ posix_listxattr (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  if (priv->pack && pack_exists (priv->pack, path))
+    return 0;
   WITH_DIR_PREPENDED (path, real_path,
     return llistxattr (real_path, list, size);
   )
@@ -472,9 +1513,113 @@ posix_removexattr (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  if (priv->pack && pack_exists (priv->pack, path)) {
+    errno = ENODATA;
+    return -1;
+  }
+  int ret;
   WITH_DIR_PREPENDED (path, real_path,
-    return lremovexattr (real_path, name);
+    ret = lremovexattr (real_path, name);
   )
+  if (ret == 0)
+    posix_attr_changed (priv, path, 0);
+  return ret;
+}
+
+/* take the stream an earlier page of path left at offset, if any */
+static struct posix_dir_stream *
+dir_stream_take (struct posix_private *priv,
+		 const char *path,
+		 off_t offset)
+{
+  struct posix_dir_stream **trav;
+  struct posix_dir_stream *stream = NULL;
+
+  pthread_mutex_lock (&priv->export->stream_lock);
+  for (trav = &priv->export->streams; *trav; trav = &(*trav)->next) {
+    if ((*trav)->pos == offset && strcmp ((*trav)->path, path) == 0) {
+      stream = *trav;
+      *trav = stream->next;
+      priv->export->nr_streams--;
+      break;
+    }
+  }
+  pthread_mutex_unlock (&priv->export->stream_lock);
+
+  return stream;
+}
+
+/* keep stream for the next page, the oldest one goes if there are too many */
+static void
+dir_stream_give (struct posix_private *priv,
+		 struct posix_dir_stream *stream)
+{
+  struct posix_dir_stream *drop = NULL;
+
+  pthread_mutex_lock (&priv->export->stream_lock);
+  if (stream->gen != priv->export->stream_gen) {
+    pthread_mutex_unlock (&priv->export->stream_lock);
+    dir_stream_free (stream);
+    return;
+  }
+  stream->next = priv->export->streams;
+  priv->export->streams = stream;
+  if (++priv->export->nr_streams > POSIX_DIR_STREAMS) {
+    struct posix_dir_stream **trav = &priv->export->streams;
+
+    while ((*trav)->next)
+      trav = &(*trav)->next;
+    drop = *trav;
+    *trav = NULL;
+    priv->export->nr_streams--;
+  }
+  pthread_mutex_unlock (&priv->export->stream_lock);
+
+  if (drop)
+    dir_stream_free (drop);
+}
+
+static struct posix_dir_stream *
+dir_stream_open (struct xlator *xl,
+		 const char *path,
+		 off_t offset)
+{
+  struct posix_private *priv = xl->private;
+  struct posix_dir_stream *stream;
+  struct dir_cache_entry *entry;
+  const char *name;
+  unsigned int gen;
+  int dirfd;
+  int fd;
+
+  /* before the open, a rename racing with it makes the stream stale */
+  pthread_mutex_lock (&priv->export->stream_lock);
+  gen = priv->export->stream_gen;
+  pthread_mutex_unlock (&priv->export->stream_lock);
+
+  dirfd = dir_cache_get (priv->dir_cache, path, 0, &name, &entry);
+  if (dirfd == -1)
+    return NULL;
+  fd = openat (dirfd, name, O_RDONLY | O_DIRECTORY);
+  dir_cache_put (priv->dir_cache, entry);
+
+  if (fd == -1)
+    return NULL;
+
+  /* the cookie is a d_off handed out by an earlier page, or with the
+     hashed layout a shard and a count, see posix_getdents_hashed () */
+  if (offset && !priv->dir_cache->fanout && lseek (fd, offset, SEEK_SET) == -1) {
+    close (fd);
+    return NULL;
+  }
+
+  stream = calloc (1, sizeof (*stream));
+  stream->path = strdup (path);
+  stream->fd = fd;
+  stream->pos = offset;
+  stream->gen = gen;
+  stream->shard_fd = -1;
+  return stream;
 }
 
 static int
@@ -486,66 +1631,414 @@ posix_opendir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  int ret = 0;
-  WITH_DIR_PREPENDED (path, real_path,
-    DIR *dir = opendir (real_path);
-  if (!dir)
-    ret = -1;
+  /* keep it open, the first page is coming */
+  struct posix_dir_stream *stream = dir_stream_open (xl, path, 0);
+
+  if (!stream)
+    return -1;
+  stream->owner = ctx;
+  dir_stream_give (priv, stream);
+  return 0;
+}
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* the directories of a multi-disk brick are listed by its first disk */
+static int
+posix_dent_is_dir (int dirfd, struct linux_dirent64 *dent)
+{
+  struct stat stbuf;
+
+  if (dent->d_type != DT_UNKNOWN)
+    return dent->d_type == DT_DIR;
+  return stat_at (dirfd, dent->d_name, &stbuf) == 0 && S_ISDIR (stbuf.st_mode);
+}
+
+/*
+  A page of a directory of the hashed layout, its shards one after the
+  other. The cookie is the shard and the number of entries read of it,
+  so that a stream which is gone can be found again by reading that far.
+*/
+static int
+posix_getdents_hashed (struct xlator *xl,
+		       const char *path,
+		       off_t offset,
+		       char *buf,
+		       size_t size,
+		       off_t *next)
+{
+  static const char *dots[] = {".", ".."};
+  struct posix_private *priv = xl->private;
+  struct dir_cache *cache = priv->dir_cache;
+  int nr_shards = cache->fanout * cache->fanout;
+  struct posix_dir_stream *stream = dir_stream_take (priv, path, offset);
+  char dents[8192];
+  size_t used = 0;
+  int count = 0;
+  int full = 0;
+  off_t skip = 0;
+  off_t nth;
+  int shard;
+
+  if (!stream)
+    stream = dir_stream_open (xl, path, offset);
+  if (!stream)
+    return -1;
+  shard = SHARD_OF (stream->pos);
+  nth = SHARD_NTH (stream->pos);
+
+  /* shard 0 is the directory itself */
+  while (shard == 0 && !full) {
+    int len;
+
+    if (nth == 2 || priv->files_only) {
+      shard = 1;
+      nth = 0;
+      break;
+    }
+    len = strlen (dots[nth]);
+    if (used + len + 1 > size) {
+      full = 1;
+      break;
+    }
+    memcpy (buf + used, dots[nth], len);
+    used += len;
+    buf[used++] = '/';
+    nth++;
+    count++;
+  }
+
+  while (!full && shard <= nr_shards) {
+    int nread, bpos = 0;
+
+    if (stream->shard_fd == -1) {
+      char name[DIR_CACHE_SHARD_LEN + 1];
+
+      dir_cache_shard_nth (cache, shard - 1, name);
+      stream->shard_fd = openat (stream->fd, name, O_RDONLY | O_DIRECTORY);
+      stream->shard_off = 0;
+      if (stream->shard_fd == -1) {
+	if (errno != ENOENT) {
+	  dir_stream_free (stream);
+	  return -1;
+	}
+	shard++;
+	nth = 0;
+	continue;
+      }
+      skip = nth;
+      nth = 0;
+    }
+
+    nread = syscall (SYS_getdents64, stream->shard_fd, dents, sizeof (dents));
+    if (nread < 0) {
+      dir_stream_free (stream);
+      return -1;
+    }
+    if (nread == 0) {
+      close (stream->shard_fd);
+      stream->shard_fd = -1;
+      shard++;
+      nth = 0;
+      continue;
+    }
+
+    while (bpos < nread) {
+      struct linux_dirent64 *dent = (struct linux_dirent64 *)(dents + bpos);
+      int len = strlen (dent->d_name);
+      int shown = !skip &&
+	strcmp (dent->d_name, ".") != 0 && strcmp (dent->d_name, "..") != 0 &&
+	!(priv->files_only && posix_dent_is_dir (stream->shard_fd, dent));
+
+      if (shown && used + len + 1 > size) {
+	/* the rest of this batch belongs to the next page */
+	lseek (stream->shard_fd, stream->shard_off, SEEK_SET);
+	full = 1;
+	break;
+      }
+      if (skip) {
+	skip--;
+      } else if (shown) {
+	memcpy (buf + used, dent->d_name, len);
+	used += len;
+	buf[used++] = '/';
+	count++;
+      }
+
+      stream->shard_off = dent->d_off;
+      nth++;
+      bpos += dent->d_reclen;
+    }
+  }
+
+  if (used)
+    buf[used - 1] = '\0';
+  else if (size)
+    buf[0] = '\0';
+  stream->pos = SHARD_COOKIE (shard, nth);
+  *next = stream->pos;
+
+  if (shard > nr_shards)
+    dir_stream_free (stream);
   else
-    closedir (dir);
-  )		      
-  return ret;
+    dir_stream_give (priv, stream);
+
+  if (!count && shard <= nr_shards) {
+    /* not even one name fits */
+    errno = EINVAL;
+    return -1;
+  }
+  return count;
 }
 
+static int
+posix_getdents_dir (struct xlator *xl,
+		    const char *path,
+		    off_t offset,
+		    char *buf,
+		    size_t size,
+		    off_t *next)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->dir_cache->fanout)
+    return posix_getdents_hashed (xl, path, offset, buf, size, next);
+
+  struct posix_dir_stream *stream = dir_stream_take (priv, path, offset);
+  char dents[8192];
+  size_t used = 0;
+  int count = 0;
+  int full = 0;
+  int eof = 0;
+
+  if (!stream)
+    stream = dir_stream_open (xl, path, offset);
+  if (!stream)
+    return -1;
+
+  while (!full && !eof) {
+    int nread = syscall (SYS_getdents64, stream->fd, dents, sizeof (dents));
+    int bpos = 0;
+
+    if (nread < 0) {
+      dir_stream_free (stream);
+      return -1;
+    }
+    if (nread == 0)
+      eof = 1;
+
+    while (bpos < nread) {
+      struct linux_dirent64 *dent = (struct linux_dirent64 *)(dents + bpos);
+      int len = strlen (dent->d_name);
+
+      if ((priv->files_only && posix_dent_is_dir (stream->fd, dent)) ||
+	  (strcmp (path, "/") == 0 &&
+	   dir_cache_hidden (priv->dir_cache, dent->d_name))) {
+	stream->pos = dent->d_off;
+	bpos += dent->d_reclen;
+	continue;
+      }
+
+      if (used + len + 1 > size) {
+	/* the rest of this batch belongs to the next page */
+	lseek (stream->fd, stream->pos, SEEK_SET);
+	full = 1;
+	break;
+      }
+      memcpy (buf + used, dent->d_name, len);
+      used += len;
+      buf[used++] = '/';
+
+      stream->pos = dent->d_off;
+      count++;
+      bpos += dent->d_reclen;
+    }
+  }
+
+  if (used)
+    buf[used - 1] = '\0';
+  else if (size)
+    buf[0] = '\0';
+  *next = stream->pos;
+
+  if (eof)
+    dir_stream_free (stream);
+  else
+    dir_stream_give (priv, stream);
+
+  if (!count && !eof) {
+    /* not even one name fits */
+    errno = EINVAL;
+    return -1;
+  }
+  return count;
+}
+
+/* the directory itself, then the files packed into it */
+static int
+posix_getdents (struct xlator *xl,
+		const char *path,
+		off_t offset,
+		char *buf,
+		size_t size,
+		off_t *next)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  int count, seq;
+
+  if (!priv->pack || offset >= 0) {
+    count = posix_getdents_dir (xl, path, offset, buf, size, next);
+    if (count != 0 || !priv->pack)
+      return count;
+    offset = PACK_COOKIE (0);
+  }
+  count = pack_list (priv->pack, path, PACK_SEQ (offset), buf, size, &seq);
+  *next = PACK_COOKIE (seq);
+  return count;
+}
+
+/* plain read and write, where the kernel can not copy between the two */
+static ssize_t
+posix_copy_by_hand (int from_fd,
+		    off_t from_offset,
+		    int to_fd,
+		    off_t to_offset,
+		    size_t size)
+{
+  char *buf = malloc (POSIX_COPY_CHUNK);
+  size_t done = 0;
+
+  while (done < size) {
+    size_t chunk = size - done;
+    ssize_t len;
+
+    if (chunk > POSIX_COPY_CHUNK)
+      chunk = POSIX_COPY_CHUNK;
+    len = pread (from_fd, buf, chunk, from_offset + done);
+    if (len > 0)
+      len = pwrite (to_fd, buf, len, to_offset + done);
+    if (len <= 0) {
+      free (buf);
+      return (done || len == 0) ? (ssize_t)done : -1;
+    }
+    done += len;
+  }
+
+  free (buf);
+  return done;
+}
+
+/* copy_file_range does the work inside the kernel, reflinking where the
+   filesystem can */
+static int
+posix_copy (struct xlator *xl,
+	    const char *from,
+	    off_t from_offset,
+	    const char *to,
+	    off_t to_offset,
+	    size_t size)
+{
+  struct posix_private *priv = xl->private;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+  int from_fd, to_fd;
+  size_t done = 0;
+  int ret = 0;
+
+  if (size > GF_COPY_MAX)
+    size = GF_COPY_MAX;
+  if (posix_pack_unpack (xl, from) == -1 || posix_pack_unpack (xl, to) == -1)
+    return -1;
+
+  WITH_PARENT_FD (from, dirfd, name,
+    from_fd = openat (dirfd, name, O_RDONLY);
+  )
+  if (from_fd == -1)
+    return -1;
+
+  WITH_PARENT_FD (to, dirfd, name,
+    to_fd = openat (dirfd, name, O_WRONLY);
+  )
+  if (to_fd == -1) {
+    close (from_fd);
+    return -1;
+  }
+
+  while (done < size) {
+    loff_t in_off = from_offset + done;
+    loff_t out_off = to_offset + done;
+    ssize_t len = copy_file_range (from_fd, &in_off, to_fd, &out_off,
+				   size - done, 0);
+
+    if (len == -1 && (errno == ENOSYS || errno == EXDEV ||
+		      errno == EINVAL || errno == EOPNOTSUPP))
+      len = posix_copy_by_hand (from_fd, from_offset + done,
+				to_fd, to_offset + done, size - done);
+    if (len <= 0) {
+      if (len == -1 && !done)
+	ret = -1;
+      break;
+    }
+    done += len;
+  }
+
+  close (to_fd);
+  close (from_fd);
+  if (done)
+    posix_attr_changed (priv, to, 0);
+  return ret ? ret : (int)done;
+}
+
+/* the whole directory from offset on, as one '/' separated string */
 static char *
 posix_readdir (struct xlator *xl,
 	       const char *path,
 	       off_t offset)
 {
-  DIR *dir;
-  struct dirent *dirent = NULL;
-  int length = 0;
-  int buf_len = 0;
-  char *buf = calloc (1, 4096); // #define the value
-  int alloced = 4096;
   struct posix_private *priv = xl->private;
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  size_t alloced = GF_GETDENTS_PAGE;
+  size_t length = 0;
+  char *buf = malloc (alloced);
+  int count;
 
   if (!buf){
     gf_log ("posix", LOG_DEBUG, "posix.c->posix_readdir: failed to allocate buf for dir %s\n", path);
     return buf;
   }
 
-  WITH_DIR_PREPENDED (path, real_path,
-    dir = opendir (real_path);
-  )
-  
-  if (!dir){
-    gf_log ("posix", LOG_DEBUG, "posix.c->posix_readdir: failed to do opendir for %s\n", path);
-    return NULL;
-  }
+  while ((count = posix_getdents (xl, path, offset, buf + length,
+				  alloced - length, &offset)) > 0) {
+    length += strlen (buf + length);
+    buf[length++] = '/';
 
-  while ((dirent = readdir (dir))) {
-    if (!dirent)
-      break;
-    length += strlen (dirent->d_name) + 1;
-    if (length > alloced) {
-      alloced = length * 2;
+    if (alloced - length < GF_GETDENTS_PAGE) {
+      alloced *= 2;
       buf = realloc (buf, alloced);
-      if (!buf){
-	gf_log ("posix", LOG_DEBUG, "posix.c->posix_readdir: failed realloc for buf\n");
-	return buf;
-      }
     }
-    memcpy (&buf[buf_len], dirent->d_name, strlen (dirent->d_name) + 1);
-    buf_len = length;
-    buf[length - 1] = '/';
   }
-  buf[length - 1] = '\0';
 
-  closedir (dir);
+  if (count < 0) {
+    gf_log ("posix", LOG_DEBUG, "posix.c->posix_readdir: failed to read %s\n", path);
+    free (buf);
+    return NULL;
+  }
+
+  if (length)
+    buf[length - 1] = '\0';
+  else
+    buf[0] = '\0';
   return buf;
 }
 
@@ -558,6 +2051,9 @@ posix_releasedir (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  /* a stream opendir left and no page took */
+  if (ctx)
+    dir_stream_drop (priv, path, ctx);
   return 0;
 }
 
@@ -584,9 +2080,23 @@ posix_access (struct xlator *xl,
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  WITH_DIR_PREPENDED (path, real_path,
-    return access (real_path, mode);
+  int ret;
+  if (priv->pack && pack_exists (priv->pack, path))
+    return 0;
+  /* existence is all the cache can tell, and not through a symlink */
+  if (priv->attr_cache && mode == F_OK) {
+    struct stat stbuf;
+
+    ret = attr_cache_get (priv->attr_cache, path, &stbuf);
+    if (ret == ATTR_CACHE_NOENT)
+      return -1;
+    if (ret == ATTR_CACHE_HIT && !S_ISLNK (stbuf.st_mode))
+      return 0;
+  }
+  WITH_PARENT_FD (path, dirfd, name,
+    ret = faccessat (dirfd, name, mode, 0);
   )
+  return ret;
 }
 
 static int
@@ -606,8 +2116,12 @@ posix_ftruncate (struct xlator *xl,
     return -1;
   }
   int fd = (int)tmp->context;
+  struct pack_entry *held = posix_pack_begin (priv, fd, offset);
+  int ret = ftruncate (fd, offset);
 
-  return ftruncate (fd, offset);
+  posix_pack_end (priv, held);
+  posix_attr_changed (priv, path, 0);
+  return ret;
 }
 
 static int
@@ -627,18 +2141,289 @@ posix_fgetattr (struct xlator *xl,
     return -1;
   }
   int fd = (int)tmp->context;
+  struct posix_fd *pfd = posix_fd_get (priv, fd);
+
+  if (pfd && pfd->pack_pending)
+    return pack_fstat (priv->pack, fd, buf);
+  if (pfd && pfd->packed) {
+    if (pack_stat (priv->pack, path, buf) == 0)
+      return 0;
+    /* removed or renamed since, the container stands in for it */
+    if (fstat (fd, buf) == -1)
+      return -1;
+    buf->st_size = pfd->pack_len;
+    buf->st_blocks = (pfd->pack_len + 511) / 512;
+    return 0;
+  }
 
   return fstat (fd, buf);
 }
 
+/* whether the volume keeps anything about its export in memory or next
+   to it: caches, the pack, the trash */
+static int
+posix_keeps_state (struct xlator *xl)
+{
+  static char *options[] = {"fd-cache", "attr-cache", "pack-threshold",
+			    "trash-threshold", NULL};
+  data_t *dir_cache = dict_get (xl->options, "dir-fd-cache");
+  int i;
+
+  if (!dir_cache || atoi (dir_cache->data) > 0)
+    return 1;
+  for (i = 0; options[i]; i++) {
+    data_t *option = dict_get (xl->options, options[i]);
+    long long value = 0;
+
+    if (option && str2size (option->data, &value) == 0 && value > 0)
+      return 1;
+  }
+  return 0;
+}
+
+/*
+  The first volume exporting a directory sets up what is kept of it.
+  It also takes a flock of the directory, exclusive if it keeps state
+  there. Another glusterfsd on the same directory would change that state
+  behind its back. Volumes that keep nothing can share the directory.
+*/
+static struct posix_export *
+posix_export_new (struct xlator *xl, const char *path)
+{
+  struct posix_export *export = calloc (1, sizeof (*export));
+  int exclusive = posix_keeps_state (xl);
+  int nr_fds = getdtablesize ();
+
+  export->refs = 1;
+  export->root_fd = open (path, O_PATH | O_DIRECTORY);
+  if (export->root_fd == -1) {
+    gf_log ("posix", LOG_CRITICAL, "posix.c->init: %s: %s\n",
+	    path, strerror (errno));
+    exit (1);
+  }
+  export->lock_fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (export->lock_fd == -1 ||
+      flock (export->lock_fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) == -1) {
+    gf_log ("posix", LOG_CRITICAL, "posix.c->init: %s is in use by another process and one of them caches or packs it\n",
+	    path);
+    if (export->lock_fd != -1)
+      close (export->lock_fd);
+    close (export->root_fd);
+    free (export);
+    return NULL;
+  }
+
+  {
+    data_t *cache_size = dict_get (xl->options, "dir-fd-cache");
+    data_t *fanout = dict_get (xl->options, "hashed-dir-fanout");
+    int max = POSIX_DIR_CACHE_SIZE;
+    int shards = 0;
+
+    if (cache_size)
+      max = atoi (cache_size->data);
+    if (fanout)
+      shards = atoi (fanout->data);
+    if (shards < 0 || shards > POSIX_MAX_FANOUT) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: hashed-dir-fanout must be 0 to %d\n",
+	      POSIX_MAX_FANOUT);
+      exit (1);
+    }
+    export->dir_cache = dir_cache_new (export->root_fd, max, shards);
+    /* what the pack and the trash keep is reached through them only */
+    dir_cache_hide (export->dir_cache, PACK_DIR);
+    dir_cache_hide (export->dir_cache, TRASH_DIR);
+  }
+  pthread_mutex_init (&export->stream_lock, NULL);
+
+  {
+    data_t *threshold = dict_get (xl->options, "pack-threshold");
+    data_t *container_size = dict_get (xl->options, "pack-container-size");
+    data_t *compact_ratio = dict_get (xl->options, "pack-compact-ratio");
+    long long bytes = 0;
+    long long container_bytes = PACK_CONTAINER_SIZE;
+    int ratio = PACK_COMPACT_RATIO;
+
+    if (threshold && str2size (threshold->data, &bytes) != 0) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid pack-threshold \"%s\"\n",
+	      threshold->data);
+      bytes = 0;
+    }
+    if (container_size && (str2size (container_size->data, &container_bytes) != 0 ||
+			   container_bytes <= 0)) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid pack-container-size \"%s\"\n",
+	      container_size->data);
+      container_bytes = PACK_CONTAINER_SIZE;
+    }
+    if (compact_ratio)
+      ratio = atoi (compact_ratio->data);
+    if (ratio < 1 || ratio > 100)
+      ratio = PACK_COMPACT_RATIO;
+    if (bytes > container_bytes)
+      bytes = container_bytes;
+
+    if (bytes > 0) {
+      struct pack_ops ops = {posix_pack_create, posix_pack_remove, export};
+
+      export->pack = pack_store_new (export->root_fd, bytes, container_bytes,
+				       ratio, &ops);
+      if (!export->pack)
+	gf_log ("posix", LOG_CRITICAL, "posix.c->init: could not open the pack of %s, small files stay regular\n",
+		path);
+    }
+  }
+
+  {
+    data_t *entries = dict_get (xl->options, "attr-cache");
+    data_t *timeout = dict_get (xl->options, "attr-cache-timeout");
+    int max = entries ? atoi (entries->data) : 0;
+
+    if (max > 0)
+      export->attr_cache = attr_cache_new (max, timeout ? atoi (timeout->data) : 0);
+  }
+
+  {
+    data_t *threshold = dict_get (xl->options, "trash-threshold");
+    data_t *step = dict_get (xl->options, "trash-truncate-step");
+    data_t *rate = dict_get (xl->options, "trash-rate");
+    long long bytes = 0;
+    long long step_bytes = TRASH_STEP;
+    long long rate_bytes = TRASH_RATE;
+
+    if (threshold && str2size (threshold->data, &bytes) != 0) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid trash-threshold \"%s\"\n",
+	      threshold->data);
+      bytes = 0;
+    }
+    if (step && (str2size (step->data, &step_bytes) != 0 || step_bytes <= 0)) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid trash-truncate-step \"%s\"\n",
+	      step->data);
+      step_bytes = TRASH_STEP;
+    }
+    if (rate && (str2size (rate->data, &rate_bytes) != 0 || rate_bytes <= 0)) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid trash-rate \"%s\"\n",
+	      rate->data);
+      rate_bytes = TRASH_RATE;
+    }
+    if (bytes > 0) {
+      export->trash = trash_new (export->root_fd, bytes, step_bytes, rate_bytes);
+      if (!export->trash)
+	gf_log ("posix", LOG_CRITICAL, "posix.c->init: no trash in %s, large files are unlinked inline\n",
+		path);
+    }
+  }
+
+  if (nr_fds > POSIX_MAX_FDS)
+    nr_fds = POSIX_MAX_FDS;
+
+  {
+    data_t *entries = dict_get (xl->options, "fd-cache");
+    int max = entries ? atoi (entries->data) : 0;
+
+    /* released fds must leave room for open ones */
+    if (max > nr_fds / 2)
+      max = nr_fds / 2;
+    if (max > 0)
+      export->fd_cache = fd_cache_new (max);
+  }
+  return export;
+}
+
+static void
+posix_export_destroy (struct posix_export *export)
+{
+  while (export->streams) {
+    struct posix_dir_stream *next = export->streams->next;
+    dir_stream_free (export->streams);
+    export->streams = next;
+  }
+  if (export->pack)
+    pack_store_destroy (export->pack);
+  if (export->attr_cache)
+    attr_cache_destroy (export->attr_cache);
+  if (export->fd_cache)
+    fd_cache_destroy (export->fd_cache);
+  if (export->trash)
+    trash_destroy (export->trash);
+  dir_cache_destroy (export->dir_cache);
+  pthread_mutex_destroy (&export->stream_lock);
+  close (export->root_fd);
+  close (export->lock_fd);
+  free (export);
+}
+
+static struct posix_export *exports = NULL;
+static pthread_mutex_t exports_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* what is kept of the directory at path, set up by xl if no other volume
+   of the process exports it; otherwise its options for that are ignored */
+static struct posix_export *
+posix_export_get (struct xlator *xl, const char *path)
+{
+  struct posix_export *export;
+  struct stat stbuf;
+
+  if (stat (path, &stbuf) == -1) {
+    gf_log ("posix", LOG_CRITICAL, "posix.c->init: %s: %s\n",
+	    path, strerror (errno));
+    exit (1);
+  }
+
+  pthread_mutex_lock (&exports_lock);
+  for (export = exports; export; export = export->next)
+    if (export->dev == stbuf.st_dev && export->ino == stbuf.st_ino)
+      break;
+  if (export) {
+    export->refs++;
+    gf_log ("posix", LOG_NORMAL, "posix.c->init: %s is exported by another volume too, %s shares its caches, pack and trash\n",
+	    path, xl->name);
+  } else {
+    export = posix_export_new (xl, path);
+    if (export) {
+      export->dev = stbuf.st_dev;
+      export->ino = stbuf.st_ino;
+      export->next = exports;
+      exports = export;
+    }
+  }
+  pthread_mutex_unlock (&exports_lock);
+
+  return export;
+}
+
+static void
+posix_export_put (struct posix_export *export)
+{
+  struct posix_export **trav;
+
+  pthread_mutex_lock (&exports_lock);
+  if (--export->refs) {
+    pthread_mutex_unlock (&exports_lock);
+    return;
+  }
+  for (trav = &exports; *trav != export; trav = &(*trav)->next)
+    ;
+  *trav = export->next;
+  pthread_mutex_unlock (&exports_lock);
+
+  posix_export_destroy (export);
+}
+
 int
 init (struct xlator *xl)
 {
   struct posix_private *_private = calloc (1, sizeof (*_private));
 
   data_t *directory = dict_get (xl->options, "directory");
+  data_t *directories = dict_get (xl->options, "directories");
   data_t *debug = dict_get (xl->options, "debug");
 
+  if (directories) {
+    if (debug && strcasecmp (debug->data, "on") == 0)
+      _private->is_debug = 1;
+    xl->private = (void *)_private;
+    return multi_disk_init (xl, directories->data);
+  }
+
   if (!directory){
     gf_log ("posix", LOG_CRITICAL, "posix.c->init: export directory not specified in spec file\n");
     exit (1);
@@ -651,6 +2436,83 @@ init (struct xlator *xl)
   strcpy (_private->base_path, directory->data);
   _private->base_path_length = strlen (_private->base_path);
 
+  _private->export = posix_export_get (xl, _private->base_path);
+  if (!_private->export) {
+    free (_private);
+    return -1;
+  }
+  _private->root_fd = _private->export->root_fd;
+  _private->dir_cache = _private->export->dir_cache;
+  _private->pack = _private->export->pack;
+  _private->attr_cache = _private->export->attr_cache;
+  _private->fd_cache = _private->export->fd_cache;
+  _private->trash = _private->export->trash;
+
+  {
+    data_t *threads = dict_get (xl->options, "stat-threads");
+    data_t *parallel = dict_get (xl->options, "stat-parallel-threshold");
+    int nr_threads = POSIX_STAT_THREADS;
+
+    if (threads)
+      nr_threads = atoi (threads->data);
+    if (nr_threads > 0)
+      _private->stat_pool = stat_pool_new (nr_threads);
+
+    _private->stat_parallel = POSIX_STAT_PARALLEL;
+    if (parallel)
+      _private->stat_parallel = atoi (parallel->data);
+  }
+
+  {
+    data_t *extent = dict_get (xl->options, "preallocate-extent");
+    long long bytes = 0;
+
+    if (extent && str2size (extent->data, &bytes) != 0) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid preallocate-extent \"%s\"\n",
+	      extent->data);
+      bytes = 0;
+    }
+    if (bytes > 0)
+      _private->prealloc_extent = bytes;
+  }
+
+  {
+    data_t *direct_io = dict_get (xl->options, "direct-io");
+    data_t *direct_min = dict_get (xl->options, "direct-io-min-size");
+    data_t *stream_fadvise = dict_get (xl->options, "stream-fadvise");
+    long long bytes = POSIX_DIRECT_MIN;
+
+    if (direct_io && strcasecmp (direct_io->data, "on") == 0)
+      _private->direct_io = 1;
+    if (direct_min && str2size (direct_min->data, &bytes) != 0) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid direct-io-min-size \"%s\"\n",
+	      direct_min->data);
+      bytes = POSIX_DIRECT_MIN;
+    }
+    /* smaller than a block there is no aligned middle anyway */
+    _private->direct_min = (bytes < DIRECT_ALIGN) ? DIRECT_ALIGN : bytes;
+    if (stream_fadvise && strcasecmp (stream_fadvise->data, "on") == 0)
+      _private->stream_fadvise = 1;
+  }
+
+  {
+    data_t *fsync_batch = dict_get (xl->options, "fsync-batch");
+    data_t *window = dict_get (xl->options, "fsync-batch-window");
+
+    if (fsync_batch && strcasecmp (fsync_batch->data, "on") == 0) {
+      _private->sync_batch = sync_batch_new (window ? atoi (window->data) : 0);
+      if (!_private->sync_batch)
+	gf_log ("posix", LOG_CRITICAL, "posix.c->init: could not start the fsync thread, syncing inline\n");
+    }
+  }
+
+  _private->nr_fds = getdtablesize ();
+  if (_private->nr_fds > POSIX_MAX_FDS)
+    _private->nr_fds = POSIX_MAX_FDS;
+
+  _private->fds = calloc (_private->nr_fds, sizeof (struct posix_fd));
+  pthread_mutex_init (&_private->fd_lock, NULL);
+
   _private->is_debug = 0;
   if (debug && strcasecmp (debug->data, "on") == 0) {
     _private->is_debug = 1;
@@ -659,11 +2521,20 @@ init (struct xlator *xl)
   }
 
   {
-    /* Stats related variables */
-    gettimeofday (&_private->init_time, NULL);
-    gettimeofday (&_private->prev_fetch_time, NULL);
-    _private->max_read = 1;
-    _private->max_write = 1;
+    data_t *window = dict_get (xl->options, "stats-window");
+    data_t *calibrate_size = dict_get (xl->options, "disk-calibrate-size");
+    data_t *calibrate_interval = dict_get (xl->options, "disk-calibrate-interval");
+    long long bytes = IO_METER_CALIBRATE_SIZE;
+
+    if (calibrate_size && str2size (calibrate_size->data, &bytes) != 0) {
+      gf_log ("posix", LOG_CRITICAL, "posix.c->init: invalid disk-calibrate-size \"%s\"\n",
+	      calibrate_size->data);
+      bytes = IO_METER_CALIBRATE_SIZE;
+    }
+    _private->meter = io_meter_new (window ? atoi (window->data) : IO_METER_WINDOW,
+				    _private->root_fd, (bytes > 0) ? bytes : 0,
+				    calibrate_interval ? atoi (calibrate_interval->data) :
+				    IO_METER_CALIBRATE_INTERVAL);
   }
 
   xl->private = (void *)_private;
@@ -677,72 +2548,124 @@ fini (struct xlator *xl)
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
+  if (priv->multi_disk) {
+    multi_disk_fini (xl);
+    free (priv);
+    return;
+  }
+  if (priv->stat_pool)
+    stat_pool_destroy (priv->stat_pool);
+  if (priv->sync_batch)
+    sync_batch_destroy (priv->sync_batch);
+  io_meter_destroy (priv->meter);
+  free (priv->fds);
+  posix_export_put (priv->export);
   free (priv);
   return;
 }
 
+/* one getdents page of path, every name stat'ed relative to the directory,
+   large pages by the stat pool */
 static int
 posix_bulk_getattr (struct xlator *xl,
 		    const char *path,
-		    struct bulk_stat *bstbuf)
+		    off_t offset,
+		    struct bulk_stat *bstbuf,
+		    off_t *next)
 {
-  char rel_pathname[PATH_MAX] = {0,};
   struct posix_private *priv = xl->private;
-  char *curr_pathname = calloc (sizeof (char), PATH_MAX);
-  char *dirents = NULL;
-  int index = 0;
-
-  char real_path[PATH_MAX]; 
-  strcpy (real_path, ((struct posix_private *)xl->private)->base_path); 
-  strcpy (real_path+((struct posix_private *)xl->private)->base_path_length, path); 
-
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
-  
-  /*  GET_DIR_PRENDED(path, real_path);*/
-  
-  /* get stats for all the entries in the current directory */
-  dirents = posix_readdir (xl, path, 0);
- 
-  if (dirents){
-    char *filename = NULL;          
-    filename = strtok (dirents, "/");
-    /*filename = strtok (NULL, "/");*/
-    while (filename){
-      if (1/*strcmp (filename, "..")*/){
-	struct bulk_stat *curr = calloc (sizeof (struct bulk_stat), 1);
-	struct stat *stbuf = calloc (sizeof (struct stat), 1);
-	struct bulk_stat *prev_node = NULL, *ind_node = NULL;
-	curr->stbuf = stbuf;
-	ind_node = bstbuf;
-	while (ind_node){
-	  prev_node = ind_node;
-	  ind_node = ind_node->next;
-	}
-	//	curr->next = bstbuf->next;
-	if (strcmp ("/", path)){
-	  sprintf (rel_pathname, "%s/%s", path, filename);
-	} else {
-	  sprintf (rel_pathname, "%s%s", path, filename);
-	}
-	curr->pathname = strdup (filename);
-	memset (rel_pathname, 0, PATH_MAX);
-	prev_node->next = curr;
-	sprintf (curr_pathname, "%s/%s", real_path, filename);
-	lstat (curr_pathname, stbuf);
-	index++;
-      }else{
-	// NOPS: computer dictionary name for not doing anything :)
-	gf_log ("posix", LOG_DEBUG, "posix.c->posix_bulk_getattr: failed to do readdir for %s\n", path);
-	free (curr_pathname);
-	return -1;
-      }
-      filename = strtok (NULL, "/");
+  char *names, *filename, *saveptr = NULL;
+  struct bulk_stat **entries;
+  int count, fd, index = 0;
+
+  WITH_PARENT_FD (path, dirfd, name,
+    fd = openat (dirfd, name, O_PATH | O_DIRECTORY);
+  )
+  if (fd == -1) {
+    gf_log ("posix", LOG_DEBUG, "posix.c->posix_bulk_getattr: failed to open %s\n", path);
+    return -1;
+  }
+
+  names = malloc (GF_BULK_GETATTR_PAGE);
+  count = posix_getdents (xl, path, offset, names, GF_BULK_GETATTR_PAGE, next);
+  if (count <= 0) {
+    close (fd);
+    free (names);
+    return count;
+  }
+
+  if (priv->pack && *next < 0) {
+    /* a page of packed files, the index has their attributes */
+    int len = strlen (path);
+
+    for (filename = strtok_r (names, "/", &saveptr);
+	 filename && index < count;
+	 filename = strtok_r (NULL, "/", &saveptr)) {
+      struct bulk_stat *curr = calloc (1, sizeof (*curr));
+      char *full = malloc (len + strlen (filename) + 2);
+
+      strcpy (full, path);
+      if (len && path[len - 1] != '/')
+	strcat (full, "/");
+      strcat (full, filename);
+      curr->stbuf = calloc (1, sizeof (struct stat));
+      curr->pathname = strdup (filename);
+      pack_stat (priv->pack, full, curr->stbuf);
+      free (full);
+      curr->next = bstbuf->next;
+      bstbuf->next = curr;
+      index++;
     }
+    close (fd);
+    free (names);
+    return index;
   }
-  //return index; //index is number of files
-  return 0;
+
+  entries = calloc (count, sizeof (*entries));
+  for (filename = strtok_r (names, "/", &saveptr);
+       filename && index < count;
+       filename = strtok_r (NULL, "/", &saveptr)) {
+    struct bulk_stat *curr = calloc (1, sizeof (*curr));
+
+    curr->stbuf = calloc (1, sizeof (struct stat));
+    if (priv->dir_cache->fanout &&
+	strcmp (filename, ".") != 0 && strcmp (filename, "..") != 0) {
+      /* stat'ed through its shard, which is cut off again below */
+      curr->pathname = malloc (DIR_CACHE_SHARD_LEN + strlen (filename) + 2);
+      dir_cache_shard (priv->dir_cache, filename, curr->pathname);
+      curr->pathname[DIR_CACHE_SHARD_LEN] = '/';
+      strcpy (curr->pathname + DIR_CACHE_SHARD_LEN + 1, filename);
+    } else {
+      curr->pathname = strdup (filename);
+    }
+    entries[index++] = curr;
+  }
+  count = index;
+
+  if (priv->stat_pool && count >= priv->stat_parallel) {
+    stat_pool_run (priv->stat_pool, fd, entries, count);
+  } else {
+    for (index = 0; index < count; index++)
+      stat_at (fd, entries[index]->pathname, entries[index]->stbuf);
+  }
+
+  for (index = 0; index < count; index++) {
+    char *pathname = entries[index]->pathname;
+
+    if (strchr (pathname, '/'))
+      memmove (pathname, pathname + DIR_CACHE_SHARD_LEN + 1,
+	       strlen (pathname + DIR_CACHE_SHARD_LEN + 1) + 1);
+    entries[index]->next = bstbuf->next;
+    bstbuf->next = entries[index];
+  }
+
+  free (entries);
+  close (fd);
+  free (names);
+  return count;
 }
 
 static int
@@ -750,12 +2673,8 @@ posix_stats (struct xlator *xl,
 	     struct xlator_stats *stats)
 {
   struct statvfs buf;
-  struct timeval tv;
   struct posix_private *priv = (struct posix_private *)xl->private;
-  long avg_read = 0;
-  long avg_write = 0;
-  long _time_ms = 0; 
-  
+
   WITH_DIR_PREPENDED ("/", real_path,
 		      statvfs (real_path, &buf); // Get the file system related information.
 		      )
@@ -765,31 +2684,8 @@ posix_stats (struct xlator *xl,
   stats->free_disk = buf.f_bfree * buf.f_bsize; // Number of Free block in the filesystem.
   stats->disk_usage = (buf.f_bfree - buf.f_bavail) * buf.f_bsize;
 
-  /* Calculate read and write usage */
-  gettimeofday (&tv, NULL);
-  
-  /* Read */
-  _time_ms = (tv.tv_sec - priv->init_time.tv_sec) * 1000 +
-             ((tv.tv_usec - priv->init_time.tv_usec) / 1000);
-
-  avg_read = (_time_ms) ? (priv->read_value / _time_ms) : 0; /* KBps */
-  avg_write = (_time_ms) ? (priv->write_value / _time_ms) : 0; /* KBps */
-  
-  _time_ms = (tv.tv_sec - priv->prev_fetch_time.tv_sec) * 1000 +
-             ((tv.tv_usec - priv->prev_fetch_time.tv_usec) / 1000);
-  if (_time_ms && ((priv->interval_read / _time_ms) > priv->max_read)) {
-    priv->max_read = (priv->interval_read / _time_ms);
-  }
-  if (_time_ms && ((priv->interval_write / _time_ms) > priv->max_write)) {
-    priv->max_write = priv->interval_write / _time_ms;
-  }
-
-  stats->read_usage = avg_read / priv->max_read;
-  stats->write_usage = avg_write / priv->max_write;
-
-  gettimeofday (&(priv->prev_fetch_time), NULL);
-  priv->interval_read = 0;
-  priv->interval_write = 0;
+  /* throughput, iops, latencies and disk_speed */
+  io_meter_get (priv->meter, stats);
   return 0;
 }
 
@@ -829,5 +2725,13 @@ struct xlator_fops fops = {
   .access      = posix_access,
   .ftruncate   = posix_ftruncate,
   .fgetattr    = posix_fgetattr,
-  .bulk_getattr = posix_bulk_getattr
+  .bulk_getattr = posix_bulk_getattr,
+  .readv       = posix_readv,
+  .writev      = posix_writev,
+  .getdents    = posix_getdents,
+  .copy        = posix_copy,
+  .seek        = posix_seek,
+  .fallocate   = posix_falloc,
+  .discard     = posix_discard,
+  .zerofill    = posix_zerofill
 };
@@ -5,17 +5,37 @@
 #include <dirent.h>
 #include <sys/xattr.h>
 #include "xlator.h"
+#include "dir-cache.h"
+#include "stat-pool.h"
+#include "direct-io.h"
+#include "sync-batch.h"
+#include "multi-disk.h"
+#include "pack.h"
+#include "attr-cache.h"
+#include "fd-cache.h"
+#include "io-meter.h"
+#include "trash.h"
 
 // FIXME: possible portability issue if we ever run on other POSIX systems
 #include <linux/limits.h> 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 //#include <any_other_required_header>
 
 /* Note: This assumes that you have "xl" declared as the xlator struct */
 #define WITH_DIR_PREPENDED(path, var, code) do { \
   char var[PATH_MAX]; \
+  struct posix_private *_priv_##var = xl->private; \
   memset (var, 0, PATH_MAX);\
-  strcpy (var, ((struct posix_private *)xl->private)->base_path); \
-  strcpy (var+((struct posix_private *)xl->private)->base_path_length, path); \
+  strcpy (var, _priv_##var->base_path); \
+  if (dir_cache_backend (_priv_##var->dir_cache, path, \
+			 var + _priv_##var->base_path_length, \
+			 PATH_MAX - _priv_##var->base_path_length) == -1) \
+    return -1; \
   code ; \
 } while (0);
 
@@ -25,23 +45,134 @@
   strcpy (var+((struct posix_private *)xl->private)->base_path_length, path); \
 } while (0);
 
+/*
+  Resolve path relative to the export, dirfd is its parent directory and
+  name the last component, for use with the *at () calls. Returns -1
+  from the fop if the parent can not be opened. WITH_NEW_PARENT_FD is for
+  fops creating path, it makes the shard of the hashed layout if needed.
+*/
+#define WITH_NEW_PARENT_FD(path, create, dirfd, name, code) do { \
+  const char *name; \
+  struct dir_cache_entry *_entry_##dirfd; \
+  struct dir_cache *_cache_##dirfd = ((struct posix_private *)xl->private)->dir_cache; \
+  int dirfd = dir_cache_get (_cache_##dirfd, path, create, &name, &_entry_##dirfd); \
+  if (dirfd == -1) \
+    return -1; \
+  code ; \
+  dir_cache_put (_cache_##dirfd, _entry_##dirfd); \
+} while (0);
+
+#define WITH_PARENT_FD(path, dirfd, name, code) \
+  WITH_NEW_PARENT_FD (path, 0, dirfd, name, code)
+
+#ifndef O_PATH
+#define O_PATH O_RDONLY
+#endif
+
+#define POSIX_DIR_CACHE_SIZE 256 /* default number of cached directory fds */
+#define POSIX_DIR_STREAMS    64  /* directory streams kept open between pages */
+#define POSIX_STAT_THREADS   4   /* default threads of the stat pool */
+#define POSIX_STAT_PARALLEL  64  /* smallest bulk_getattr page stat'ed in parallel */
+#define POSIX_DIRECT_MIN     (256 * 1024) /* smallest request served with O_DIRECT */
+#define POSIX_STREAM_WINDOW  (8 * 1024 * 1024) /* streamed bytes between fadvise calls */
+#define POSIX_MAX_FDS        65536 /* fds above this get no per-fd state */
+#define POSIX_MAX_DISKS      64  /* directories of a multi-disk brick */
+#define POSIX_DISK_THREADS   1   /* default threads serving each disk */
+#define POSIX_MAX_FANOUT     256 /* shards per level of the hashed layout */
+#define POSIX_COPY_CHUNK     (1024 * 1024) /* buffer of a copy by read and write */
+
+/* a listing cookie of the hashed layout, shard 0 holds "." and ".." */
+#define SHARD_COOKIE(shard, nth) (((off_t)(shard) << 32) | (nth))
+#define SHARD_OF(cookie)         ((int)((cookie) >> 32))
+#define SHARD_NTH(cookie)        ((cookie) & 0xffffffff)
+
+/*
+  A directory fd left open after a getdents page, or by opendir, at the
+  cookie the next page starts from. A request for that path and cookie
+  continues it without opening or seeking the directory again. rename and
+  rmdir of the path drop it, and so does releasedir of the opendir.
+*/
+struct posix_dir_stream {
+  struct posix_dir_stream *next;
+  char *path;
+  void *owner;         /* context of the opendir, NULL after a getdents */
+  unsigned int gen;    /* of the streams when it was opened */
+  int fd;
+  off_t pos;
+  /* hashed layout: pos is the shard and the entries read of it */
+  int shard_fd;        /* -1 until the shard is opened */
+  off_t shard_off;     /* d_off within shard_fd */
+};
+
+/*
+  What posix keeps of an exported directory, shared by the volumes of the
+  process exporting it: two volumes of one spec, or the old and the new
+  graph of a reload. The first of them sets it up from its options, the
+  last one tears it down; posix_private has copies of the pointers.
+*/
+struct posix_export {
+  struct posix_export *next;
+  dev_t dev;
+  ino_t ino;
+  int refs;
+  int root_fd;                 /* O_PATH fd of the directory */
+  int lock_fd;                 /* flock of it, see posix_export_new () */
+  struct dir_cache *dir_cache;
+  struct posix_dir_stream *streams;
+  int nr_streams;
+  unsigned int stream_gen;     /* bumped when a path is dropped */
+  pthread_mutex_t stream_lock;
+  struct pack_store *pack;
+  struct attr_cache *attr_cache;
+  struct fd_cache *fd_cache;
+  struct trash *trash;
+};
+
+/* what posix remembers of an open file, indexed by its fd */
+struct posix_fd {
+  off_t prealloc_end;  /* reserved up to here */
+  off_t stream_pos;    /* where the next sequential access starts */
+  off_t advised;       /* start of the window not advised yet */
+  off_t dropped;       /* page cache dropped below here */
+  int direct_fd;       /* O_DIRECT twin of the fd, -1 if none */
+  char direct_failed;  /* do not try to open it again */
+  char streaming;
+  char pack_pending;   /* a new small file, still in memory */
+  char packed;         /* a packed file, the fd is its container */
+  off_t pack_base;     /* where in the container it starts */
+  size_t pack_len;
+  int open_flags;
+  unsigned int fd_gen;  /* of the fd cache when it was opened */
+};
+
 struct posix_private {
   int temp;
   char is_stateless;
   char is_debug;
   char base_path[PATH_MAX];
   int base_path_length;
+  struct posix_export *export; /* of base_path, shared with other volumes */
+  int root_fd;                 /* O_PATH fd of base_path */
+  struct dir_cache *dir_cache; /* fds of hot parent directories */
+  struct stat_pool *stat_pool; /* NULL when stat-threads is 0 */
+  int stat_parallel;
+  off_t prealloc_extent;       /* 0 unless preallocate-extent is set */
+  struct posix_fd *fds;
+  int nr_fds;
+  pthread_mutex_t fd_lock;     /* opening of direct fds, the offsets of posix_fd */
+  char direct_io;
+  size_t direct_min;
+  char stream_fadvise;
+  struct sync_batch *sync_batch; /* NULL unless fsync-batch is on */
+  struct multi_disk *multi_disk; /* NULL unless directories is set */
+  char files_only;             /* listings leave directories out */
+  struct pack_store *pack;     /* NULL unless pack-threshold is set */
+  struct attr_cache *attr_cache; /* NULL unless attr-cache is set */
+  struct fd_cache *fd_cache;   /* NULL unless fd-cache is set */
+  struct trash *trash;         /* NULL unless trash-threshold is set */
 
   struct xlator_stats stats; /* Statastics, provides activity of the server */
-  
-  struct timeval prev_fetch_time;
-  struct timeval init_time;
-  int max_read;            /* */
-  int max_write;           /* */
-  long interval_read;      /* Used to calculate the max_read value */
-  long interval_write;     /* Used to calculate the max_write value */
-  long long read_value;    /* Total read, from init */
-  long long write_value;   /* Total write, from init */
+  struct io_meter *meter;    /* throughput, latencies, speed of the disk */
 };
 
 #endif /* _POSIX_H */
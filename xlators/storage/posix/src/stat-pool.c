@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/sysmacros.h>
+
+#include "stat-pool.h"
+
+/* lstat of name under dirfd, through statx where the kernel has it */
+int
+stat_at (int dirfd, const char *name, struct stat *stbuf)
+{
+#ifdef STATX_BASIC_STATS
+  static int no_statx;
+  struct statx stx;
+
+  if (!no_statx) {
+    if (statx (dirfd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT,
+	       STATX_BASIC_STATS, &stx) == 0) {
+      memset (stbuf, 0, sizeof (*stbuf));
+      stbuf->st_dev = makedev (stx.stx_dev_major, stx.stx_dev_minor);
+      stbuf->st_ino = stx.stx_ino;
+      stbuf->st_mode = stx.stx_mode;
+      stbuf->st_nlink = stx.stx_nlink;
+      stbuf->st_uid = stx.stx_uid;
+      stbuf->st_gid = stx.stx_gid;
+      stbuf->st_rdev = makedev (stx.stx_rdev_major, stx.stx_rdev_minor);
+      stbuf->st_size = stx.stx_size;
+      stbuf->st_blksize = stx.stx_blksize;
+      stbuf->st_blocks = stx.stx_blocks;
+      stbuf->st_atim.tv_sec = stx.stx_atime.tv_sec;
+      stbuf->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+      stbuf->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+      stbuf->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+      stbuf->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+      stbuf->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+      return 0;
+    }
+    if (errno != ENOSYS)
+      return -1;
+    no_statx = 1;
+  }
+#endif
+  return fstatat (dirfd, name, stbuf, AT_SYMLINK_NOFOLLOW);
+}
+
+/* hand out the next entry of batch, called with the pool locked */
+static int
+batch_claim (struct stat_pool *pool, struct stat_batch *batch)
+{
+  int index = batch->claimed++;
+
+  if (batch->claimed == batch->count) {
+    struct stat_batch **trav = &pool->batches;
+
+    while (*trav != batch)
+      trav = &(*trav)->next;
+    *trav = batch->next;
+  }
+  return index;
+}
+
+static void
+batch_stat (struct stat_pool *pool, struct stat_batch *batch, int index)
+{
+  struct bulk_stat *entry = batch->entries[index];
+
+  stat_at (batch->dirfd, entry->pathname, entry->stbuf);
+
+  pthread_mutex_lock (&pool->lock);
+  if (++batch->done == batch->count)
+    pthread_cond_signal (&batch->cond);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+static void *
+stat_worker (void *arg)
+{
+  struct stat_pool *pool = arg;
+
+  pthread_mutex_lock (&pool->lock);
+  while (1) {
+    struct stat_batch *batch;
+    int index;
+
+    while (!pool->batches && !pool->stopping)
+      pthread_cond_wait (&pool->work, &pool->lock);
+    if (pool->stopping)
+      break;
+
+    batch = pool->batches;
+    index = batch_claim (pool, batch);
+    pthread_mutex_unlock (&pool->lock);
+
+    batch_stat (pool, batch, index);
+    pthread_mutex_lock (&pool->lock);
+  }
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+struct stat_pool *
+stat_pool_new (int nr_threads)
+{
+  struct stat_pool *pool = calloc (1, sizeof (*pool));
+  int i;
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work, NULL);
+  pool->threads = calloc (nr_threads, sizeof (pthread_t));
+
+  for (i = 0; i < nr_threads; i++) {
+    if (pthread_create (&pool->threads[i], NULL, stat_worker, pool) != 0)
+      break;
+    pool->nr_threads++;
+  }
+
+  return pool;
+}
+
+void
+stat_pool_destroy (struct stat_pool *pool)
+{
+  int i;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast (&pool->work);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < pool->nr_threads; i++)
+    pthread_join (pool->threads[i], NULL);
+
+  pthread_cond_destroy (&pool->work);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->threads);
+  free (pool);
+}
+
+void
+stat_pool_run (struct stat_pool *pool,
+	       int dirfd,
+	       struct bulk_stat **entries,
+	       int count)
+{
+  struct stat_batch batch = {0,};
+
+  if (count <= 0)
+    return;
+
+  batch.entries = entries;
+  batch.dirfd = dirfd;
+  batch.count = count;
+  pthread_cond_init (&batch.cond, NULL);
+
+  pthread_mutex_lock (&pool->lock);
+  batch.next = pool->batches;
+  pool->batches = &batch;
+  pthread_cond_broadcast (&pool->work);
+
+  /* do our share rather than sleep */
+  while (batch.claimed < batch.count) {
+    int index = batch_claim (pool, &batch);
+
+    pthread_mutex_unlock (&pool->lock);
+    batch_stat (pool, &batch, index);
+    pthread_mutex_lock (&pool->lock);
+  }
+
+  while (batch.done < batch.count)
+    pthread_cond_wait (&batch.cond, &pool->lock);
+  pthread_mutex_unlock (&pool->lock);
+
+  pthread_cond_destroy (&batch.cond);
+}
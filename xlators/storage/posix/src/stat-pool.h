@@ -0,0 +1,42 @@
+#ifndef _STAT_POOL_H
+#define _STAT_POOL_H
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include "xlator.h"
+
+/*
+  A few threads that stat the entries of a large directory page in
+  parallel, so a cold cache waits on several inode reads at a time
+  instead of one. The caller of stat_pool_run () takes entries of its
+  own batch as well and returns once every entry has been stat'ed.
+*/
+
+struct stat_batch {
+  struct stat_batch *next;
+  struct bulk_stat **entries;
+  int dirfd;
+  int count;
+  int claimed;  /* entries handed out so far */
+  int done;     /* entries stat'ed so far */
+  pthread_cond_t cond;
+};
+
+struct stat_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  struct stat_batch *batches;  /* with entries left to hand out */
+  pthread_t *threads;
+  int nr_threads;
+  char stopping;
+};
+
+struct stat_pool *stat_pool_new (int nr_threads);
+void stat_pool_destroy (struct stat_pool *pool);
+
+void stat_pool_run (struct stat_pool *pool, int dirfd,
+		    struct bulk_stat **entries, int count);
+
+int stat_at (int dirfd, const char *name, struct stat *stbuf);
+
+#endif /* _STAT_POOL_H */
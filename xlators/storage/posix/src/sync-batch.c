@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "sync-batch.h"
+
+static void
+waiter_sync (struct sync_waiter *waiter)
+{
+  if (waiter->datasync)
+    waiter->ret = fdatasync (waiter->fd);
+  else
+    waiter->ret = fsync (waiter->fd);
+  waiter->op_errno = (waiter->ret == -1) ? errno : 0;
+}
+
+/* one syncfs per filesystem for everybody on it, then each file for its
+   own writeback errors */
+static void
+batch_sync (struct sync_waiter *list)
+{
+  struct sync_waiter *trav, *other;
+
+  if (!list->next) {
+    waiter_sync (list);
+    return;
+  }
+
+  for (trav = list; trav; trav = trav->next) {
+    if (trav->synced)
+      continue;
+
+    syncfs (trav->fd);
+    for (other = trav; other; other = other->next) {
+      if (other->synced || other->dev != trav->dev)
+	continue;
+      waiter_sync (other);
+      other->synced = 1;
+    }
+  }
+}
+
+static void *
+sync_thread (void *arg)
+{
+  struct sync_batch *batch = arg;
+
+  pthread_mutex_lock (&batch->lock);
+  while (1) {
+    struct sync_waiter *list;
+
+    while (!batch->pending && !batch->stopping)
+      pthread_cond_wait (&batch->queued, &batch->lock);
+    if (!batch->pending && batch->stopping)
+      break;
+
+    /* a lone caller has nobody to wait for */
+    if (batch->window && batch->callers > 1) {
+      pthread_mutex_unlock (&batch->lock);
+      usleep (batch->window);
+      pthread_mutex_lock (&batch->lock);
+    }
+
+    list = batch->pending;
+    batch->pending = NULL;
+    pthread_mutex_unlock (&batch->lock);
+
+    batch_sync (list);
+
+    /* a waiter seeing done may return and take its entry with it */
+    pthread_mutex_lock (&batch->lock);
+    while (list) {
+      struct sync_waiter *next = list->next;
+
+      list->done = 1;
+      list = next;
+    }
+    pthread_cond_broadcast (&batch->synced);
+  }
+  pthread_mutex_unlock (&batch->lock);
+
+  return NULL;
+}
+
+struct sync_batch *
+sync_batch_new (int window)
+{
+  struct sync_batch *batch = calloc (1, sizeof (*batch));
+
+  pthread_mutex_init (&batch->lock, NULL);
+  pthread_cond_init (&batch->queued, NULL);
+  pthread_cond_init (&batch->synced, NULL);
+  batch->window = (window > 0) ? window : 0;
+
+  if (pthread_create (&batch->thread, NULL, sync_thread, batch) != 0) {
+    pthread_cond_destroy (&batch->synced);
+    pthread_cond_destroy (&batch->queued);
+    pthread_mutex_destroy (&batch->lock);
+    free (batch);
+    return NULL;
+  }
+
+  return batch;
+}
+
+void
+sync_batch_destroy (struct sync_batch *batch)
+{
+  pthread_mutex_lock (&batch->lock);
+  batch->stopping = 1;
+  pthread_cond_signal (&batch->queued);
+  pthread_mutex_unlock (&batch->lock);
+
+  pthread_join (batch->thread, NULL);
+
+  pthread_cond_destroy (&batch->synced);
+  pthread_cond_destroy (&batch->queued);
+  pthread_mutex_destroy (&batch->lock);
+  free (batch);
+}
+
+int
+sync_batch_fsync (struct sync_batch *batch,
+		  int fd,
+		  int datasync)
+{
+  struct sync_waiter waiter = {0,};
+  struct stat stbuf;
+
+  if (fstat (fd, &stbuf) == -1)
+    return -1;
+
+  waiter.fd = fd;
+  waiter.datasync = datasync;
+  waiter.dev = stbuf.st_dev;
+
+  pthread_mutex_lock (&batch->lock);
+  if (!batch->callers) {
+    batch->caller = pthread_self ();
+    batch->callers = 1;
+  } else if (!pthread_equal (batch->caller, pthread_self ())) {
+    batch->callers = 2;
+  }
+  waiter.next = batch->pending;
+  batch->pending = &waiter;
+  pthread_cond_signal (&batch->queued);
+
+  while (!waiter.done)
+    pthread_cond_wait (&batch->synced, &batch->lock);
+  pthread_mutex_unlock (&batch->lock);
+
+  errno = waiter.op_errno;
+  return waiter.ret;
+}
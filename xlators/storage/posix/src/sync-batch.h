@@ -0,0 +1,47 @@
+#ifndef _SYNC_BATCH_H
+#define _SYNC_BATCH_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/*
+  Group commit of fsyncs. Callers of sync_batch_fsync () queue up and
+  sleep; one thread takes everything queued, waits up to 'window'
+  microseconds for more, and syncs each filesystem in the batch once with
+  syncfs (), so concurrent fsyncs share one journal flush. A lone request
+  gets a plain fsync/fdatasync. Nobody is woken before its data is on
+  disk. syncfs () does not tell whose writeback failed, so every file is
+  then synced on its own, cheap as it is clean by then, for its own
+  result. Batches only form with several threads calling in (glusterfsd
+  with acceptors > 1); until a second one shows up there is no window.
+*/
+
+struct sync_waiter {
+  struct sync_waiter *next;
+  int fd;
+  int datasync;
+  dev_t dev;
+  int ret;
+  int op_errno;
+  char synced;  /* sync thread only */
+  char done;    /* under the lock */
+};
+
+struct sync_batch {
+  pthread_mutex_t lock;
+  pthread_cond_t queued;  /* wakes the sync thread */
+  pthread_cond_t synced;  /* wakes the waiters */
+  struct sync_waiter *pending;
+  int window;             /* usecs to wait for company */
+  pthread_t caller;       /* the first thread to call in */
+  char callers;           /* 0 none yet, 1 only caller, 2 more */
+  pthread_t thread;
+  char stopping;
+};
+
+struct sync_batch *sync_batch_new (int window);
+void sync_batch_destroy (struct sync_batch *batch);
+
+int sync_batch_fsync (struct sync_batch *batch, int fd, int datasync);
+
+#endif /* _SYNC_BATCH_H */
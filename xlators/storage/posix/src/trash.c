@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "trash.h"
+#include "logging.h"
+
+/* waits usecs, or until woken with wake set; returns 1 when stopping */
+static int
+trash_wait (struct trash *trash, long long usecs, int wake)
+{
+  struct timespec until;
+  int stopping;
+
+  clock_gettime (CLOCK_REALTIME, &until);
+  until.tv_sec += usecs / 1000000;
+  until.tv_nsec += (usecs % 1000000) * 1000;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock (&trash->lock);
+  while (!trash->stopping && !(wake && trash->pending) &&
+	 pthread_cond_timedwait (&trash->cond, &trash->lock, &until) != ETIMEDOUT)
+    ;
+  stopping = trash->stopping;
+  pthread_mutex_unlock (&trash->lock);
+  return stopping;
+}
+
+/* no one but us has the file open, as far as leases tell */
+static int
+trash_idle (int fd)
+{
+  if (fcntl (fd, F_SETLEASE, F_WRLCK) == -1)
+    return (errno != EAGAIN && errno != EBUSY);
+  /* only a probe, a lease broken later would signal us */
+  fcntl (fd, F_SETLEASE, F_UNLCK);
+  return 1;
+}
+
+/* removes one file of the trash bit by bit; returns 1 if it is still
+   open somewhere, it is tried again later then */
+static int
+trash_empty (struct trash *trash, const char *name)
+{
+  struct stat stbuf;
+  off_t size;
+  int fd;
+
+  fd = openat (trash->dir_fd, name, O_WRONLY | O_NOFOLLOW | O_NONBLOCK);
+  if (fd == -1) {
+    unlinkat (trash->dir_fd, name, 0);
+    return 0;
+  }
+  if (fstat (fd, &stbuf) == -1 || !S_ISREG (stbuf.st_mode) || stbuf.st_nlink > 1) {
+    /* not ours to cut down, only the name goes */
+    close (fd);
+    unlinkat (trash->dir_fd, name, 0);
+    return 0;
+  }
+  if (!trash_idle (fd)) {
+    close (fd);
+    return 1;
+  }
+
+  size = stbuf.st_size;
+  while (size > 0) {
+    size = (size > trash->step) ? size - trash->step : 0;
+    if (ftruncate (fd, size) == -1) {
+      gf_log ("posix", LOG_CRITICAL, "trash.c->trash_empty: %s: %s\n",
+	      name, strerror (errno));
+      break;
+    }
+    if (trash_wait (trash, trash->step * 1000000LL / trash->rate, 0)) {
+      /* the rest once the brick is back */
+      close (fd);
+      return 0;
+    }
+  }
+  close (fd);
+  unlinkat (trash->dir_fd, name, 0);
+  return 0;
+}
+
+/* everything in the trash once; returns whether something was busy */
+static int
+trash_pass (struct trash *trash)
+{
+  struct dirent *dent;
+  DIR *dir;
+  int fd, busy = 0;
+
+  /* an fd of its own, with its own offset */
+  fd = openat (trash->dir_fd, ".", O_RDONLY | O_DIRECTORY);
+  dir = (fd == -1) ? NULL : fdopendir (fd);
+  if (!dir) {
+    gf_log ("posix", LOG_CRITICAL, "trash.c->trash_pass: %s\n", strerror (errno));
+    if (fd != -1)
+      close (fd);
+    return 1;
+  }
+
+  while ((dent = readdir (dir)) && !trash->stopping) {
+    if (strcmp (dent->d_name, ".") == 0 || strcmp (dent->d_name, "..") == 0)
+      continue;
+    busy |= trash_empty (trash, dent->d_name);
+  }
+  closedir (dir);
+  return busy;
+}
+
+static void *
+trash_thread (void *arg)
+{
+  struct trash *trash = arg;
+
+  while (1) {
+    int busy;
+
+    pthread_mutex_lock (&trash->lock);
+    trash->pending = 0;
+    pthread_mutex_unlock (&trash->lock);
+
+    busy = trash_pass (trash);
+    /* without anything busy only a file moved in wakes us */
+    if (trash_wait (trash, busy ? TRASH_RETRY * 1000000LL : 24 * 3600 * 1000000LL, 1))
+      break;
+  }
+  return NULL;
+}
+
+struct trash *
+trash_new (int root_fd,
+	   off_t threshold,
+	   off_t step,
+	   off_t rate)
+{
+  struct trash *trash = calloc (1, sizeof (*trash));
+
+  trash->threshold = threshold;
+  trash->step = (step > 0) ? step : TRASH_STEP;
+  trash->rate = (rate > 0) ? rate : TRASH_RATE;
+  trash->seq = time (NULL);
+  pthread_mutex_init (&trash->lock, NULL);
+  pthread_cond_init (&trash->cond, NULL);
+
+  if (mkdirat (root_fd, TRASH_DIR, 0700) == -1 && errno != EEXIST)
+    goto err;
+  trash->dir_fd = openat (root_fd, TRASH_DIR, O_RDONLY | O_DIRECTORY);
+  if (trash->dir_fd == -1)
+    goto err;
+  /* files left over from the last run are gone through right away */
+  if (pthread_create (&trash->thread, NULL, trash_thread, trash) != 0) {
+    close (trash->dir_fd);
+    goto err;
+  }
+  return trash;
+
+ err:
+  gf_log ("posix", LOG_CRITICAL, "trash.c->trash_new: %s\n", strerror (errno));
+  pthread_cond_destroy (&trash->cond);
+  pthread_mutex_destroy (&trash->lock);
+  free (trash);
+  return NULL;
+}
+
+void
+trash_destroy (struct trash *trash)
+{
+  pthread_mutex_lock (&trash->lock);
+  trash->stopping = 1;
+  pthread_cond_signal (&trash->cond);
+  pthread_mutex_unlock (&trash->lock);
+  pthread_join (trash->thread, NULL);
+
+  close (trash->dir_fd);
+  pthread_cond_destroy (&trash->cond);
+  pthread_mutex_destroy (&trash->lock);
+  free (trash);
+}
+
+/* unlinkat () of name in dirfd, a large file only moved to the trash */
+int
+trash_unlink (struct trash *trash,
+	      int dirfd,
+	      const char *name)
+{
+  struct stat stbuf;
+  char trashed[32];
+
+  if (fstatat (dirfd, name, &stbuf, AT_SYMLINK_NOFOLLOW) == -1)
+    return -1;
+  if (!S_ISREG (stbuf.st_mode) || stbuf.st_nlink > 1 || stbuf.st_size < trash->threshold)
+    return unlinkat (dirfd, name, 0);
+
+  pthread_mutex_lock (&trash->lock);
+  snprintf (trashed, sizeof (trashed), "%08x.%llx", trash->seq++,
+	    (unsigned long long)stbuf.st_ino);
+  pthread_mutex_unlock (&trash->lock);
+
+  /* EXDEV for a directory mounted from elsewhere */
+  if (renameat (dirfd, name, trash->dir_fd, trashed) == -1)
+    return unlinkat (dirfd, name, 0);
+
+  pthread_mutex_lock (&trash->lock);
+  trash->pending = 1;
+  pthread_cond_signal (&trash->cond);
+  pthread_mutex_unlock (&trash->lock);
+  return 0;
+}
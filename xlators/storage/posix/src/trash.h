@@ -0,0 +1,42 @@
+#ifndef _TRASH_H
+#define _TRASH_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/*
+  Background removal of large files. posix_unlink () moves a regular
+  file of at least 'threshold' bytes with no other link into a hidden
+  directory at the root of the export, which takes no longer than any
+  rename. A thread then cuts each file down from the end, 'step' bytes
+  at a time and at no more than 'rate' bytes a second, and unlinks what
+  is left; the filesystem frees the blocks of one step at a time instead
+  of all at once. A file still open somewhere holds a lease off and is
+  left for a later pass. Files left over by a brick stopped midway are
+  removed once it starts again.
+*/
+
+#define TRASH_DIR        ".glusterfs-trash"  /* at the root of the export */
+#define TRASH_STEP       (256 * 1024 * 1024)
+#define TRASH_RATE       (1024 * 1024 * 1024) /* bytes a second */
+#define TRASH_RETRY      60                   /* seconds before busy files are tried again */
+
+struct trash {
+  int dir_fd;
+  off_t threshold;
+  off_t step;
+  off_t rate;
+  unsigned int seq;             /* names files moved in */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;          /* files moved in, or stopping */
+  char pending;
+  char stopping;
+  pthread_t thread;
+};
+
+struct trash *trash_new (int root_fd, off_t threshold, off_t step, off_t rate);
+void trash_destroy (struct trash *trash);
+
+int trash_unlink (struct trash *trash, int dirfd, const char *name);
+
+#endif /* _TRASH_H */
@@ -3,6 +3,7 @@
 #include "transport-socket.h"
 #include "dict.h"
 #include "protocol.h"
+#include "common-utils.h"
 #include "xlator.h"
 #include "logging.h"
 #include "layout.h"
@@ -872,6 +873,7 @@ brick_read (struct xlator *xl,
     dict_set (&request, "FD", int_to_data (fd));
     dict_set (&request, "OFFSET", int_to_data (offset));
     dict_set (&request, "LEN", int_to_data (size));
+    dict_set (&request, "SPARSE", int_to_data (1));
   }
 
   ret = fops_xfer (priv, OP_READ, &request, &reply);
@@ -882,13 +884,28 @@ brick_read (struct xlator *xl,
 
   ret = data_to_int (dict_get (&reply, "RET"));
   remote_errno = data_to_int (dict_get (&reply, "ERRNO"));
-  memcpy (buf, data_to_bin (dict_get (&reply, "BUF")), ret);
   
   if (ret < 0) {
     errno = remote_errno;
     goto ret;
   }
 
+  {
+    data_t *buf_data = dict_get (&reply, "BUF");
+    data_t *holes = dict_get (&reply, "HOLES");
+
+    /* holes of a sparse file are described, not sent */
+    if (holes) {
+      if (sparse_expand (buf, ret, buf_data->data, buf_data->len, holes->data) != 0) {
+	gf_log ("tcp", LOG_CRITICAL, "tcp.c->read: bad hole list for %s\n", path);
+	errno = EPROTO;
+	ret = -1;
+      }
+    } else {
+      memcpy (buf, buf_data->data, ret);
+    }
+  }
+
  ret:
   dict_destroy (&reply);
   return ret;
@@ -1652,32 +1669,261 @@ brick_fgetattr (struct xlator *xl,
 }
 
 
+static int
+brick_getdents (struct xlator *xl,
+		const char *path,
+		off_t offset,
+		char *buf,
+		size_t size,
+		off_t *next)
+{
+  int ret = 0;
+  int remote_errno = 0;
+  struct brick_private *priv = xl->private;
+  dict_t request = STATIC_DICT;
+  dict_t reply = STATIC_DICT;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+
+  {
+    dict_set (&request, "PATH", str_to_data ((char *)path));
+    dict_set (&request, "OFFSET", int_to_data (offset));
+    dict_set (&request, "SIZE", int_to_data (size));
+  }
+
+  ret = fops_xfer (priv, OP_GETDENTS, &request, &reply);
+  dict_destroy (&request);
+
+  if (ret != 0)
+    goto ret;
+
+  ret = data_to_int (dict_get (&reply, "RET"));
+  remote_errno = data_to_int (dict_get (&reply, "ERRNO"));
+  
+  if (ret < 0) {
+    errno = remote_errno;
+    goto ret;
+  }
+
+  {
+    data_t *datat = dict_get (&reply, "BUF");
+    int len = (datat->len < size) ? datat->len : size;
+
+    memcpy (buf, datat->data, len);
+    if (len)
+      buf[len - 1] = '\0';
+    *next = data_to_int (dict_get (&reply, "NEXT"));
+  }
+
+ ret:
+  dict_destroy (&reply);
+  return ret;
+}
+
+static int
+brick_copy (struct xlator *xl,
+	    const char *from,
+	    off_t from_offset,
+	    const char *to,
+	    off_t to_offset,
+	    size_t size)
+{
+  int ret = 0;
+  int remote_errno = 0;
+  struct brick_private *priv = xl->private;
+  dict_t request = STATIC_DICT;
+  dict_t reply = STATIC_DICT;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+
+  {
+    dict_set (&request, "FROM", str_to_data ((char *)from));
+    dict_set (&request, "FROM_OFFSET", int_to_data (from_offset));
+    dict_set (&request, "TO", str_to_data ((char *)to));
+    dict_set (&request, "TO_OFFSET", int_to_data (to_offset));
+    dict_set (&request, "SIZE", int_to_data (size));
+  }
+
+  ret = fops_xfer (priv, OP_COPY, &request, &reply);
+  dict_destroy (&request);
+
+  if (ret != 0)
+    goto ret;
+
+  ret = data_to_int (dict_get (&reply, "RET"));
+  remote_errno = data_to_int (dict_get (&reply, "ERRNO"));
+  
+  if (ret < 0)
+    errno = remote_errno;
+
+ ret:
+  dict_destroy (&reply);
+  return ret;
+}
+
+static int
+brick_seek (struct xlator *xl,
+	    const char *path,
+	    off_t offset,
+	    int whence,
+	    off_t *result,
+	    struct file_context *ctx)
+{
+  int ret = 0;
+  int remote_errno = 0;
+  struct brick_private *priv = xl->private;
+  dict_t request = STATIC_DICT;
+  dict_t reply = STATIC_DICT;
+  int fd;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  if (tmp == NULL) {
+    return -1;
+  }
+  fd = (int)tmp->context;
+
+  {
+    dict_set (&request, "PATH", str_to_data ((char *)path));
+    dict_set (&request, "FD", int_to_data (fd));
+    dict_set (&request, "OFFSET", int_to_data (offset));
+    dict_set (&request, "WHENCE", int_to_data (whence));
+  }
+
+  ret = fops_xfer (priv, OP_SEEK, &request, &reply);
+  dict_destroy (&request);
+
+  if (ret != 0)
+    goto ret;
+
+  ret = data_to_int (dict_get (&reply, "RET"));
+  remote_errno = data_to_int (dict_get (&reply, "ERRNO"));
+  
+  if (ret < 0) {
+    errno = remote_errno;
+    goto ret;
+  }
+  *result = data_to_int (dict_get (&reply, "OFFSET"));
+
+ ret:
+  dict_destroy (&reply);
+  return ret;
+}
+
+/* fallocate, discard and zerofill travel the same way */
+static int
+brick_range_op (struct xlator *xl,
+		int op,
+		const char *path,
+		int keep_size,
+		off_t offset,
+		size_t len,
+		struct file_context *ctx)
+{
+  int ret = 0;
+  int remote_errno = 0;
+  struct brick_private *priv = xl->private;
+  dict_t request = STATIC_DICT;
+  dict_t reply = STATIC_DICT;
+  int fd;
+  if (priv->is_debug) {
+    FUNCTION_CALLED;
+  }
+
+  struct file_context *tmp;
+  FILL_MY_CTX (tmp, ctx, xl);
+  if (tmp == NULL) {
+    return -1;
+  }
+  fd = (int)tmp->context;
+
+  {
+    dict_set (&request, "PATH", str_to_data ((char *)path));
+    dict_set (&request, "FD", int_to_data (fd));
+    dict_set (&request, "OFFSET", int_to_data (offset));
+    dict_set (&request, "LEN", int_to_data (len));
+    dict_set (&request, "KEEP_SIZE", int_to_data (keep_size));
+  }
+
+  ret = fops_xfer (priv, op, &request, &reply);
+  dict_destroy (&request);
+
+  if (ret != 0)
+    goto ret;
+
+  ret = data_to_int (dict_get (&reply, "RET"));
+  remote_errno = data_to_int (dict_get (&reply, "ERRNO"));
+  
+  if (ret < 0) {
+    errno = remote_errno;
+    goto ret;
+  }
+
+ ret:
+  dict_destroy (&reply);
+  return ret;
+}
+
+static int
+brick_fallocate (struct xlator *xl,
+		 const char *path,
+		 int keep_size,
+		 off_t offset,
+		 size_t len,
+		 struct file_context *ctx)
+{
+  return brick_range_op (xl, OP_FALLOCATE, path, keep_size, offset, len, ctx);
+}
+
+static int
+brick_discard (struct xlator *xl,
+	       const char *path,
+	       off_t offset,
+	       size_t len,
+	       struct file_context *ctx)
+{
+  return brick_range_op (xl, OP_DISCARD, path, 1, offset, len, ctx);
+}
+
+static int
+brick_zerofill (struct xlator *xl,
+		const char *path,
+		off_t offset,
+		size_t len,
+		struct file_context *ctx)
+{
+  return brick_range_op (xl, OP_ZEROFILL, path, 0, offset, len, ctx);
+}
+
 static int
 brick_bulk_getattr (struct xlator *xl,
 		    const char *path,
-		    struct bulk_stat *bstbuf)
+		    off_t offset,
+		    struct bulk_stat *bstbuf,
+		    off_t *next)
 {
-  struct bulk_stat *curr = NULL;
-  struct stat *stbuf = NULL;
-  char *buffer_ptr = NULL;
   struct brick_private *priv = xl->private;
   dict_t request = STATIC_DICT;
   dict_t reply = STATIC_DICT;
   int ret;
   int remote_errno;
-  char *buf = NULL;
-  unsigned int nr_entries = 0;
-  char pathname[PATH_MAX] = {0,};
-
-  /* play it safe */
-  bstbuf->stbuf = NULL;
-  bstbuf->next = NULL;
+  int nr_entries;
+  data_t *buf_data = NULL;
+  struct bulk_stat_record *records = NULL;
+  char *filename, *saveptr = NULL;
+  int index = 0;
 
   if (priv->is_debug) {
     FUNCTION_CALLED;
   }
   
   dict_set (&request, "PATH", str_to_data ((char *)path));
+  dict_set (&request, "OFFSET", int_to_data (offset));
 
   ret = fops_xfer (priv, OP_BULKGETATTR, &request, &reply);
   dict_destroy (&request);
@@ -1695,73 +1941,31 @@ brick_bulk_getattr (struct xlator *xl,
   }
   
   nr_entries = data_to_int (dict_get (&reply, "NR_ENTRIES"));
-  buf = data_to_bin (dict_get (&reply, "BUF"));
+  buf_data = dict_get (&reply, "BUF");
+  *next = data_to_int (dict_get (&reply, "NEXT"));
+  if (nr_entries <= 0)
+    goto fail;
+  if (!buf_data || !dict_get (&reply, "NAMES") ||
+      buf_data->len < nr_entries * sizeof (*records)) {
+    gf_log ("tcp", LOG_CRITICAL, "tcp.c->bulk_getattr: short reply for %s\n", path);
+    errno = EPROTO;
+    ret = -1;
+    goto fail;
+  }
+  records = data_to_bin (buf_data);
 
-  buffer_ptr = buf;
-  while (nr_entries) {
-    int bread = 0;
-    char tmp_buf[512] = {0,};
-    curr = calloc (sizeof (struct bulk_stat), 1);
-    curr->stbuf = calloc (sizeof (struct stat), 1);
-    
-    stbuf = curr->stbuf;
-    nr_entries--;
-    /*    sscanf (buffer_ptr, "%s", pathname);*/
-    char *ender = strchr (buffer_ptr, '/');
-    int count = ender - buffer_ptr;
-    strncpy (pathname, buffer_ptr, count);
-    bread = count + 1;
-    buffer_ptr += bread;
-
-    ender = strchr (buffer_ptr, '/');
-    count = ender - buffer_ptr;
-    if (!ender) {
-      gf_log ("transport-tcp", LOG_CRITICAL, "BUF: %s", buf);
-      raise (SIGSEGV);
-    }
+  /* names come in the same order as the records */
+  for (filename = strtok_r (data_to_str (dict_get (&reply, "NAMES")), "/", &saveptr);
+       filename && index < nr_entries;
+       filename = strtok_r (NULL, "/", &saveptr)) {
+    struct bulk_stat *curr = calloc (1, sizeof (*curr));
 
-    strncpy (tmp_buf, buffer_ptr, count);
-    bread = count + 1;
-    buffer_ptr += bread;
-    sscanf (tmp_buf, F_L64"x,"F_L64"x,%x,%lx,%x,%x,"F_L64"x,"F_L64"x,%lx,"F_L64"x,%lx,%lx,%lx,%lx,%lx,%lx",
-	    &stbuf->st_dev,
-	    &stbuf->st_ino,
-	    &stbuf->st_mode,
-	    &stbuf->st_nlink,
-	    &stbuf->st_uid,
-	    &stbuf->st_gid,
-	    &stbuf->st_rdev,
-	    &stbuf->st_size,
-	    &stbuf->st_blksize,
-	    &stbuf->st_blocks,
-	    &stbuf->st_atime,
-	    &stbuf->st_atim.tv_nsec,
-	    &stbuf->st_mtime,
-	    &stbuf->st_mtim.tv_nsec,
-	    &stbuf->st_ctime,
-	    &stbuf->st_ctim.tv_nsec);
+    curr->stbuf = calloc (1, sizeof (struct stat));
+    bulk_stat_unpack (curr->stbuf, &records[index++]);
+    curr->pathname = strdup (filename);
 
-    /*    bread = printf (F_L64"x,"F_L64"x,%x,%lx,%x,%x,"F_L64"x,"F_L64"x,%lx,"F_L64"x,%lx,%lx,%lx,%lx,%lx,%lx\n", 
-		    stbuf->st_dev,
-		    stbuf->st_ino,
-		    stbuf->st_mode,
-		    stbuf->st_nlink,
-		    stbuf->st_uid,
-		    stbuf->st_gid,
-		    stbuf->st_rdev,
-		    stbuf->st_size,
-		    stbuf->st_blksize,
-		    stbuf->st_blocks,
-		    stbuf->st_atime,
-		    stbuf->st_atim.tv_nsec,
-		    stbuf->st_mtime,
-		    stbuf->st_mtim.tv_nsec,
-		    stbuf->st_ctime,
-		    stbuf->st_ctim.tv_nsec);*/
-    curr->pathname = strdup (pathname);
     curr->next = bstbuf->next;
     bstbuf->next = curr;
-    memset (pathname, 0, PATH_MAX);
   }
 
  fail:
@@ -1769,6 +1973,7 @@ brick_bulk_getattr (struct xlator *xl,
   return ret;
 }
 
+
 /*
  * MGMT_OPS
  */
@@ -1802,14 +2007,22 @@ brick_stats (struct xlator *xl, struct xlator_stats *stats)
 
   {
     char *buf = data_to_bin (dict_get (&reply, "BUF"));
-    sscanf (buf, "%ulx,%lx,"F_L64"x,"F_L64"x,"F_L64"x,"F_L64"x,"F_L64"x\n",
+
+    /* an older server sends the first seven only */
+    memset (stats, 0, sizeof (*stats));
+    sscanf (buf, "%lx,%llx,%llx,%llx,%llx,%lx,%lx,%lx,%lx,%lx,%lx,%lx\n",
 	    &stats->nr_files,
 	    &stats->disk_usage,
 	    &stats->free_disk,
 	    &stats->read_usage,
 	    &stats->write_usage,
 	    &stats->disk_speed,
-	    &stats->nr_clients);
+	    &stats->nr_clients,
+	    &stats->read_iops,
+	    &stats->write_iops,
+	    &stats->latency_p50,
+	    &stats->latency_p90,
+	    &stats->latency_p99);
   }
 
  ret:
@@ -2079,7 +2292,13 @@ struct xlator_fops fops = {
   .access      = brick_access,
   .ftruncate   = brick_ftruncate,
   .fgetattr    = brick_fgetattr,
-  .bulk_getattr = brick_bulk_getattr
+  .bulk_getattr = brick_bulk_getattr,
+  .getdents    = brick_getdents,
+  .copy        = brick_copy,
+  .seek        = brick_seek,
+  .fallocate   = brick_fallocate,
+  .discard     = brick_discard,
+  .zerofill    = brick_zerofill
 };
 
 struct xlator_mgmt_ops mgmt_ops = {